@@ -0,0 +1,190 @@
+#ifndef ASYNC_WRITER_CPP
+#define ASYNC_WRITER_CPP
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include "Matrix.cpp"
+#include "MatrixText.cpp"
+
+/*
+* Output on a background thread, so printing or saving a result overlaps the work that
+* comes after it, typically the convolution of the next frame. Every job returns a
+* std::future that is ready when the job is done and rethrows what the job threw.
+*
+* The jobs run one at a time in the order they were submitted, so two prints to the
+* same stream never interleave. print() and save() copy the view first, so the caller
+* can overwrite it as soon as they return; submit() runs any job as it is, and the
+* caller keeps what it uses alive and unchanged until its future is ready.
+*/
+
+/**
+* Description: Copies a view into a matrix of its own
+* @params view, the view to copy
+* @returns std::shared_ptr<Matrix<T> >, the copy, shared with the job that writes it
+*/
+template <typename T>
+std::shared_ptr<Matrix<T> > copyMatrix(MatrixView<T> view)
+{
+	std::shared_ptr<Matrix<T> > copy = std::make_shared<Matrix<T> >(view.getRows(), view.getColumns(), MatrixLayout(), FILL_NONE);
+	const MatrixView<T> to = copy->view();
+	for(int i = 0; i < view.getRows(); i++)
+	{
+		std::memcpy(to.getRow(i), view.getRow(i), view.getColumns()*sizeof(T));
+	}
+	return copy;
+}
+
+class AsyncWriter
+{
+public:
+	///////////////////////////////////////
+	//CONSTRUCTORS AND DESTRUCTORS
+	///////////////////////////////////////
+	AsyncWriter();
+	~AsyncWriter();
+
+	AsyncWriter(const AsyncWriter &) = delete;
+	AsyncWriter & operator=(const AsyncWriter &) = delete;
+
+	///////////////////////////////////////
+	//JOB SUBMISSION
+	///////////////////////////////////////
+	std::future<void> submit(std::function<void()> job);
+
+	template <typename T>
+	std::future<void> print(MatrixView<T> view, std::ostream & out);
+
+	template <typename T>
+	std::future<void> save(MatrixView<T> view, const std::string & path);
+
+private:
+	void work();
+
+	///////////////////////////////////////
+	//PRIVATE DATA VARIABLES
+	///////////////////////////////////////
+	/**
+	* Guards jobs and stopping
+	*/
+	std::mutex lock;
+	std::condition_variable wake;
+
+	/**
+	* The jobs not started yet, in submission order
+	*/
+	std::deque<std::packaged_task<void()> > jobs;
+
+	/**
+	* Set by the destructor, the worker finishes the queued jobs and returns
+	*/
+	bool stopping;
+
+	std::thread worker;
+};
+
+/**
+* Description: Starts the writer thread, which sleeps until a job is submitted
+*/
+AsyncWriter::AsyncWriter() : stopping(false)
+{
+	worker = std::thread(&AsyncWriter::work, this);
+}
+
+/**
+* Description: Runs the jobs still queued, then stops the writer thread
+*/
+AsyncWriter::~AsyncWriter()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_one();
+	worker.join();
+}
+
+/**
+* Description: Queues a job for the writer thread
+* @params job, the job, what it uses must stay valid until its future is ready
+* @returns std::future<void>, ready when the job is done, get() rethrows its exception
+*/
+std::future<void> AsyncWriter::submit(std::function<void()> job)
+{
+	std::packaged_task<void()> task(job);
+	std::future<void> done = task.get_future();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs.push_back(std::move(task));
+	}
+	wake.notify_one();
+	return done;
+}
+
+/**
+* Description: Writes a view as text (writeMatrixText()) on the writer thread
+* Implementation: The view is copied before this returns, the stream is used by the
+* writer thread until the future is ready
+* @params view, the matrix or region to print
+* @params out, the stream to print to
+* @returns std::future<void>, ready when the text is written and flushed
+*/
+template <typename T>
+std::future<void> AsyncWriter::print(MatrixView<T> view, std::ostream & out)
+{
+	std::shared_ptr<Matrix<T> > copy = copyMatrix(view);
+	std::ostream * stream = &out;
+	return submit([copy, stream]()
+	{
+		writeMatrixText(copy->view(), *stream);
+	});
+}
+
+/**
+* Description: Writes a view to a matrix file (Matrix::save()) on the writer thread
+* @params view, the matrix or region to save, copied before this returns
+* @params path, the path of the matrix file
+* @returns std::future<void>, ready when the file is written, get() throws
+* std::runtime_error if it cannot be
+*/
+template <typename T>
+std::future<void> AsyncWriter::save(MatrixView<T> view, const std::string & path)
+{
+	std::shared_ptr<Matrix<T> > copy = copyMatrix(view);
+	return submit([copy, path]()
+	{
+		copy->save(path);
+	});
+}
+
+/**
+* Description: The loop of the writer thread, runs the jobs in order until stopped
+*/
+void AsyncWriter::work()
+{
+	while(true)
+	{
+		std::packaged_task<void()> task;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this] { return stopping || !jobs.empty(); });
+			if(jobs.empty())
+			{
+				return;
+			}
+			task = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		//a packaged_task stores the exception of its job in the future
+		task();
+	}
+}
+
+#endif
@@ -0,0 +1,325 @@
+#ifndef BATCH_CPP
+#define BATCH_CPP
+
+#include <istream>
+#include <ostream>
+#include <vector>
+#include <future>
+#include <chrono>
+#include <stdexcept>
+#include "Convolution.cpp"
+#include "AsyncWriter.cpp"
+
+/*
+* Multi-frame convolution for video streams: many same-sized frames per call instead of
+* one matrix per run. convolveBatch() spreads the frames and row bands of a batch over a
+* thread pool, convolveFrames() pipelines a stream of frames so that reading frame k+1
+* overlaps with convolving frame k. Both reuse the output buffers they are given.
+*/
+
+///////////////////////////////////////
+//FRAME VIEWS
+///////////////////////////////////////
+/**
+* Description: Splits a contiguous 3D buffer of frames into one view per frame
+* Implementation: Frame f starts f*frameStride elements after 'data', every frame has
+* 'rows' rows that are 'stride' elements apart
+* @params data, pointer to row 0, column 0 of frame 0
+* @params frames, the number of frames
+* @params rows, the row size of every frame
+* @params columns, the column size of every frame
+* @params stride, the distance in elements between two rows of a frame
+* @params frameStride, the distance in elements between two frames, at least rows*stride
+* @returns std::vector<MatrixView<T>>, the views of the frames
+*/
+template <typename T>
+std::vector<MatrixView<T> > frameViews(T * data, int frames, int rows, int columns, int stride, long frameStride)
+{
+	std::vector<MatrixView<T> > views;
+	views.reserve(frames);
+	for(int f = 0; f < frames; f++)
+	{
+		views.push_back(MatrixView<T>(data + f*frameStride, rows, columns, stride));
+	}
+	return views;
+}
+
+/**
+* Description: frameViews() for packed frames, stride = columns and frameStride = rows*columns
+*/
+template <typename T>
+std::vector<MatrixView<T> > frameViews(T * data, int frames, int rows, int columns)
+{
+	return frameViews(data, frames, rows, columns, columns, (long)rows*columns);
+}
+
+///////////////////////////////////////
+//BATCH CONVOLUTION
+///////////////////////////////////////
+/**
+* Description: Convolves N same-sized frames with the filter [-1, 0, 1]
+* Implementation: The batch is cut into tasks of one row band of one frame. With at least
+* as many frames as threads every task is a whole frame, so the threads never share a
+* frame; with fewer frames than threads each frame is split into enough bands to keep
+* every thread busy. Every task runs the SIMD row kernels on its rows, exactly like
+* convolveParallel() does for a single frame.
+* Throws: std::invalid_argument if the three lists do not have the same length
+* Preconditions: all frames and outputs have the same row and column size
+* Postconditions: Dx[f] and Dy[f] hold the convolution of frames[f], identical to convolve()
+* @params frames, the input frames
+* @params Dx, the horizontal results, one per frame
+* @params Dy, the vertical results, one per frame
+* @params pool, the thread pool to run the tasks on
+* @return NONE
+*/
+void convolveBatch(const std::vector<MatrixView<unsigned char> > & frames, const std::vector<MatrixView<short int> > & Dx,
+	const std::vector<MatrixView<short int> > & Dy, ThreadPool & pool)
+{
+	if(Dx.size() != frames.size() || Dy.size() != frames.size())
+	{
+		throw std::invalid_argument("convolveBatch needs one Dx and one Dy per frame");
+	}
+	if(frames.empty())
+	{
+		return;
+	}
+	const int count = (int)frames.size();
+	const int rows = frames[0].getRows();
+	const int bands = std::max(1, std::min(rows, (pool.getThreads() + count - 1) / count));
+	const RowKernels kernels = simdRowKernels(simdLevel());
+
+	pool.run(count*bands, [&](int task)
+	{
+		const int frame = task / bands;
+		const int band = task % bands;
+		RowKernels taskKernels = kernels;
+		convolveRowRange(frames[frame], Dx[frame], Dy[frame], taskKernels, bandStart(rows, bands, band), bandStart(rows, bands, band+1));
+	});
+}
+
+///////////////////////////////////////
+//FRAME SOURCES AND SINKS
+///////////////////////////////////////
+/**
+* Supplier of the frames for convolveFrames()
+*/
+class FrameSource
+{
+public:
+	virtual ~FrameSource() {}
+
+	/**
+	* Description: Reads the next frame
+	* @params frame, receives the frame, its size is the frame size of the stream
+	* @returns bool, true if a frame was read, false at the end of the stream
+	*/
+	virtual bool readFrame(MatrixView<unsigned char> frame) = 0;
+};
+
+/**
+* Receiver of the results of convolveFrames()
+*/
+class FrameSink
+{
+public:
+	virtual ~FrameSink() {}
+
+	/**
+	* Description: Receives the results of one frame, in frame order
+	* @params index, the frame number, starting at 0
+	* @params Dx, the horizontal result, only valid during the call
+	* @params Dy, the vertical result, only valid during the call
+	* @returns NONE
+	*/
+	virtual void writeFrame(long index, MatrixView<short int> Dx, MatrixView<short int> Dy) = 0;
+};
+
+/**
+* FrameSource reading raw unsigned char frames, rows*columns bytes each, from a stream
+*/
+class StreamFrameSource : public FrameSource
+{
+public:
+	StreamFrameSource(std::istream & in) : in(in) {}
+
+	bool readFrame(MatrixView<unsigned char> frame)
+	{
+		for(int i = 0; i < frame.getRows(); i++)
+		{
+			in.read((char *)frame.getRow(i), frame.getColumns());
+			if(in.gcount() != frame.getColumns())
+			{
+				if(i > 0 || in.gcount() > 0)
+				{
+					std::cout << "ERROR: incomplete last frame, the frame is ignored" << std::endl;
+				}
+				return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	std::istream & in;
+};
+
+/**
+* FrameSink writing the raw short int rows of Dx and Dy to two streams, frame after frame
+*/
+class StreamFrameSink : public FrameSink
+{
+public:
+	StreamFrameSink(std::ostream & dxOut, std::ostream & dyOut) : dxOut(dxOut), dyOut(dyOut) {}
+
+	void writeFrame(long, MatrixView<short int> Dx, MatrixView<short int> Dy)
+	{
+		const long rowBytes = (long)Dx.getColumns()*sizeof(short int);
+		for(int i = 0; i < Dx.getRows(); i++)
+		{
+			dxOut.write((const char *)Dx.getRow(i), rowBytes);
+			dyOut.write((const char *)Dy.getRow(i), rowBytes);
+		}
+	}
+
+private:
+	std::ostream & dxOut;
+	std::ostream & dyOut;
+};
+
+/**
+* FrameSink handing the frames to another sink on the thread of an AsyncWriter, so
+* convolveFrames() convolves the next frame while the last one is written. Dx and Dy
+* are copied in writeFrame(), and at most maxPending frames wait to be written: a
+* slower target then holds the convolution back instead of piling up copies.
+*/
+class AsyncFrameSink : public FrameSink
+{
+public:
+	/**
+	* @params target, the sink that writes the frames, used on the writer thread only
+	* @params writer, the writer thread
+	* @params maxPending, the most frames copied and not written yet
+	*/
+	AsyncFrameSink(FrameSink & target, AsyncWriter & writer, int maxPending = 2)
+		: target(target), writer(writer), maxPending(std::max(1, maxPending)) {}
+
+	/**
+	* Description: Waits for the frames not written yet, an error of one of them is lost
+	*/
+	~AsyncFrameSink()
+	{
+		for(std::future<void> & frame : pending)
+		{
+			frame.wait();
+		}
+	}
+
+	void writeFrame(long index, MatrixView<short int> Dx, MatrixView<short int> Dy)
+	{
+		while((int)pending.size() >= maxPending)
+		{
+			pending.front().get();
+			pending.pop_front();
+		}
+		std::shared_ptr<Matrix<short int> > dx = copyMatrix(Dx);
+		std::shared_ptr<Matrix<short int> > dy = copyMatrix(Dy);
+		FrameSink * to = &target;
+		pending.push_back(writer.submit([to, index, dx, dy]()
+		{
+			to->writeFrame(index, dx->view(), dy->view());
+		}));
+	}
+
+	/**
+	* Description: Waits until every frame is written
+	* Throws: what the target threw while writing a frame
+	* @returns NONE
+	*/
+	void finish()
+	{
+		while(!pending.empty())
+		{
+			std::future<void> frame = std::move(pending.front());
+			pending.pop_front();
+			frame.get();
+		}
+	}
+
+private:
+	FrameSink & target;
+	AsyncWriter & writer;
+	const int maxPending;
+	std::deque<std::future<void> > pending;
+};
+
+///////////////////////////////////////
+//PIPELINED CONVOLUTION
+///////////////////////////////////////
+/**
+* Frames processed by convolveFrames() and the wall-clock time they took
+*/
+struct FrameThroughput
+{
+	long frames;
+	double seconds;
+
+	double framesPerSecond() const
+	{
+		return (seconds > 0.0) ? frames / seconds : 0.0;
+	}
+};
+
+/**
+* Description: Convolves every frame of a source with the filter [-1, 0, 1], pipelined
+* Implementation: Two input frames are double-buffered. While the pool convolves frame k
+* from one buffer, frame k+1 is read into the other buffer on a separate thread (a
+* std::async task), so reading and convolving overlap and the slower of the two sets the
+* frame rate. Dx and Dy are allocated once and handed to the sink after every frame, so
+* the sink must consume or copy them before returning.
+* Preconditions: every frame of the source has 'rows' x 'columns' elements
+* Postconditions: the sink has received the results of every frame, in order
+* @params source, supplies the frames
+* @params sink, receives Dx and Dy of every frame
+* @params rows, the row size of the frames
+* @params columns, the column size of the frames
+* @params pool, the thread pool the frames are convolved on
+* @return FrameThroughput, the number of frames and the time taken
+*/
+FrameThroughput convolveFrames(FrameSource & source, FrameSink & sink, int rows, int columns, ThreadPool & pool)
+{
+	MatrixLayout layout;
+	layout.padRows = true;
+	Matrix<unsigned char> current(rows, columns, layout, FILL_NONE);
+	Matrix<unsigned char> next(rows, columns, layout, FILL_NONE);
+	Matrix<short int> Dx(rows, columns, layout, FILL_NONE);
+	Matrix<short int> Dy(rows, columns, layout, FILL_NONE);
+	std::vector<MatrixView<unsigned char> > frame(1);
+	std::vector<MatrixView<short int> > dx(1, Dx.view());
+	std::vector<MatrixView<short int> > dy(1, Dy.view());
+
+	FrameThroughput throughput = { 0, 0.0 };
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	bool haveFrame = source.readFrame(current);
+	while(haveFrame)
+	{
+		//start reading the next frame, then convolve this one while it loads
+		MatrixView<unsigned char> loading = next.view();
+		std::future<bool> loaded = std::async(std::launch::async, [&source, loading]
+		{
+			return source.readFrame(loading);
+		});
+
+		frame[0] = current.view();
+		convolveBatch(frame, dx, dy, pool);
+		sink.writeFrame(throughput.frames++, Dx, Dy);
+
+		haveFrame = loaded.get();
+		std::swap(current, next);
+	}
+
+	throughput.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return throughput;
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef BENCHMARK_CPP
+#define BENCHMARK_CPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+/*
+* Timing of repeated runs for the --bench mode of the driver. The run is repeated
+* 'warmup' times untimed, so the caches, page tables and thread pool are warm, and then
+* 'repetitions' times with every repetition timed on its own.
+*/
+
+/**
+* Summary of the timed repetitions of one run
+*/
+struct TimingSummary
+{
+	int samples;
+	double minSeconds;
+	double medianSeconds;
+	double p99Seconds;
+};
+
+/**
+* Description: Runs a callable warmup + repetitions times and times the last repetitions
+* Implementation: Every repetition is timed with std::chrono::steady_clock, which never
+* jumps with the wall clock
+* @params warmup, the untimed runs done first
+* @params repetitions, the timed runs
+* @params run, the callable to time
+* @returns std::vector<double>, the time of every timed run in seconds
+*/
+template <typename Run>
+std::vector<double> timeRepetitions(int warmup, int repetitions, Run run)
+{
+	for(int k = 0; k < warmup; k++)
+	{
+		run();
+	}
+	std::vector<double> seconds;
+	seconds.reserve(repetitions);
+	for(int k = 0; k < repetitions; k++)
+	{
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		run();
+		seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	return seconds;
+}
+
+/**
+* Description: Computes the min, median and 99th percentile of a list of times
+* Implementation: Sorts the times, the median of an even count is the mean of the two
+* middle times and the percentile is the nearest-rank one, so with fewer than 100 samples
+* the p99 is the slowest run
+* @params seconds, the times, must not be empty
+* @returns TimingSummary, the summary
+*/
+TimingSummary summarizeTimings(std::vector<double> seconds)
+{
+	std::sort(seconds.begin(), seconds.end());
+	const int count = (int)seconds.size();
+	TimingSummary summary;
+	summary.samples = count;
+	summary.minSeconds = seconds[0];
+	summary.medianSeconds = (count % 2 == 1) ? seconds[count/2] : (seconds[count/2 - 1] + seconds[count/2]) / 2.0;
+	const int rank = (int)std::ceil(0.99*count);
+	summary.p99Seconds = seconds[std::max(rank, 1) - 1];
+	return summary;
+}
+
+#endif
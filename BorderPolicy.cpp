@@ -0,0 +1,80 @@
+#ifndef BORDER_POLICY_CPP
+#define BORDER_POLICY_CPP
+
+/*
+* Border policies for the kernel convolution engine (KernelConvolution.cpp).
+* A policy decides which element a kernel tap reads when it falls outside the matrix.
+* It is a template parameter of the engine, so only the border columns and rows call
+* index(), and the interior loop is the same branch-free loop for every policy.
+*
+* For a row "a b c d" and a tap two positions out of range on each side:
+*   WrapBorder     c d | a b c d | a b    the opposite end, as convolve() does
+*   ClampBorder    a a | a b c d | d d    the edge element repeated
+*   MirrorBorder   c b | a b c d | c b    reflected about the edge element
+*   ZeroBorder     0 0 | a b c d | 0 0    zeros
+*   ValidBorder    no output for positions whose taps leave the matrix, the result
+*                  has 2*radius fewer columns (horizontal) or rows (vertical)
+*/
+
+/**
+* index(i, n) maps a position i, possibly outside [0, n), to the position read in its
+* place, or to -1 when the tap reads a zero
+*/
+struct WrapBorder
+{
+	static const bool valid = false;
+
+	static int index(int i, int n)
+	{
+		return ((i % n) + n) % n;
+	}
+};
+
+struct ClampBorder
+{
+	static const bool valid = false;
+
+	static int index(int i, int n)
+	{
+		return (i < 0) ? 0 : (i >= n) ? n - 1 : i;
+	}
+};
+
+struct MirrorBorder
+{
+	static const bool valid = false;
+
+	static int index(int i, int n)
+	{
+		if(n == 1)
+		{
+			return 0;
+		}
+		//reflecting repeats with a period of 2*(n-1), kernels wider than the matrix fold several times
+		const int period = 2*(n - 1);
+		i = ((i % period) + period) % period;
+		return (i < n) ? i : period - i;
+	}
+};
+
+struct ZeroBorder
+{
+	static const bool valid = false;
+
+	static int index(int i, int n)
+	{
+		return (i < 0 || i >= n) ? -1 : i;
+	}
+};
+
+struct ValidBorder
+{
+	static const bool valid = true;
+
+	static int index(int i, int)
+	{
+		return i;
+	}
+};
+
+#endif
@@ -0,0 +1,311 @@
+#ifndef COMMAND_LINE_CPP
+#define COMMAND_LINE_CPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+* Command line options of the driver. parseArguments() turns argv into a DriverOptions
+* once, so the engines get plain values and never look anything up while they run.
+*/
+
+/**
+* Convolution engines the user can choose from
+* ENGINE_NAIVE is the original per-pixel convolve() from NaiveConvolution.cpp
+* ENGINE_SPLIT is the interior/border split engine from Convolution.cpp
+* ENGINE_SIMD is the split engine with SSE4.1/AVX2 row kernels
+* ENGINE_FUSED is the SIMD engine that also computes the min/max of Dx and Dy in the same sweep
+* ENGINE_TILED is the SIMD engine walking cache-sized column strips, for very wide matrices
+* ENGINE_GHOST is the SIMD engine on aligned, padded rows with ghost cells holding the wrap-around
+* ENGINE_KERNEL is the generic separable convolution from KernelConvolution.cpp
+* ENGINE_GRADIENT is the SIMD engine plus gradient magnitude and orientation from Gradient.cpp
+* ENGINE_BATCH convolves a batch of frames with convolveBatch() from Batch.cpp
+* ENGINE_STREAM reads M row by row from a raw file with convolveStream() from Streaming.cpp
+* ENGINE_COMPACT is the SIMD engine writing signed char Dx and Dy, from CompactConvolution.cpp
+*/
+enum ConvolutionEngine { ENGINE_NAIVE, ENGINE_SPLIT, ENGINE_SIMD, ENGINE_FUSED, ENGINE_TILED, ENGINE_GHOST, ENGINE_KERNEL,
+	ENGINE_GRADIENT, ENGINE_BATCH, ENGINE_STREAM, ENGINE_COMPACT };
+const char * const ENGINE_NAMES[] = { "naive", "split", "simd", "fused", "tiled", "ghost", "kernel", "gradient", "batch", "stream", "compact" };
+
+/**
+* Border policies of the kernel engine, see BorderPolicy.cpp. Every other engine wraps around.
+* BORDER_VALID shrinks the results by the radius of the kernel on each side.
+*/
+enum BorderMode { BORDER_WRAP, BORDER_CLAMP, BORDER_MIRROR, BORDER_ZERO, BORDER_VALID };
+const char * const BORDER_NAMES[] = { "wrap", "clamp", "mirror", "zero", "valid" };
+
+/**
+* Gradient operators of the kernel engine
+* KERNEL_CENTRAL is [-1, 0, 1] along one axis, the Dx and Dy of every other engine
+* KERNEL_SOBEL and KERNEL_SCHARR also smooth across the gradient with [1, 2, 1] and [3, 10, 3]
+*/
+enum KernelChoice { KERNEL_CENTRAL, KERNEL_SOBEL, KERNEL_SCHARR };
+const char * const KERNEL_NAMES[] = { "central", "sobel", "scharr" };
+
+/**
+* Element types of M. Every engine takes uint8, the wider types go through the kernel
+* engine, which writes int Dx and Dy for the 16-bit types and float/double for the
+* floating point ones (see ConvolutionTypes in KernelConvolution.cpp)
+*/
+enum ElementType { ELEMENT_UINT8, ELEMENT_UINT16, ELEMENT_INT16, ELEMENT_FLOAT, ELEMENT_DOUBLE };
+const char * const ELEMENT_NAMES[] = { "uint8", "uint16", "int16", "float", "double" };
+
+/**
+* How the compact engine narrows the 9-bit gradients to signed chars, see CompactMode
+* NARROW_SATURATE clamps them to [-128, 127], NARROW_HALVE shifts them right by one
+*/
+enum NarrowMode { NARROW_SATURATE, NARROW_HALVE };
+const char * const NARROW_NAMES[] = { "saturate", "halve" };
+
+/**
+* Everything the user chose, from the command line or from the interactive prompts
+*/
+struct DriverOptions
+{
+	int rows = 0;
+	int columns = 0;
+	bool toPrint = false;
+	ConvolutionEngine engine = ENGINE_SIMD;
+	ElementType dtype = ELEMENT_UINT8;
+	NarrowMode narrow = NARROW_SATURATE;
+	bool interleave = false;
+	KernelChoice kernel = KERNEL_CENTRAL;
+	BorderMode border = BORDER_WRAP;
+	int stripColumns = 0;
+	int threads = 0;
+	uint64_t seed = 0;
+	int frames = 8;
+	bool bench = false;
+	int repetitions = 1;
+	int warmup = 0;
+	std::string input;
+	std::string output;
+	std::string stats;
+	std::vector<double> percentiles;
+};
+
+/**
+* Description: Prints the command line help
+* @params out, the stream to print to
+* @returns NONE
+*/
+void printUsage(std::ostream & out)
+{
+	out << "usage: convolution.exe [options]" << std::endl
+		<< "  without options the rows, columns and engine are asked for interactively" << std::endl
+		<< std::endl
+		<< "  --rows N          rows of M" << std::endl
+		<< "  --cols N          columns of M" << std::endl
+		<< "  --dtype T         element type of M, uint8 (default), uint16, int16, float, double;" << std::endl
+		<< "                    the types other than uint8 run the kernel engine" << std::endl
+		<< "  --engine E        naive, split, simd (default), fused, tiled, ghost, kernel, gradient, batch, stream, compact" << std::endl
+		<< "  --narrow N        saturate (default) or halve, how the compact engine fits Dx and Dy in signed chars" << std::endl
+		<< "  --interleave      the compact engine writes Dx and Dy as pairs in one matrix, PREFIX_dxdy" << std::endl
+		<< "  --kernel K        central (default), sobel, scharr, for the kernel engine" << std::endl
+		<< "  --border B        wrap (default), clamp, mirror, zero, valid, for the kernel engine" << std::endl
+		<< "  --strip N         strip width in columns for the tiled engine, 0 = from the cache size" << std::endl
+		<< "  --threads N       threads, 0 = all cores (default)" << std::endl
+		<< "  --seed N          seed of the random M, 0 = from the clock (default)" << std::endl
+		<< "  --frames N        frames per batch for the batch engine (default 8)" << std::endl
+		<< "  --input FILE      read M from a matrix file, or raw rows for the stream engine" << std::endl
+		<< "  --output PREFIX   write Dx and Dy to PREFIX_dx and PREFIX_dy" << std::endl
+		<< "  --print           print M, Dx and Dy" << std::endl
+		<< "  --percentiles P   comma separated percentiles of Dx and Dy to print with their mean and" << std::endl
+		<< "                    variance, from one histogram pass, e.g. 1,50,99.9" << std::endl
+		<< "  --stats FILE      write the time and hardware counters of every stage to FILE, CSV for" << std::endl
+		<< "                    a .csv name and JSON otherwise, needs a build with CONVOLUTION_INSTRUMENT" << std::endl
+		<< "  --bench           time every repetition and report min/median/p99 and throughput" << std::endl
+		<< "  --reps N          timed repetitions (default 1, or 10 with --bench)" << std::endl
+		<< "  --warmup N        untimed repetitions before the timed ones (default 0, or 2 with --bench)" << std::endl
+		<< "  --help            show this help" << std::endl;
+}
+
+/**
+* Description: Parses a whole-number option value
+* Throws: std::invalid_argument if the text is not a number of at least 'minimum'
+* @params text, the value
+* @params flag, the option, used in the error message
+* @params minimum, the smallest accepted value
+* @returns long long, the value
+*/
+long long parseNumber(const char * text, const std::string & flag, long long minimum)
+{
+	char * end = nullptr;
+	const long long value = std::strtoll(text, &end, 10);
+	if(end == text || *end != '\0' || value < minimum)
+	{
+		throw std::invalid_argument(flag + " needs a whole number of at least " + std::to_string(minimum) + ", got '" + text + "'");
+	}
+	return value;
+}
+
+/**
+* Description: Parses a comma separated list of percentiles
+* Throws: std::invalid_argument if an entry is not a number in [0, 100]
+* @params text, the value
+* @params flag, the option, used in the error message
+* @returns std::vector<double>, the percentiles in the order given
+*/
+std::vector<double> parsePercentiles(const char * text, const std::string & flag)
+{
+	std::vector<double> percentiles;
+	const char * start = text;
+	while(true)
+	{
+		char * end = nullptr;
+		const double value = std::strtod(start, &end);
+		if(end == start || (*end != ',' && *end != '\0') || !(value >= 0.0 && value <= 100.0))
+		{
+			throw std::invalid_argument(flag + " needs comma separated numbers in [0, 100], got '" + text + "'");
+		}
+		percentiles.push_back(value);
+		if(*end == '\0')
+		{
+			return percentiles;
+		}
+		start = end + 1;
+	}
+}
+
+/**
+* Description: Parses an option value that must be one of a list of names
+* Throws: std::invalid_argument if the text is not one of the names
+* @params text, the value
+* @params flag, the option, used in the error message
+* @params names, the accepted names
+* @params count, the number of names
+* @returns int, the index of the name
+*/
+int parseChoice(const char * text, const std::string & flag, const char * const * names, int count)
+{
+	for(int k = 0; k < count; k++)
+	{
+		if(std::strcmp(text, names[k]) == 0)
+		{
+			return k;
+		}
+	}
+	std::string accepted;
+	for(int k = 0; k < count; k++)
+	{
+		accepted += (k > 0) ? ", " : "";
+		accepted += names[k];
+	}
+	throw std::invalid_argument(flag + " must be one of " + accepted + ", got '" + text + "'");
+}
+
+/**
+* Description: Turns the command line into DriverOptions
+* Throws: std::invalid_argument for an unknown option, a missing or bad value, or a
+* combination of options that cannot run
+* @params argc, the argument count of main()
+* @params argv, the arguments of main()
+* @params help, set to true if --help was given
+* @returns DriverOptions, the options
+*/
+DriverOptions parseArguments(int argc, char ** argv, bool & help)
+{
+	DriverOptions options;
+	bool repetitionsGiven = false;
+	bool warmupGiven = false;
+	bool engineGiven = false;
+	help = false;
+
+	for(int k = 1; k < argc; k++)
+	{
+		const std::string flag = argv[k];
+		if(flag == "--help" || flag == "-h")
+		{
+			help = true;
+			return options;
+		}
+		if(flag == "--print")
+		{
+			options.toPrint = true;
+			continue;
+		}
+		if(flag == "--bench")
+		{
+			options.bench = true;
+			continue;
+		}
+		if(flag == "--interleave")
+		{
+			options.interleave = true;
+			continue;
+		}
+
+		//every other option takes a value
+		if(k + 1 >= argc)
+		{
+			throw std::invalid_argument(flag + " needs a value");
+		}
+		const char * value = argv[++k];
+		if(flag == "--rows") options.rows = (int)parseNumber(value, flag, 1);
+		else if(flag == "--cols" || flag == "--columns") options.columns = (int)parseNumber(value, flag, 1);
+		else if(flag == "--dtype") options.dtype = (ElementType)parseChoice(value, flag, ELEMENT_NAMES, 5);
+		else if(flag == "--engine") { options.engine = (ConvolutionEngine)parseChoice(value, flag, ENGINE_NAMES, 11); engineGiven = true; }
+		else if(flag == "--narrow") options.narrow = (NarrowMode)parseChoice(value, flag, NARROW_NAMES, 2);
+		else if(flag == "--kernel") options.kernel = (KernelChoice)parseChoice(value, flag, KERNEL_NAMES, 3);
+		else if(flag == "--border") options.border = (BorderMode)parseChoice(value, flag, BORDER_NAMES, 5);
+		else if(flag == "--strip") options.stripColumns = (int)parseNumber(value, flag, 0);
+		else if(flag == "--threads") options.threads = (int)parseNumber(value, flag, 0);
+		else if(flag == "--seed") options.seed = (uint64_t)parseNumber(value, flag, 0);
+		else if(flag == "--frames") options.frames = (int)parseNumber(value, flag, 1);
+		else if(flag == "--reps") { options.repetitions = (int)parseNumber(value, flag, 1); repetitionsGiven = true; }
+		else if(flag == "--warmup") { options.warmup = (int)parseNumber(value, flag, 0); warmupGiven = true; }
+		else if(flag == "--input") options.input = value;
+		else if(flag == "--output") options.output = value;
+		else if(flag == "--stats") options.stats = value;
+		else if(flag == "--percentiles") options.percentiles = parsePercentiles(value, flag);
+		else throw std::invalid_argument("unknown option " + flag + ", see --help");
+	}
+
+	if(options.bench)
+	{
+		options.repetitions = repetitionsGiven ? options.repetitions : 10;
+		options.warmup = warmupGiven ? options.warmup : 2;
+	}
+
+	//only the kernel engine is generic over the element type, it is the default for the wider types
+	if(options.dtype != ELEMENT_UINT8 && !engineGiven)
+	{
+		options.engine = ENGINE_KERNEL;
+	}
+	if(options.dtype != ELEMENT_UINT8 && options.engine != ENGINE_KERNEL)
+	{
+		throw std::invalid_argument(std::string("--dtype ") + ELEMENT_NAMES[options.dtype] + " needs the kernel engine, the " + ENGINE_NAMES[options.engine] + " engine is uint8 only");
+	}
+
+	//the size comes from the input file, except for raw rows where only the rows are counted
+	if(options.input.empty() && (options.rows < 1 || options.columns < 1))
+	{
+		throw std::invalid_argument("--rows and --cols are required without --input");
+	}
+	if(options.engine == ENGINE_STREAM && (options.input.empty() || options.columns < 1))
+	{
+		throw std::invalid_argument("the stream engine needs --input with raw rows and --cols");
+	}
+	//the histogram is of uint8 results, one matrix each for Dx and Dy
+	if(!options.percentiles.empty() && (options.dtype != ELEMENT_UINT8 || options.interleave
+		|| options.engine == ENGINE_BATCH || options.engine == ENGINE_STREAM))
+	{
+		throw std::invalid_argument("--percentiles needs uint8 input and planar Dx and Dy, not the batch or stream engine or --interleave");
+	}
+	if(options.interleave && options.engine != ENGINE_COMPACT)
+	{
+		throw std::invalid_argument("--interleave needs the compact engine");
+	}
+	if(options.engine == ENGINE_BATCH && !options.input.empty())
+	{
+		throw std::invalid_argument("the batch engine convolves random frames, --input is not supported");
+	}
+	return options;
+}
+
+#endif
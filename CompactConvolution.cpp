@@ -0,0 +1,425 @@
+#ifndef COMPACT_CONVOLUTION_CPP
+#define COMPACT_CONVOLUTION_CPP
+
+#include <algorithm>
+#include "Convolution.cpp"
+#include "SimdKernels.cpp"
+#include "ThreadPool.cpp"
+
+/*
+* Compact output for the filter K = [-1, 0, 1]: Dx and Dy as signed chars instead of
+* short ints, for consumers such as thresholding that only need coarse gradients.
+* The gradients of unsigned char input are in [-255, 255], 9 bits, so they are narrowed
+* to 8 bits in one of two ways:
+*   COMPACT_SATURATE clamps to [-128, 127], exact for the small gradients of smooth
+*                    regions, strong edges all read as -128 or 127
+*   COMPACT_HALVE    shifts right by one, rounding toward negative infinity, keeps the
+*                    whole range at half the resolution
+* The results are written planar, Dx and Dy in two signed char matrices, or interleaved,
+* Dx and Dy of a pixel next to each other in one matrix of twice the columns. Both cut
+* the bytes written per pixel from 4 to 2, and the interleaved layout also writes a
+* single stream instead of two, which is what a memory-bound host runs out of first.
+* The narrowing happens in the registers that computed the gradients, the short int
+* results are never stored.
+*/
+
+/**
+* How 9-bit gradients are narrowed to signed chars
+*/
+enum CompactMode { COMPACT_SATURATE, COMPACT_HALVE };
+
+/**
+* Description: Narrows one gradient to a signed char
+* @params gradient, the gradient in [-255, 255]
+* @returns signed char, the gradient clamped (Halve false) or halved (Halve true)
+*/
+template <bool Halve>
+inline signed char compactValue(int gradient)
+{
+	return Halve ? (signed char)(gradient >> 1) : (signed char)std::min(127, std::max(-128, gradient));
+}
+
+inline signed char compactValue(int gradient, CompactMode mode)
+{
+	return (mode == COMPACT_HALVE) ? compactValue<true>(gradient) : compactValue<false>(gradient);
+}
+
+///////////////////////////////////////
+//SCALAR ROW KERNELS
+///////////////////////////////////////
+/**
+* Description: convolveInteriorDx() writing narrowed gradients
+* Preconditions: src[0] through src[count+1] are readable
+* Postconditions: dst[1] through dst[count] hold the narrowed right - left
+*/
+template <bool Halve>
+void compactInteriorDx(const unsigned char * src, signed char * dst, int count)
+{
+	for(int j = 1; j <= count; j++)
+	{
+		dst[j] = compactValue<Halve>(src[j+1] - src[j-1]);
+	}
+}
+
+/**
+* Description: convolveRowDy() writing narrowed gradients
+*/
+template <bool Halve>
+void compactRowDy(const unsigned char * above, const unsigned char * below, signed char * dst, int columns)
+{
+	for(int j = 0; j < columns; j++)
+	{
+		dst[j] = compactValue<Halve>(below[j] - above[j]);
+	}
+}
+
+/**
+* Description: Calculates the interior Dx and Dy of one row into interleaved pairs
+* Preconditions: src[0] through src[count+1], above and below [1, count] are readable
+* Postconditions: dst[2j] and dst[2j+1] hold Dx and Dy of column j, for j in [1, count]
+* @params src, above, below, the row of M and the rows above and below it
+* @params dst, pointer to column 0 of the interleaved row
+* @params count, the number of interior columns
+* @returns NONE
+*/
+template <bool Halve>
+void compactInteriorInterleaved(const unsigned char * src, const unsigned char * above, const unsigned char * below, signed char * dst, int count)
+{
+	for(int j = 1; j <= count; j++)
+	{
+		dst[2*j] = compactValue<Halve>(src[j+1] - src[j-1]);
+		dst[2*j+1] = compactValue<Halve>(below[j] - above[j]);
+	}
+}
+
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+///////////////////////////////////////
+//SSE4.1 ROW KERNELS
+///////////////////////////////////////
+/**
+* Description: Calculates 16 narrowed gradients plus - minus
+* Implementation: gradient16Sse41() followed by a saturating pack of the two halves,
+* after an arithmetic shift by one for COMPACT_HALVE, which then never saturates
+*/
+template <bool Halve>
+__attribute__((target("sse4.1")))
+inline __m128i compact16Sse41(const unsigned char * plus, const unsigned char * minus)
+{
+	__m128i lo, hi;
+	gradient16Sse41(plus, minus, lo, hi);
+	if(Halve)
+	{
+		lo = _mm_srai_epi16(lo, 1);
+		hi = _mm_srai_epi16(hi, 1);
+	}
+	return _mm_packs_epi16(lo, hi);
+}
+
+template <bool Halve>
+__attribute__((target("sse4.1")))
+void compactInteriorDxSse41(const unsigned char * src, signed char * dst, int count)
+{
+	int j = 1;
+	for(; j + 16 <= count + 1; j += 16)
+	{
+		_mm_storeu_si128((__m128i *)(dst + j), compact16Sse41<Halve>(src + j + 1, src + j - 1));
+	}
+	compactInteriorDx<Halve>(src + j - 1, dst + j - 1, count + 1 - j);
+}
+
+template <bool Halve>
+__attribute__((target("sse4.1")))
+void compactRowDySse41(const unsigned char * above, const unsigned char * below, signed char * dst, int columns)
+{
+	int j = 0;
+	for(; j + 16 <= columns; j += 16)
+	{
+		_mm_storeu_si128((__m128i *)(dst + j), compact16Sse41<Halve>(below + j, above + j));
+	}
+	compactRowDy<Halve>(above + j, below + j, dst + j, columns - j);
+}
+
+/**
+* Implementation: Interleaves 16 narrowed Dx and Dy bytes into 16 pairs with the byte unpacks
+*/
+template <bool Halve>
+__attribute__((target("sse4.1")))
+void compactInteriorInterleavedSse41(const unsigned char * src, const unsigned char * above, const unsigned char * below, signed char * dst, int count)
+{
+	int j = 1;
+	for(; j + 16 <= count + 1; j += 16)
+	{
+		const __m128i dx = compact16Sse41<Halve>(src + j + 1, src + j - 1);
+		const __m128i dy = compact16Sse41<Halve>(below + j, above + j);
+		_mm_storeu_si128((__m128i *)(dst + 2*j), _mm_unpacklo_epi8(dx, dy));
+		_mm_storeu_si128((__m128i *)(dst + 2*j + 16), _mm_unpackhi_epi8(dx, dy));
+	}
+	compactInteriorInterleaved<Halve>(src + j - 1, above + j - 1, below + j - 1, dst + 2*(j - 1), count + 1 - j);
+}
+
+///////////////////////////////////////
+//AVX2 ROW KERNELS
+///////////////////////////////////////
+/**
+* Description: Calculates 32 narrowed gradients plus - minus
+* Implementation: gradient32Avx2() and a saturating pack as compact16Sse41(). The pack
+* works within each 128 bit lane, so the 64 bit quarters are put back in order after it.
+*/
+template <bool Halve>
+__attribute__((target("avx2")))
+inline __m256i compact32Avx2(const unsigned char * plus, const unsigned char * minus)
+{
+	__m256i lo, hi;
+	gradient32Avx2(plus, minus, lo, hi);
+	if(Halve)
+	{
+		lo = _mm256_srai_epi16(lo, 1);
+		hi = _mm256_srai_epi16(hi, 1);
+	}
+	return _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8);
+}
+
+template <bool Halve>
+__attribute__((target("avx2")))
+void compactInteriorDxAvx2(const unsigned char * src, signed char * dst, int count)
+{
+	int j = 1;
+	for(; j + 32 <= count + 1; j += 32)
+	{
+		_mm256_storeu_si256((__m256i *)(dst + j), compact32Avx2<Halve>(src + j + 1, src + j - 1));
+	}
+	compactInteriorDx<Halve>(src + j - 1, dst + j - 1, count + 1 - j);
+}
+
+template <bool Halve>
+__attribute__((target("avx2")))
+void compactRowDyAvx2(const unsigned char * above, const unsigned char * below, signed char * dst, int columns)
+{
+	int j = 0;
+	for(; j + 32 <= columns; j += 32)
+	{
+		_mm256_storeu_si256((__m256i *)(dst + j), compact32Avx2<Halve>(below + j, above + j));
+	}
+	compactRowDy<Halve>(above + j, below + j, dst + j, columns - j);
+}
+
+/**
+* Implementation: The byte unpacks pair up the columns 0-7 and 16-23 in one register and
+* 8-15 and 24-31 in the other, the lane permutes put the 32 pairs back in order
+*/
+template <bool Halve>
+__attribute__((target("avx2")))
+void compactInteriorInterleavedAvx2(const unsigned char * src, const unsigned char * above, const unsigned char * below, signed char * dst, int count)
+{
+	int j = 1;
+	for(; j + 32 <= count + 1; j += 32)
+	{
+		const __m256i dx = compact32Avx2<Halve>(src + j + 1, src + j - 1);
+		const __m256i dy = compact32Avx2<Halve>(below + j, above + j);
+		const __m256i low = _mm256_unpacklo_epi8(dx, dy);
+		const __m256i high = _mm256_unpackhi_epi8(dx, dy);
+		_mm256_storeu_si256((__m256i *)(dst + 2*j), _mm256_permute2x128_si256(low, high, 0x20));
+		_mm256_storeu_si256((__m256i *)(dst + 2*j + 32), _mm256_permute2x128_si256(low, high, 0x31));
+	}
+	compactInteriorInterleaved<Halve>(src + j - 1, above + j - 1, below + j - 1, dst + 2*(j - 1), count + 1 - j);
+}
+#endif
+
+///////////////////////////////////////
+//ROW KERNEL SELECTION
+///////////////////////////////////////
+/**
+* The compact row kernels an engine runs for every row, the counterpart of RowKernels
+* for signed char results, usable with convolveRowRange()
+*/
+struct CompactRowKernels
+{
+	CompactMode mode;
+	void (*interiorDx)(const unsigned char * src, signed char * dst, int count);
+	void (*rowDy)(const unsigned char * above, const unsigned char * below, signed char * dst, int columns);
+	void (*interiorInterleaved)(const unsigned char * src, const unsigned char * above, const unsigned char * below, signed char * dst, int count);
+
+	/**
+	* Description: convolveRowDx() for narrowed gradients, the wrap-around columns are scalar
+	*/
+	void dxRow(const unsigned char * src, signed char * dst, int columns)
+	{
+		if(columns == 1)
+		{
+			dst[0] = 0;
+			return;
+		}
+		dst[0] = compactValue(src[1] - src[columns-1], mode);
+		interiorDx(src, dst, columns-2);
+		dst[columns-1] = compactValue(src[0] - src[columns-2], mode);
+	}
+
+	void dyRow(const unsigned char * above, const unsigned char * below, signed char * dst, int columns)
+	{
+		rowDy(above, below, dst, columns);
+	}
+
+	/**
+	* Description: Calculates Dx and Dy of one row into interleaved pairs
+	* @params src, above, below, the row of M and its wrap-around neighbor rows
+	* @params dst, pointer to column 0 of the interleaved row, 2*columns elements
+	* @params columns, the column size of M
+	* @returns NONE
+	*/
+	void interleavedRow(const unsigned char * src, const unsigned char * above, const unsigned char * below, signed char * dst, int columns)
+	{
+		if(columns == 1)
+		{
+			dst[0] = 0;
+			dst[1] = compactValue(below[0] - above[0], mode);
+			return;
+		}
+		dst[0] = compactValue(src[1] - src[columns-1], mode);
+		dst[1] = compactValue(below[0] - above[0], mode);
+		interiorInterleaved(src, above, below, dst, columns-2);
+		dst[2*columns-2] = compactValue(src[0] - src[columns-2], mode);
+		dst[2*columns-1] = compactValue(below[columns-1] - above[columns-1], mode);
+	}
+};
+
+/**
+* Description: Returns the compact row kernels of one narrowing for an instruction set level
+*/
+template <bool Halve>
+CompactRowKernels compactRowKernelsFor(SimdLevel level, CompactMode mode)
+{
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+	if(level == SIMD_AVX2)
+	{
+		CompactRowKernels kernels = { mode, compactInteriorDxAvx2<Halve>, compactRowDyAvx2<Halve>, compactInteriorInterleavedAvx2<Halve> };
+		return kernels;
+	}
+	if(level == SIMD_SSE41)
+	{
+		CompactRowKernels kernels = { mode, compactInteriorDxSse41<Halve>, compactRowDySse41<Halve>, compactInteriorInterleavedSse41<Halve> };
+		return kernels;
+	}
+#endif
+	(void)level;
+	CompactRowKernels kernels = { mode, compactInteriorDx<Halve>, compactRowDy<Halve>, compactInteriorInterleaved<Halve> };
+	return kernels;
+}
+
+/**
+* Description: Returns the compact row kernels for a narrowing and an instruction set level
+* @params level, the instruction set level, normally simdLevel()
+* @params mode, the narrowing
+* @returns CompactRowKernels, the kernels
+*/
+CompactRowKernels compactRowKernels(SimdLevel level, CompactMode mode)
+{
+	return (mode == COMPACT_HALVE) ? compactRowKernelsFor<true>(level, mode) : compactRowKernelsFor<false>(level, mode);
+}
+
+///////////////////////////////////////
+//COMPACT CONVOLUTION ENGINES
+///////////////////////////////////////
+/**
+* Description: SIMD engine writing Dx and Dy as signed chars
+* Implementation: convolveRowRange() with the compact row kernels, so the borders and
+* the wrap-around are exactly those of convolveSimd()
+* Preconditions: M, Dx and Dy have the same row and column size
+* Postconditions: Dx and Dy hold the narrowed convolution of M
+* @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params Dx, Dy, the narrowed results
+* @params mode, the narrowing
+* @return NONE
+*/
+void convolveCompact(MatrixView<unsigned char> M, MatrixView<signed char> Dx, MatrixView<signed char> Dy, CompactMode mode)
+{
+	CompactRowKernels kernels = compactRowKernels(simdLevel(), mode);
+	convolveRowRange(M, Dx, Dy, kernels, 0, M.getRows());
+}
+
+/**
+* Description: convolveCompact() on the row bands of convolveParallel()
+*/
+void convolveCompact(MatrixView<unsigned char> M, MatrixView<signed char> Dx, MatrixView<signed char> Dy, CompactMode mode, ThreadPool & pool)
+{
+	const int rows = M.getRows();
+	const int bands = std::min(rows, pool.getThreads());
+	const CompactRowKernels kernels = compactRowKernels(simdLevel(), mode);
+
+	pool.run(bands, [&](int band)
+	{
+		CompactRowKernels bandKernels = kernels;
+		convolveRowRange(M, Dx, Dy, bandKernels, bandStart(rows, bands, band), bandStart(rows, bands, band+1));
+	});
+}
+
+/**
+* Description: Calculates the rows [firstRow, endRow) of the interleaved result
+* Implementation: Every row reads its wrap-around neighbor rows and writes one row of pairs
+*/
+void convolveInterleavedRange(MatrixView<unsigned char> M, MatrixView<signed char> DxDy, CompactRowKernels & kernels, int firstRow, int endRow)
+{
+	const int rows = M.getRows();
+	for(int i = firstRow; i < endRow; i++)
+	{
+		const unsigned char * above = M.getRow((i + rows - 1) % rows);
+		const unsigned char * below = M.getRow((i + 1) % rows);
+		kernels.interleavedRow(M.getRow(i), above, below, DxDy.getRow(i), M.getColumns());
+	}
+}
+
+/**
+* Description: SIMD engine writing Dx and Dy as interleaved signed char pairs
+* Implementation: Dx and Dy of a pixel are computed in the same pass, narrowed and
+* interleaved in registers, so the output is one stream of 2 bytes per pixel
+* Preconditions: DxDy has the row size of M and twice its column size
+* Postconditions: column 2j of DxDy holds Dx and column 2j+1 holds Dy of column j of M
+* @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params DxDy, the interleaved narrowed results
+* @params mode, the narrowing
+* @return NONE
+*/
+void convolveInterleaved(MatrixView<unsigned char> M, MatrixView<signed char> DxDy, CompactMode mode)
+{
+	CompactRowKernels kernels = compactRowKernels(simdLevel(), mode);
+	convolveInterleavedRange(M, DxDy, kernels, 0, M.getRows());
+}
+
+/**
+* Description: convolveInterleaved() on the row bands of convolveParallel()
+*/
+void convolveInterleaved(MatrixView<unsigned char> M, MatrixView<signed char> DxDy, CompactMode mode, ThreadPool & pool)
+{
+	const int rows = M.getRows();
+	const int bands = std::min(rows, pool.getThreads());
+	const CompactRowKernels kernels = compactRowKernels(simdLevel(), mode);
+
+	pool.run(bands, [&](int band)
+	{
+		CompactRowKernels bandKernels = kernels;
+		convolveInterleavedRange(M, DxDy, bandKernels, bandStart(rows, bands, band), bandStart(rows, bands, band+1));
+	});
+}
+
+/**
+* Description: The min and max of the Dx and the Dy columns of an interleaved result
+* @params DxDy, the interleaved results
+* @returns GradientExtrema, the min and max values of Dx and Dy
+*/
+GradientExtrema getInterleavedExtrema(MatrixView<signed char> DxDy)
+{
+	GradientExtrema extrema = { 127, -128, 127, -128 };
+	for(int i = 0; i < DxDy.getRows(); i++)
+	{
+		const signed char * line = DxDy.getRow(i);
+		for(int j = 0; j + 1 < DxDy.getColumns(); j += 2)
+		{
+			extrema.xMin = std::min<short int>(extrema.xMin, line[j]);
+			extrema.xMax = std::max<short int>(extrema.xMax, line[j]);
+			extrema.yMin = std::min<short int>(extrema.yMin, line[j+1]);
+			extrema.yMax = std::max<short int>(extrema.yMax, line[j+1]);
+		}
+	}
+	return extrema;
+}
+
+#endif
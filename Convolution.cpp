@@ -0,0 +1,668 @@
+#ifndef CONVOLUTION_CPP
+#define CONVOLUTION_CPP
+
+#include "Matrix.cpp"
+#include "SimdKernels.cpp"
+#include "ThreadPool.cpp"
+#include <unistd.h>
+
+/*
+* Optimized convolution engines for the filter K = [-1, 0, 1].
+* Every engine in this file produces the same Dx and Dy as convolve() in NaiveConvolution.cpp,
+* including the "WRAP-AROUND" handling of the first/last row and column.
+*/
+
+///////////////////////////////////////
+//ROW KERNELS
+///////////////////////////////////////
+/**
+* Description: Calculates the interior Dx values of one row
+* Implementation: Straight pointer walk, -1*left of index + right of index
+* Preconditions: src[0] through src[count+1] are readable
+* Postconditions: dst[1] through dst[count] hold right - left
+* @params src, pointer to the first element of the row in M
+* @params dst, pointer to the first element of the row in Dx
+* @params count, the number of interior columns
+* @returns NONE
+*/
+void convolveInteriorDx(const unsigned char * src, short int * dst, int count)
+{
+	for(int j = 1; j <= count; j++)
+	{
+		dst[j] = src[j+1] - src[j-1];
+	}
+}
+
+/**
+* Description: Calculates one row of the vertical convolution Dy
+* Implementation: Subtracts the row above from the row below, column by column.
+* The caller chooses the wrap-around rows for the first and last row, so this
+* loop never branches.
+* Preconditions: above, below and dst point to at least 'columns' elements
+* Postconditions: dst holds the Dy values for this row
+* @params above, pointer to the row in M multiplied by the '-1' filter value
+* @params below, pointer to the row in M multiplied by the '1' filter value
+* @params dst, pointer to the first element of the row in Dy
+* @params columns, the column size of the matrix
+* @returns NONE
+*/
+void convolveRowDy(const unsigned char * above, const unsigned char * below, short int * dst, int columns)
+{
+	for(int j = 0; j < columns; j++)
+	{
+		dst[j] = below[j] - above[j];
+	}
+}
+
+/**
+* Description: Calculates one row of the horizontal convolution Dx
+* Implementation: The interior columns [1, columns-2] are computed by the interior
+* kernel. Only the first and last column take the wrap-around neighbor from the
+* opposite end of the same row.
+* Preconditions: src and dst point to at least 'columns' elements
+* Postconditions: dst holds the Dx values for this row
+* @params src, pointer to the first element of the row in M
+* @params dst, pointer to the first element of the row in Dx
+* @params columns, the column size of the matrix
+* @params interior, callable as interior(src, dst, count) that fills dst[1] to dst[count]
+* @returns NONE
+*/
+template <typename InteriorKernel>
+void convolveRowDx(const unsigned char * src, short int * dst, int columns, InteriorKernel interior)
+{
+	//a single column wraps onto itself, so both neighbors are the same value
+	if(columns == 1)
+	{
+		dst[0] = 0;
+		return;
+	}
+
+	//left border: the '-1' neighbor wraps around to the last column
+	dst[0] = src[1] - src[columns-1];
+
+	//interior: no edge checks
+	interior(src, dst, columns-2);
+
+	//right border: the '1' neighbor wraps around to the first column
+	dst[columns-1] = src[0] - src[columns-2];
+}
+
+/**
+* The pair of row kernels an engine runs for every row:
+* interiorDx computes Dx for columns [1, columns-2], rowDy computes a full row of Dy
+*/
+struct RowKernels
+{
+	void (*interiorDx)(const unsigned char * src, short int * dst, int count);
+	void (*rowDy)(const unsigned char * above, const unsigned char * below, short int * dst, int columns);
+
+	void dxRow(const unsigned char * src, short int * dst, int columns)
+	{
+		convolveRowDx(src, dst, columns, interiorDx);
+	}
+
+	void dyRow(const unsigned char * above, const unsigned char * below, short int * dst, int columns)
+	{
+		rowDy(above, below, dst, columns);
+	}
+};
+
+/**
+* Description: Returns the plain C++ row kernels
+* @params NONE
+* @returns RowKernels, the scalar kernels
+*/
+RowKernels scalarRowKernels()
+{
+	RowKernels kernels = { convolveInteriorDx, convolveRowDy };
+	return kernels;
+}
+
+/**
+* Description: Returns the row kernels for the given instruction set level
+* Implementation: Picks the SSE4.1 or AVX2 kernels from SimdKernels.cpp, falling back
+* to the scalar kernels when the level is SIMD_SCALAR or SIMD is not compiled in
+* @params level, the instruction set level, normally simdLevel()
+* @returns RowKernels, the kernels for that level
+*/
+RowKernels simdRowKernels(SimdLevel level)
+{
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+	if(level == SIMD_AVX2)
+	{
+		RowKernels kernels = { convolveInteriorDxAvx2, convolveRowDyAvx2 };
+		return kernels;
+	}
+	if(level == SIMD_SSE41)
+	{
+		RowKernels kernels = { convolveInteriorDxSse41, convolveRowDySse41 };
+		return kernels;
+	}
+#endif
+	return scalarRowKernels();
+}
+
+///////////////////////////////////////
+//FUSED MIN/MAX ROW KERNELS
+///////////////////////////////////////
+/**
+* The min and max values of Dx and Dy
+*/
+struct GradientExtrema
+{
+	short int xMin;
+	short int xMax;
+	short int yMin;
+	short int yMax;
+};
+
+/**
+* Description: convolveInteriorDx() that also tracks the min and max of the values it writes
+* Implementation: The running min/max are locals written back once at the end, like the
+* SIMD kernels do. Updated through the references, which may point anywhere a short int
+* store to dst could reach, they would be stored on every element and keep the loop scalar.
+* @params src, pointer to the first element of the row in M
+* @params dst, pointer to the first element of the row in Dx
+* @params count, the number of interior columns
+* @params lowest, the lowest Dx value found so far, updated in place
+* @params greatest, the greatest Dx value found so far, updated in place
+* @returns NONE
+*/
+void convolveInteriorDxMinMax(const unsigned char * src, short int * dst, int count, short int & lowest, short int & greatest)
+{
+	short int low = lowest;
+	short int high = greatest;
+	for(int j = 1; j <= count; j++)
+	{
+		const short int value = src[j+1] - src[j-1];
+		dst[j] = value;
+		low = std::min(low, value);
+		high = std::max(high, value);
+	}
+	lowest = low;
+	greatest = high;
+}
+
+/**
+* Description: convolveRowDy() that also tracks the min and max of the values it writes
+* Implementation: Local min/max written back once, as convolveInteriorDxMinMax()
+* @params above, pointer to the row in M multiplied by the '-1' filter value
+* @params below, pointer to the row in M multiplied by the '1' filter value
+* @params dst, pointer to the first element of the row in Dy
+* @params columns, the column size of the matrix
+* @params lowest, the lowest Dy value found so far, updated in place
+* @params greatest, the greatest Dy value found so far, updated in place
+* @returns NONE
+*/
+void convolveRowDyMinMax(const unsigned char * above, const unsigned char * below, short int * dst, int columns, short int & lowest, short int & greatest)
+{
+	short int low = lowest;
+	short int high = greatest;
+	for(int j = 0; j < columns; j++)
+	{
+		const short int value = below[j] - above[j];
+		dst[j] = value;
+		low = std::min(low, value);
+		high = std::max(high, value);
+	}
+	lowest = low;
+	greatest = high;
+}
+
+/**
+* Row kernels that compute Dx and Dy and accumulate their min/max in the same sweep.
+* The running min/max live in 'extrema', which starts out as the empty range
+* (min = largest short, max = smallest short) so any value replaces it.
+*/
+struct FusedRowKernels
+{
+	void (*interiorDx)(const unsigned char * src, short int * dst, int count, short int & lowest, short int & greatest);
+	void (*rowDy)(const unsigned char * above, const unsigned char * below, short int * dst, int columns, short int & lowest, short int & greatest);
+	GradientExtrema extrema;
+
+	void dxRow(const unsigned char * src, short int * dst, int columns)
+	{
+		GradientExtrema & e = extrema;
+		void (*kernel)(const unsigned char *, short int *, int, short int &, short int &) = interiorDx;
+		convolveRowDx(src, dst, columns, [&e, kernel](const unsigned char * s, short int * d, int count)
+		{
+			kernel(s, d, count, e.xMin, e.xMax);
+		});
+
+		//the border columns are not seen by the interior kernel
+		e.xMin = std::min(e.xMin, std::min(dst[0], dst[columns-1]));
+		e.xMax = std::max(e.xMax, std::max(dst[0], dst[columns-1]));
+	}
+
+	void dyRow(const unsigned char * above, const unsigned char * below, short int * dst, int columns)
+	{
+		rowDy(above, below, dst, columns, extrema.yMin, extrema.yMax);
+	}
+};
+
+/**
+* Description: Returns the fused row kernels for the given instruction set level
+* Implementation: Picks the SSE4.1 or AVX2 min/max kernels from SimdKernels.cpp, falling
+* back to the scalar kernels when the level is SIMD_SCALAR or SIMD is not compiled in
+* @params level, the instruction set level, normally simdLevel()
+* @returns FusedRowKernels, the kernels for that level with an empty min/max range
+*/
+FusedRowKernels fusedRowKernels(SimdLevel level)
+{
+	const short int lowest = std::numeric_limits<short int>::min();
+	const short int greatest = std::numeric_limits<short int>::max();
+	FusedRowKernels kernels = { convolveInteriorDxMinMax, convolveRowDyMinMax, { greatest, lowest, greatest, lowest } };
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+	if(level == SIMD_AVX2)
+	{
+		kernels.interiorDx = convolveInteriorDxMinMaxAvx2;
+		kernels.rowDy = convolveRowDyMinMaxAvx2;
+	}
+	else if(level == SIMD_SSE41)
+	{
+		kernels.interiorDx = convolveInteriorDxMinMaxSse41;
+		kernels.rowDy = convolveRowDyMinMaxSse41;
+	}
+#endif
+	return kernels;
+}
+
+///////////////////////////////////////
+//CONVOLUTION ENGINES
+///////////////////////////////////////
+/**
+* Description: Calculate Dx and Dy for the rows [firstRow, endRow) with the given row kernels
+* Implementation: Splits the range into an interior and a border. The interior rows
+* are walked with row pointers into getMatrix() so the inner loops carry no edge checks,
+* no indexMap() bounds checks and no user_input lookups. The first and last row of the
+* matrix, when inside the range, are separate border passes that pick their wrap-around
+* neighbor row, and the first and last column of every row are handled at the ends of
+* convolveRowDx(). The rows just outside the range are only read, so several ranges can
+* be computed at the same time.
+* For matrices of at least 2x2 the result is identical to convolve(). A matrix with a
+* single row or column wraps onto itself, so the corresponding gradient is 0.
+* M, Dx and Dy can be whole matrices or views of a region of larger matrices, an ROI
+* is convolved as if it were a matrix of its own.
+* Preconditions: M, Dx and Dy have the same row and column size, 0 <= firstRow <= endRow <= rows
+* Postconditions: rows [firstRow, endRow) of Dx and Dy hold the convolution result
+* @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params Matrix Dx, covolution result of filter [-1, 0, 1] on horizontal axis
+* @params Matrix Dy, covolution result of filter [-1, 0, 1] on vertical axis
+* @params kernels, the row kernels to run on every row (RowKernels, FusedRowKernels, or
+* CompactRowKernels of CompactConvolution.cpp, which write signed chars)
+* @params firstRow, the first row to compute
+* @params endRow, one past the last row to compute
+* @return NONE
+*/
+template <typename Kernels, typename TOut>
+void convolveRowRange(MatrixView<unsigned char> M, MatrixView<TOut> Dx, MatrixView<TOut> Dy, Kernels & kernels, int firstRow, int endRow)
+{
+	const int rows = M.getRows();
+	const int columns = M.getColumns();
+	const long mStride = M.getStride();
+	const long dxStride = Dx.getStride();
+	const long dyStride = Dy.getStride();
+	const unsigned char * m = M.getMatrix();
+	TOut * dx = Dx.getMatrix();
+	TOut * dy = Dy.getMatrix();
+
+	//top border pass: the '-1' neighbor row wraps around to the bottommost row
+	if(firstRow == 0 && endRow > 0)
+	{
+		const unsigned char * lastRow = m + (rows-1)*mStride;
+		const unsigned char * secondRow = (rows > 1) ? m + mStride : m;
+		kernels.dxRow(m, dx, columns);
+		kernels.dyRow(lastRow, secondRow, dy, columns);
+	}
+
+	//interior pass: both neighbor rows exist
+	const int interiorEnd = std::min(endRow, rows-1);
+	for(int i = std::max(firstRow, 1); i < interiorEnd; i++)
+	{
+		const unsigned char * src = m + i*mStride;
+		kernels.dxRow(src, dx + i*dxStride, columns);
+		kernels.dyRow(src - mStride, src + mStride, dy + i*dyStride, columns);
+	}
+
+	//bottom border pass: the '1' neighbor row wraps around to the topmost row
+	if(rows > 1 && endRow == rows)
+	{
+		const unsigned char * src = m + (rows-1)*mStride;
+		kernels.dxRow(src, dx + (rows-1)*dxStride, columns);
+		kernels.dyRow(src - mStride, m, dy + (rows-1)*dyStride, columns);
+	}
+}
+
+/**
+* Description: Calculate Dx and Dy of the whole matrix with the given row kernels
+* @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params Matrix Dx, covolution result of filter [-1, 0, 1] on horizontal axis
+* @params Matrix Dy, covolution result of filter [-1, 0, 1] on vertical axis
+* @params kernels, the row kernels to run on every row (RowKernels or FusedRowKernels)
+* @return NONE
+*/
+template <typename Kernels>
+void convolveRows(MatrixView<unsigned char> M, MatrixView<short int> Dx, MatrixView<short int> Dy, Kernels & kernels)
+{
+	convolveRowRange(M, Dx, Dy, kernels, 0, M.getRows());
+}
+
+/**
+* Description: Interior/border split engine with scalar row kernels
+* @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params Matrix Dx, covolution result of filter [-1, 0, 1] on horizontal axis
+* @params Matrix Dy, covolution result of filter [-1, 0, 1] on vertical axis
+* @return NONE
+*/
+void convolveSplit(MatrixView<unsigned char> M, MatrixView<short int> Dx, MatrixView<short int> Dy)
+{
+	RowKernels kernels = scalarRowKernels();
+	convolveRows(M, Dx, Dy, kernels);
+}
+
+/**
+* Description: Interior/border split engine with SIMD row kernels
+* Implementation: Dispatches at runtime to the AVX2 kernels (32 pixels per step), the
+* SSE4.1 kernels (16 pixels per step) or the scalar kernels, whichever is the widest
+* the CPU supports. The wrap-around borders are always computed by the scalar code,
+* so the result bit-matches convolve().
+* @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params Matrix Dx, covolution result of filter [-1, 0, 1] on horizontal axis
+* @params Matrix Dy, covolution result of filter [-1, 0, 1] on vertical axis
+* @return NONE
+*/
+void convolveSimd(MatrixView<unsigned char> M, MatrixView<short int> Dx, MatrixView<short int> Dy)
+{
+	RowKernels kernels = simdRowKernels(simdLevel());
+	convolveRows(M, Dx, Dy, kernels);
+}
+
+/**
+* Description: SIMD engine that also computes the min and max of Dx and Dy in the same sweep
+* Implementation: Runs the fused row kernels, which keep vector min/max accumulators
+* next to the gradient registers, so Dx and Dy are not read back from memory by
+* four separate getMin()/getMax() passes. The separate functions stay available
+* and return the same values.
+* @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params Matrix Dx, covolution result of filter [-1, 0, 1] on horizontal axis
+* @params Matrix Dy, covolution result of filter [-1, 0, 1] on vertical axis
+* @return GradientExtrema, the min and max values of Dx and Dy
+*/
+GradientExtrema convolveFused(MatrixView<unsigned char> M, MatrixView<short int> Dx, MatrixView<short int> Dy)
+{
+	FusedRowKernels kernels = fusedRowKernels(simdLevel());
+	convolveRows(M, Dx, Dy, kernels);
+	return kernels.extrema;
+}
+
+///////////////////////////////////////
+//GHOST-CELL CONVOLUTION ENGINE
+///////////////////////////////////////
+/**
+* Description: SIMD engine for an M allocated with ghost cells (MatrixLayout::ghost = 1)
+* Implementation: refreshGhosts() copies the wrap-around neighbors into the ring of ghost
+* cells, after which every pixel of M has real left/right/above/below neighbors in memory.
+* Every row, including the first and last, is then one uninterrupted run of the interior
+* kernels: no border pass, no border columns, no scalar code outside the kernel tails.
+* With padded rows (MatrixLayout::padRows) every row of M, Dx and Dy starts 64 byte aligned.
+* Preconditions: M has ghost cells, M, Dx and Dy have the same row and column size
+* Postconditions: Dx and Dy will hold the respective horizontal and vertical convolution,
+* the ghost cells of M are up to date.
+* @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params Matrix Dx, covolution result of filter [-1, 0, 1] on horizontal axis
+* @params Matrix Dy, covolution result of filter [-1, 0, 1] on vertical axis
+* @return NONE
+*/
+void convolveGhost(Matrix<unsigned char> & M, MatrixView<short int> Dx, MatrixView<short int> Dy)
+{
+	if(M.getGhost() == 0)
+	{
+		//no ghost cells to read from, fall back to the border passes
+		convolveSimd(M, Dx, Dy);
+		return;
+	}
+	M.refreshGhosts();
+
+	const int rows = M.getRows();
+	const int columns = M.getColumns();
+	const long mStride = M.getStride();
+	const unsigned char * m = M.getMatrix();
+	const RowKernels kernels = simdRowKernels(simdLevel());
+
+	for(int i = 0; i < rows; i++)
+	{
+		const unsigned char * src = m + i*mStride;
+		short int * dxRow = Dx.getMatrix() + (long)i*Dx.getStride();
+
+		//the interior kernel fills dst[1..count] from src[0..count+1], so shifting both
+		//pointers back by one column computes columns [0, columns-1] from the ghost cells
+		kernels.interiorDx(src - 1, dxRow - 1, columns);
+		kernels.rowDy(src - mStride, src + mStride, Dy.getMatrix() + (long)i*Dy.getStride(), columns);
+	}
+}
+
+///////////////////////////////////////
+//CACHE-BLOCKED CONVOLUTION ENGINE
+///////////////////////////////////////
+/**
+* Description: Returns the size of the per-core L2 data cache in bytes
+* Implementation: Asks sysconf() where the C library reports cache sizes and falls
+* back to a conservative 256 KiB when the size is unknown
+* @params NONE
+* @returns long, the L2 cache size in bytes
+*/
+long l2CacheBytes()
+{
+	long bytes = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+	bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+	return (bytes > 0) ? bytes : 256*1024;
+}
+
+/**
+* Description: Returns the strip width the tiled engine uses when none is given
+* Implementation: While walking down a strip, the rows i-1, i and i+1 of M (3 bytes per
+* column) and the rows i of Dx and Dy (4 bytes per column) are touched per step. The strip
+* is sized so that working set fills half of L2, leaving room for everything else,
+* and is rounded down to whole 64 byte cache lines.
+* @params NONE
+* @returns int, the strip width in columns
+*/
+int autoStripColumns()
+{
+	const long bytesPerColumn = 3*sizeof(unsigned char) + 2*sizeof(short int);
+	const long columns = (l2CacheBytes() / 2) / bytesPerColumn;
+	return (int)std::max(64L, columns - columns % 64);
+}
+
+/**
+* Description: Calculates the Dx values of the columns [firstColumn, endColumn) of one row
+* Implementation: Runs the interior kernel on the part of the segment that has both
+* neighbors and applies the wrap-around only if the segment touches the first or last
+* column. The interior kernel fills dst[1..count] from src[0..count+1], so it is handed
+* pointers shifted to the start of the segment.
+* Preconditions: 0 <= firstColumn < endColumn <= columns
+* Postconditions: dst[firstColumn] through dst[endColumn-1] hold the Dx values
+* @params src, pointer to the first element of the row in M
+* @params dst, pointer to the first element of the row in Dx
+* @params columns, the column size of the matrix
+* @params firstColumn, the first column of the segment
+* @params endColumn, one past the last column of the segment
+* @params kernels, the row kernels to use for the interior
+* @returns NONE
+*/
+void convolveSegmentDx(const unsigned char * src, short int * dst, int columns, int firstColumn, int endColumn, const RowKernels & kernels)
+{
+	if(columns == 1)
+	{
+		dst[0] = 0;
+		return;
+	}
+
+	//left border: the '-1' neighbor wraps around to the last column
+	if(firstColumn == 0)
+	{
+		dst[0] = src[1] - src[columns-1];
+	}
+
+	//interior: the neighbors of these columns are inside the row
+	const int start = std::max(firstColumn, 1);
+	const int end = std::min(endColumn, columns-1);
+	if(end > start)
+	{
+		kernels.interiorDx(src + start - 1, dst + start - 1, end - start);
+	}
+
+	//right border: the '1' neighbor wraps around to the first column
+	if(endColumn == columns)
+	{
+		dst[columns-1] = src[0] - src[columns-2];
+	}
+}
+
+/**
+* Description: SIMD engine that walks M in vertical strips sized to the cache
+* Implementation: For very wide matrices a whole row of M no longer fits in L1/L2, so
+* by the time row i+1 is needed again as the '-1' neighbor of row i+2 it has been
+* evicted. This engine cuts the columns into strips of 'stripColumns' and walks each
+* strip from the top row to the bottom row, so the three rows of the strip that Dy
+* needs stay resident in cache. The wrap-around rows and columns are handled exactly
+* as in convolveRowRange().
+* @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params Matrix Dx, covolution result of filter [-1, 0, 1] on horizontal axis
+* @params Matrix Dy, covolution result of filter [-1, 0, 1] on vertical axis
+* @params stripColumns, the strip width in columns, 0 or less picks autoStripColumns()
+* @return NONE
+*/
+void convolveTiled(MatrixView<unsigned char> M, MatrixView<short int> Dx, MatrixView<short int> Dy, int stripColumns)
+{
+	const int rows = M.getRows();
+	const int columns = M.getColumns();
+	const long mStride = M.getStride();
+	const long dxStride = Dx.getStride();
+	const long dyStride = Dy.getStride();
+	const unsigned char * m = M.getMatrix();
+	short int * dx = Dx.getMatrix();
+	short int * dy = Dy.getMatrix();
+	const RowKernels kernels = simdRowKernels(simdLevel());
+
+	if(stripColumns <= 0)
+	{
+		stripColumns = autoStripColumns();
+	}
+
+	for(int firstColumn = 0; firstColumn < columns; firstColumn += stripColumns)
+	{
+		const int endColumn = std::min(columns, firstColumn + stripColumns);
+		const int width = endColumn - firstColumn;
+
+		for(int i = 0; i < rows; i++)
+		{
+			//pick the neighbor rows, wrapping around at the top and bottom
+			const unsigned char * above = m + ((i == 0) ? rows-1 : i-1)*mStride;
+			const unsigned char * below = m + ((i == rows-1) ? 0 : i+1)*mStride;
+
+			convolveSegmentDx(m + i*mStride, dx + i*dxStride, columns, firstColumn, endColumn, kernels);
+			kernels.rowDy(above + firstColumn, below + firstColumn, dy + i*dyStride + firstColumn, width);
+		}
+	}
+}
+
+///////////////////////////////////////
+//PARALLEL CONVOLUTION ENGINES
+///////////////////////////////////////
+/**
+* Description: Returns the first row of a horizontal band
+* Implementation: Distributes the rows as evenly as possible, the first
+* (rows % bands) bands get one extra row
+* @params rows, the row size of the matrix
+* @params bands, the number of bands
+* @params band, the band index, band == bands gives the end of the last band
+* @returns int, the first row of the band
+*/
+int bandStart(int rows, int bands, int band)
+{
+	return (int)((long)rows*band / bands);
+}
+
+/**
+* Description: SIMD engine that splits M into horizontal row bands computed on a thread pool
+* Implementation: Every thread of the pool computes one band with convolveRowRange(). A band
+* reads the row above and below it (its one-row halo) straight from M, including the
+* wrap-around rows for the first and last band, and writes only its own rows of Dx and Dy,
+* so the bands need no synchronization.
+* @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params Matrix Dx, covolution result of filter [-1, 0, 1] on horizontal axis
+* @params Matrix Dy, covolution result of filter [-1, 0, 1] on vertical axis
+* @params pool, the thread pool to run the bands on
+* @return NONE
+*/
+void convolveParallel(MatrixView<unsigned char> M, MatrixView<short int> Dx, MatrixView<short int> Dy, ThreadPool & pool)
+{
+	const int rows = M.getRows();
+	const int bands = std::min(rows, pool.getThreads());
+	const RowKernels kernels = simdRowKernels(simdLevel());
+
+	pool.run(bands, [&](int band)
+	{
+		RowKernels bandKernels = kernels;
+		convolveRowRange(M, Dx, Dy, bandKernels, bandStart(rows, bands, band), bandStart(rows, bands, band+1));
+	});
+}
+
+/**
+* The min/max of one band in a 128 byte slot, so the min/max of two bands are never in the
+* same 64 byte cache line, wherever the vector of slots starts
+*/
+struct PaddedExtrema
+{
+	GradientExtrema extrema;
+	char padding[128 - sizeof(GradientExtrema)];
+};
+
+/**
+* Description: Fused SIMD + min/max engine that splits M into horizontal row bands computed on a thread pool
+* Implementation: Same banding as convolveParallel(). Every band accumulates its own
+* min/max, and the per-band results are combined once all bands are done.
+* @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params Matrix Dx, covolution result of filter [-1, 0, 1] on horizontal axis
+* @params Matrix Dy, covolution result of filter [-1, 0, 1] on vertical axis
+* @params pool, the thread pool to run the bands on
+* @return GradientExtrema, the min and max values of Dx and Dy
+*/
+GradientExtrema convolveFusedParallel(MatrixView<unsigned char> M, MatrixView<short int> Dx, MatrixView<short int> Dy, ThreadPool & pool)
+{
+	const int rows = M.getRows();
+	const int bands = std::min(rows, pool.getThreads());
+	const FusedRowKernels kernels = fusedRowKernels(simdLevel());
+
+	//the empty range, also the result for a view of 0 rows
+	GradientExtrema extrema = kernels.extrema;
+	if(bands < 1)
+	{
+		return extrema;
+	}
+
+	//every band accumulates in a copy of the kernels on its own stack and stores its
+	//result once, in a slot of a cache line of its own, so the bands share no line while they run
+	std::vector<PaddedExtrema> bandExtrema(bands);
+	pool.run(bands, [&](int band)
+	{
+		FusedRowKernels bandKernels = kernels;
+		convolveRowRange(M, Dx, Dy, bandKernels, bandStart(rows, bands, band), bandStart(rows, bands, band+1));
+		bandExtrema[band].extrema = bandKernels.extrema;
+	});
+
+	//combine the per-band results
+	for(int band = 0; band < bands; band++)
+	{
+		extrema.xMin = std::min(extrema.xMin, bandExtrema[band].extrema.xMin);
+		extrema.xMax = std::max(extrema.xMax, bandExtrema[band].extrema.xMax);
+		extrema.yMin = std::min(extrema.yMin, bandExtrema[band].extrema.yMin);
+		extrema.yMax = std::max(extrema.yMax, bandExtrema[band].extrema.yMax);
+	}
+	return extrema;
+}
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef DIRTY_REGIONS_CPP
+#define DIRTY_REGIONS_CPP
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+/*
+* The pixels of a matrix that changed since its results were last computed, so the
+* incremental convolution (IncrementalConvolution.cpp) only recomputes the pixels around
+* them. Every changed row keeps its changed columns as sorted spans: spans that overlap or
+* touch are joined, spans that do not are kept apart, so the dirty area is exactly the
+* changed area however the changes are scattered, a diagonal stroke of N pixels is N
+* pixels and not the N x N box around it. getRects() hands the spans out as rectangles,
+* joining a span with the same span of the row above, so a changed block, even one
+* written pixel by pixel with put(), is a single rectangle again.
+*/
+
+/**
+* A rectangle of rows [row, row + rows) and columns [column, column + columns)
+*/
+struct DirtyRect
+{
+	int row;
+	int column;
+	int rows;
+	int columns;
+};
+
+class DirtyRegions
+{
+public:
+	DirtyRegions();
+
+	///////////////////////////////////////
+	//MUTATORS
+	///////////////////////////////////////
+	void add(int row, int column, int rows, int columns);
+	void clear();
+
+	///////////////////////////////////////
+	//GETTERS
+	///////////////////////////////////////
+	bool isEmpty() const;
+	const std::vector<DirtyRect> & getRects() const;
+	long getArea() const;
+
+private:
+	/**
+	* The columns [first, end) of one row
+	*/
+	struct Span
+	{
+		int first;
+		int end;
+	};
+
+	void addSpan(std::vector<Span> & line, int first, int end);
+
+	/**
+	* The changed rows and their spans, sorted by column, no two of them touching
+	*/
+	std::map<int, std::vector<Span> > spans;
+
+	/**
+	* The number of pixels the spans cover
+	*/
+	long area;
+
+	/**
+	* The spans as rectangles, built by getRects() the first time it is called after a change
+	*/
+	mutable std::vector<DirtyRect> rects;
+	mutable bool rectsCurrent;
+};
+
+DirtyRegions::DirtyRegions() : area(0), rectsCurrent(true)
+{
+}
+
+/**
+* Description: Marks a rectangle as changed
+* Implementation: Adds the span of its columns to every row it covers, joining it with
+* the spans of that row it overlaps or touches, O(log rows + spans of the row) per row
+* @params row, column, the top-left corner
+* @params rows, columns, the size, nothing is marked if either is 0 or less
+* @returns NONE
+*/
+void DirtyRegions::add(int row, int column, int rows, int columns)
+{
+	if(rows <= 0 || columns <= 0)
+	{
+		return;
+	}
+	for(int i = row; i < row + rows; i++)
+	{
+		addSpan(spans[i], column, column + columns);
+	}
+	rectsCurrent = false;
+}
+
+/**
+* Description: Joins the columns [first, end) into the spans of one row
+* @params line, the spans of the row, sorted and not touching, kept that way
+* @params first, end, the columns
+* @returns NONE
+*/
+void DirtyRegions::addSpan(std::vector<Span> & line, int first, int end)
+{
+	//the first span that ends at or after 'first' is the first one the new span can touch
+	std::vector<Span>::iterator from = std::lower_bound(line.begin(), line.end(), first,
+		[](const Span & span, int column) { return span.end < column; });
+	std::vector<Span>::iterator to = from;
+	while(to != line.end() && to->first <= end)
+	{
+		first = std::min(first, to->first);
+		end = std::max(end, to->end);
+		area -= to->end - to->first;
+		++to;
+	}
+	area += end - first;
+	from = line.erase(from, to);
+	line.insert(from, Span{ first, end });
+}
+
+/**
+* Description: Forgets every change, after the results have been brought up to date
+* @returns NONE
+*/
+void DirtyRegions::clear()
+{
+	spans.clear();
+	area = 0;
+	rects.clear();
+	rectsCurrent = true;
+}
+
+bool DirtyRegions::isEmpty() const
+{
+	return spans.empty();
+}
+
+/**
+* Description: The changed pixels as rectangles that do not overlap
+* Implementation: Walks the rows in order, a span extends the rectangle of the row above
+* when that rectangle ends at the row above and has exactly the same columns, otherwise
+* it starts a new rectangle. The result is kept until the next add() or clear(), building
+* it writes that cache, so two threads must not call getRects() at once.
+* @returns const std::vector<DirtyRect> &, the rectangles, top to bottom
+*/
+const std::vector<DirtyRect> & DirtyRegions::getRects() const
+{
+	if(rectsCurrent)
+	{
+		return rects;
+	}
+	rects.clear();
+	//the rectangles that reach the previous row, in the column order of its spans
+	std::vector<size_t> open;
+	std::vector<size_t> next;
+	int previous = 0;
+	for(const auto & entry : spans)
+	{
+		const int row = entry.first;
+		const bool adjacent = !open.empty() && row == previous + 1;
+		size_t k = 0;
+		next.clear();
+		for(const Span & span : entry.second)
+		{
+			//both lists are sorted by column, skip the open rectangles left of this span
+			while(adjacent && k < open.size() && rects[open[k]].column < span.first)
+			{
+				k++;
+			}
+			if(adjacent && k < open.size() && rects[open[k]].column == span.first
+				&& rects[open[k]].column + rects[open[k]].columns == span.end)
+			{
+				rects[open[k]].rows++;
+				next.push_back(open[k]);
+				k++;
+				continue;
+			}
+			const DirtyRect rect = { row, span.first, 1, span.end - span.first };
+			rects.push_back(rect);
+			next.push_back(rects.size() - 1);
+		}
+		open.swap(next);
+		previous = row;
+	}
+	rectsCurrent = true;
+	return rects;
+}
+
+/**
+* Description: The number of pixels marked, exactly, every pixel counted once
+* @returns long, the area
+*/
+long DirtyRegions::getArea() const
+{
+	return area;
+}
+
+#endif
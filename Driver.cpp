@@ -1,8 +1,20 @@
 #include "Matrix.cpp"
+#include "NaiveConvolution.cpp"
+#include "Convolution.cpp"
+#include "KernelConvolution.cpp"
+#include "Gradient.cpp"
+#include "Batch.cpp"
+#include "Streaming.cpp"
+#include "CompactConvolution.cpp"
+#include "GradientHistogram.cpp"
+#include "CommandLine.cpp"
+#include "Benchmark.cpp"
+#include "Instrumentation.cpp"
 #include <string>
-#include <map> 
-#include <chrono> 
-using namespace std::chrono; 
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <cstring>
 
 /*
 * Given Instructions
@@ -19,15 +31,16 @@ using namespace std::chrono;
 */
 
 /**
-* Map to store and access the rows and columns inputted by the user
+* The options of this run, parsed from the command line or asked for by userinput()
 */
-std::map<std::string, int> user_input;
+DriverOptions options;
 
 /*
 * Description: Get the number of rows and column size of our matrix from the user.
-* Implementation: Prompt user for the row and column size and check to see if the input works
+* Implementation: Prompt user for the row and column size and check to see if the input works.
+* Only used when the program is started without command line options.
 * @Preconditions: NONE
-* @Postcondtions: user_input map will have 2 keys "rows" = numOfRows and "columns" = numOfColumns
+* @Postcondtions: options holds the rows, columns, engine and the rest of the answers
 * @params: int row, input row from user
 * @params: int column, input column from user
 * @returns: None
@@ -37,6 +50,11 @@ void userinput()
 	int rows;
 	int columns;
 	char toPrint;
+	char engine;
+	int threads;
+	long long seed;
+	int stripColumns = 0;
+	char border = 'w';
 	//grab user input
 	std::cout << "enter number of rows: ";
 	std::cin >> rows;
@@ -44,12 +62,29 @@ void userinput()
 	std::cin >> columns;
 	std::cout << "enter 'y' if u want to print M, Dx, and Dy, 'n' for don't print: ";
 	std::cin >> toPrint;
+	std::cout << "enter 'n' for the naive convolution engine, 's' for the interior/border split engine, 'v' for the SIMD engine, 'f' for the fused SIMD + min/max engine, 't' for the cache-tiled SIMD engine, 'g' for the ghost-cell SIMD engine, 'k' for the compile-time kernel engine: ";
+	std::cin >> engine;
+	if(engine == 't')
+	{
+		std::cout << "enter strip width in columns (0 = auto from cache size): ";
+		std::cin >> stripColumns;
+	}
+	if(engine == 'k')
+	{
+		std::cout << "enter border: 'w' for wrap-around, 'c' for clamp, 'm' for mirror, 'z' for zero, 'v' for valid-only: ";
+		std::cin >> border;
+	}
+	std::cout << "enter number of threads for the SIMD/fused engines and min/max (0 = all cores): ";
+	std::cin >> threads;
+	std::cout << "enter random seed for M (0 = seed from the clock): ";
+	std::cin >> seed;
 	//at this point we have to check for bad user input
 
-	//if the user has inputted a negative number
-	while(rows < 1 || columns < 1)
+	//if the user has inputted a negative number, valid-only borders need a full 3x3 neighborhood
+	const int minimum = (engine == 'k' && border == 'v') ? 3 : 1;
+	while(rows < minimum || columns < minimum)
 	{
-		std::cout << "cannot have rows or column length to be less than 1" << std::endl;
+		std::cout << "cannot have rows or column length to be less than " << minimum << std::endl;
 		std::cout << "enter number of rows: ";
 		std::cin >> rows;
 		std::cout << "enter number of columns: ";
@@ -57,10 +92,18 @@ void userinput()
 	}
 	//loops until we have correct user input
 
-	//insert the user input to our map
-	user_input.insert({ "rows", rows });
-	user_input.insert({ "columns", columns });
-	user_input.insert({ "toPrint", (toPrint == 'y') ? 1 : 0});
+	//store the user input in our options
+	options.rows = rows;
+	options.columns = columns;
+	options.toPrint = (toPrint == 'y');
+	options.engine = (engine == 's') ? ENGINE_SPLIT : (engine == 'v') ? ENGINE_SIMD
+		: (engine == 'f') ? ENGINE_FUSED : (engine == 't') ? ENGINE_TILED
+		: (engine == 'g') ? ENGINE_GHOST : (engine == 'k') ? ENGINE_KERNEL : ENGINE_NAIVE;
+	options.stripColumns = stripColumns;
+	options.border = (border == 'c') ? BORDER_CLAMP : (border == 'm') ? BORDER_MIRROR
+		: (border == 'z') ? BORDER_ZERO : (border == 'v') ? BORDER_VALID : BORDER_WRAP;
+	options.threads = (threads > 0) ? threads : 0;
+	options.seed = (seed > 0) ? (uint64_t)seed : 0;
 }
 
 /*
@@ -74,7 +117,8 @@ void userinput()
 * @params Matrix Dy, covolution result of filter [-1, 0, 1] on vertical axis
 * @returns: None
 */
-void print(Matrix<unsigned char> & M, Matrix<short int> & Dx, Matrix<short int> & Dy)
+template <typename TIn, typename TOut>
+void print(Matrix<TIn> & M, Matrix<TOut> & Dx, Matrix<TOut> & Dy)
 {
 	//print M first
 	std::cout << std::endl;
@@ -94,132 +138,783 @@ void print(Matrix<unsigned char> & M, Matrix<short int> & Dx, Matrix<short int>
 }
 
 /*
-* Description: Calculate the horizontal and vertical convolultion result using filter [-1, 0, 1]
-* and store the resultant horizontal result in Dx and resultant vertical result in Dy
-* Implementation: for-loop implementation taking O(n) time to calculate the left and right 
-* sum. loop through each index of Matrix M and calculate Dx convolution and Dy convolution
-* and store them in the approriate index. 
-* EDGE CASE HANDLING: To deal with the edges of the matrix, we employ "WRAP-AROUND"
-* The reason for "WRAP-AROUND" is that I expect that matrices resemble around* the same values
-* on one-side of the edge as the other.
-*
-* Dx EDGE-CASE: For Dx edge-case, the edges are one the leftmost column and the rightmost column.
-* For the leftmost column, we need to assume a postive '1' value, so we take it from the rightmost column same row.
-* imagine like a wrap around, taking the matrix and bending it on the vertical axis so that the left and right edges touch.
-* For the rightmost column, we do the exact same thing but make the '-1' assumption for the leftmost column same row.
-*
-* Dy EDGE-CASE: For Dy edge-case, the edges are the topmost and bottommost row. This is the top and bottom row respectively.
-* When we convolve on the topmost row, our '-1' filter value will be the bottommost row same column
-* When we convolve on the bottommost row, our '1' filter value will be the topmost row same column
-* Employ the same assumption of the Wrap-Around method, assume that the matrix is like a picture and bend it across the 
-* horizontal access so that the topmost and bottommost rows touch.
-*
-* Preconditions: NONE
-* Postconditions: Dx and Dy will hold the respective horizontal and vertical convolution.
+* Description: Runs the kernel engine with the gradient operator the user chose
+* Implementation: The central difference is [-1, 0, 1] along one axis only. Sobel and
+* Scharr also smooth across the gradient, so Dx is [-1, 0, 1] along the rows and the
+* smoothing kernel along the columns, and Dy is the other way round.
+* @params MatrixView M, convolve with the chosen operator on horizontal and vertical axis
+* @params MatrixView Dx, covolution result on horizontal axis
+* @params MatrixView Dy, covolution result on vertical axis
+* @returns: None
+*/
+template <typename Border, typename TIn, typename TOut>
+void convolveKernel(MatrixView<TIn> M, MatrixView<TOut> Dx, MatrixView<TOut> Dy)
+{
+	//every pixel of a result reads M and writes one result
+	{
+		PROFILE_STAGE_BYTES(STAGE_DX, (double)(sizeof(TIn) + sizeof(TOut))*Dx.getRows()*Dx.getColumns());
+		switch(options.kernel)
+		{
+			case KERNEL_CENTRAL: convolveHorizontal<CentralDifferenceKernel, Border>(M, Dx); break;
+			case KERNEL_SOBEL: convolveSeparable<CentralDifferenceKernel, SobelSmoothKernel, Border>(M, Dx); break;
+			case KERNEL_SCHARR: convolveSeparable<CentralDifferenceKernel, ScharrSmoothKernel, Border>(M, Dx); break;
+		}
+	}
+	PROFILE_STAGE_BYTES(STAGE_DY, (double)(sizeof(TIn) + sizeof(TOut))*Dy.getRows()*Dy.getColumns());
+	switch(options.kernel)
+	{
+		case KERNEL_CENTRAL: convolveVertical<CentralDifferenceKernel, Border>(M, Dy); break;
+		case KERNEL_SOBEL: convolveSeparable<SobelSmoothKernel, CentralDifferenceKernel, Border>(M, Dy); break;
+		case KERNEL_SCHARR: convolveSeparable<ScharrSmoothKernel, CentralDifferenceKernel, Border>(M, Dy); break;
+	}
+}
+
+/*
+* Description: Runs convolveKernel() with the border policy the user chose
+* @params MatrixView M, convolve with the chosen operator on horizontal and vertical axis
+* @params MatrixView Dx, covolution result on horizontal axis
+* @params MatrixView Dy, covolution result on vertical axis
+* @returns: None
+*/
+template <typename TIn, typename TOut>
+void runKernel(MatrixView<TIn> M, MatrixView<TOut> Dx, MatrixView<TOut> Dy)
+{
+	//times Dx and Dy separately, see convolveKernel()
+	switch(options.border)
+	{
+		case BORDER_WRAP: convolveKernel<WrapBorder>(M, Dx, Dy); break;
+		case BORDER_CLAMP: convolveKernel<ClampBorder>(M, Dx, Dy); break;
+		case BORDER_MIRROR: convolveKernel<MirrorBorder>(M, Dx, Dy); break;
+		case BORDER_ZERO: convolveKernel<ZeroBorder>(M, Dx, Dy); break;
+		case BORDER_VALID: convolveKernel<ValidBorder>(M, Dx, Dy); break;
+	}
+}
+
+/*
+* Description: Computes the size of Dx or Dy for an M of rows x columns
+* Implementation: Only the kernel engine with valid-only borders shrinks its results, by 2
+* along the axis it differentiates and, for Sobel and Scharr, by 2 along the axis it smooths
+* @params rows, columns, the size of M
+* @params horizontal, true for Dx, false for Dy
+* @params resultRows, resultColumns, receive the size of the result
+* @returns: None
+*/
+void resultSize(int rows, int columns, bool horizontal, int & resultRows, int & resultColumns)
+{
+	const bool valid = options.engine == ENGINE_KERNEL && options.border == BORDER_VALID;
+	const bool smoothed = options.kernel != KERNEL_CENTRAL;
+	resultRows = rows - ((valid && (!horizontal || smoothed)) ? 2 : 0);
+	resultColumns = columns - ((valid && (horizontal || smoothed)) ? 2 : 0);
+}
+
+/*
+* Description: Runs the convolution engine the user selected once
+* Implementation: Only computes, the caller times the runs. The SIMD, fused and gradient
+* engines split M into row bands on the thread pool unless the user asked for a single thread.
+* @Preconditions: Dx and Dy have the size resultSize() gives, magnitude and orientation
+* have the size of M for the gradient engine
+* @Postcondtions: Dx and Dy will hold the respective horizontal and vertical convolution.
 * @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
 * @params Matrix Dx, covolution result of filter [-1, 0, 1] on horizontal axis
 * @params Matrix Dy, covolution result of filter [-1, 0, 1] on vertical axis
-* @return NONE
+* @params magnitude, orientation, the outputs of the gradient engine, empty views otherwise
+* @params extrema, receives the min/max of Dx and Dy when the fused engine is selected
+* @params pool, the thread pool for the parallel engines
+* @returns: None
 */
-void convolve(Matrix<unsigned char> & M, Matrix<short int> & Dx, Matrix<short int> & Dy)
+void runEngine(Matrix<unsigned char> & M, Matrix<short int> & Dx, Matrix<short int> & Dy, MatrixView<short int> magnitude,
+	MatrixView<unsigned char> orientation, GradientExtrema & extrema, ThreadPool & pool)
 {
-	//calculate time taken by program
-	//start counting
-	auto start = high_resolution_clock::now(); 
+	const bool parallel = pool.getThreads() > 1;
+	if(options.engine == ENGINE_KERNEL)
+	{
+		runKernel(M.view(), Dx.view(), Dy.view());
+		return;
+	}
 
-	//Value after summing the filter neighbors
-	short int xValAccumalator;
-	short int yValAccumalator;
-	//mirror value to deal with value being at edges of matrix
-	short int xMirror;
-	short int yMirror;
+	//M is read once, Dx and Dy written once, and the gradient stage also writes magnitude and orientation
+	PROFILE_STAGE_BYTES(STAGE_CONVOLVE, ((options.engine == ENGINE_GRADIENT) ? 8.0 : 5.0)*M.getRows()*M.getColumns());
+	switch(options.engine)
+	{
+		case ENGINE_NAIVE: convolve(M, Dx, Dy); break;
+		case ENGINE_SPLIT: convolveSplit(M, Dx, Dy); break;
+		case ENGINE_SIMD:
+			if(parallel) convolveParallel(M, Dx, Dy, pool);
+			else convolveSimd(M, Dx, Dy);
+			break;
+		case ENGINE_FUSED:
+			if(parallel) extrema = convolveFusedParallel(M, Dx, Dy, pool);
+			else extrema = convolveFused(M, Dx, Dy);
+			break;
+		case ENGINE_TILED: convolveTiled(M, Dx, Dy, options.stripColumns); break;
+		case ENGINE_GHOST: convolveGhost(M, Dx, Dy); break;
+		case ENGINE_GRADIENT:
+			if(parallel) convolveGradient(M, Dx, Dy, magnitude, orientation, GradientOptions(), pool);
+			else convolveGradient(M, Dx, Dy, magnitude, orientation, GradientOptions());
+			break;
+		case ENGINE_KERNEL:
+		case ENGINE_BATCH:
+		case ENGINE_STREAM:
+		case ENGINE_COMPACT:
+			//the kernel engine ran above, the others have their own results, see runBatch(), runStream() and runCompact()
+			break;
+	}
+}
 
-	//loop through the matrix, calculate the convolution result for Dx and Dy
-	//by summing the neighbors of M with the given filter kernel [-1, 0, 1]
-	//and store the value in Dx and Dy which are passed in by references
-	for(int i = 0; i < user_input["rows"]; i++)//start the outer loop at first row and make our way down
+/*
+* Description: Reports the time the convolution took
+* Implementation: Without --bench the median time of the repetitions is printed in
+* microseconds as it always was. With --bench the min, median and 99th percentile are
+* printed with the throughput of the median run, in pixels and in bytes of M read plus
+* results written.
+* @params seconds, the time of every timed repetition
+* @params pixels, the pixels of M convolved per repetition
+* @params bytesPerPixel, the bytes read and written per pixel
+* @params frames, the frames per repetition, 0 for the single-matrix engines
+* @params pool, the thread pool the engines ran on
+* @returns: None
+*/
+void reportTime(const std::vector<double> & seconds, double pixels, double bytesPerPixel, int frames, ThreadPool & pool)
+{
+	const TimingSummary summary = summarizeTimings(seconds);
+
+	std::cout << std::endl;
+	std::cout << std::endl;
+	if(!options.bench)
 	{
-		for(int j = 0; j < user_input["columns"]; j++)// for each row, loop through each value
+		std::cout << "Time taken by convolution function: " << (long long)(summary.medianSeconds*1e6) << " microseconds" << std::endl;
+	}
+	else
+	{
+		const std::ios::fmtflags flags = std::cout.flags();
+		const std::streamsize precision = std::cout.precision();
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "bench: " << ENGINE_NAMES[options.engine] << " engine, " << options.rows << " x " << options.columns
+			<< ", threads: " << pool.getThreads() << ", repetitions: " << summary.samples << " after " << options.warmup << " warmup" << std::endl;
+		std::cout << "min: " << summary.minSeconds*1e3 << " ms" << std::endl;
+		std::cout << "median: " << summary.medianSeconds*1e3 << " ms" << std::endl;
+		std::cout << "p99: " << summary.p99Seconds*1e3 << " ms" << std::endl;
+		std::cout << "throughput: " << pixels / summary.medianSeconds / 1e6 << " MPix/s, "
+			<< pixels*bytesPerPixel / summary.medianSeconds / 1e9 << " GB/s" << std::endl;
+		if(frames > 0)
 		{
-			// first calculate Dx and then calculate Dy
-			// Start of Dx calculation
-			if(M.leftEdge(i, j))// Dx calculation, value is on the leftmost edge so our "assumed -1 filter is the rightmost-edge mirror"
-			{
-				xMirror = M.get(i, user_input["columns"]-1); //mirror value is on 'same row' and last column
-				xValAccumalator = (-1*xMirror) + M.get(i, j+1);
-				Dx.put(i, j, xValAccumalator);
-			}
-			else if(M.rightEdge(i, j))// Dx calculation, value is the rightmost edge so our "assumed 1 filter is the leftmost-edge mirror"
-			{
-				xMirror = M.get(i, 0); //mirror value is on 'same row' and 0th column
-				xValAccumalator = (-1*M.get(i, j-1)) + xMirror;
-				Dx.put(i, j, xValAccumalator);
-			}
-			else// calculate the Dx value normally [-1, 0, 1] as the filter values exist -- no assuming values (not at critical edge)
-			{
-				xValAccumalator = (-1*M.get(i, j-1)) + M.get(i, j+1); //no edge case, -1*left of index + right of index = new value of index at Dx
-				Dx.put(i, j, xValAccumalator);
-			}
-			//End of Dx calculation
-			/*
-			* 
-			*/
-			// Start of Dy calculation
-			if(M.topEdge(i, j))// Dy Calculation, value is on the topmost edge so our assumed -1 filter is the bottommost-edge mirror"
-			{
-				yMirror = M.get(user_input["rows"]-1, j);//y Mirror for the '-1' counterpart on the filter will be on the bottommost edge on the same column
-				yValAccumalator = (-1*yMirror) + M.get(i+1, j);
-				Dy.put(i, j, yValAccumalator);
-			}
-			else if(M.bottomEdge(i, j))// Dy Calculation, value is on the bottommost edge so our assumed 1 filter is the topmost-edge mirror"
-			{
-				yMirror = M.get(0, j);// yMirror for the '1' counterpart is on the same column on the 0th row
-				yValAccumalator = (-1*M.get(i-1, j)) + yMirror;
-				Dy.put(i, j, yValAccumalator);
-			}
-			else// calculate the Dx value normally [-1, 0, 1] as the filter values exist -- no assuming values (not at critical edge)
-			{
-				yValAccumalator = -1*M.get(i-1, j) + M.get(i+1, j);
-				Dy.put(i, j, yValAccumalator);
-			}
-			// End of Dy calculation
+			std::cout << "frames per second: " << frames / summary.medianSeconds << std::endl;
 		}
+		std::cout.flags(flags);
+		std::cout.precision(precision);
 	}
 
-	// end time count
-	auto stop = high_resolution_clock::now();
-	auto timeTaken = duration_cast<microseconds>(stop - start);
+	if(options.engine == ENGINE_SIMD || options.engine == ENGINE_FUSED || options.engine == ENGINE_GHOST
+		|| options.engine == ENGINE_GRADIENT || options.engine == ENGINE_BATCH || options.engine == ENGINE_STREAM
+		|| options.engine == ENGINE_COMPACT)
+	{
+		std::cout << "SIMD row kernels: " << simdLevelName(simdLevel()) << ", threads: " << pool.getThreads() << std::endl;
+	}
+	if(options.engine == ENGINE_TILED)
+	{
+		int strip = (options.stripColumns > 0) ? options.stripColumns : autoStripColumns();
+		std::cout << "SIMD row kernels: " << simdLevelName(simdLevel()) << ", strip width: " << strip << " columns" << std::endl;
+	}
+}
 
+/*
+* Description: Prints the min and max values of Dx and Dy
+* @params xMin, xMax, yMin, yMax, the min and max values
+* @returns: None
+*/
+template <typename T>
+void printExtrema(T xMin, T xMax, T yMin, T yMax)
+{
 	std::cout << std::endl;
-	std::cout << std::endl;
-	std::cout << "Time taken by convolution function: " << timeTaken.count() << " microseconds" << std::endl;
+	std::cout << "x_max: " << xMax << std::endl;
+	std::cout << "x_min: " << xMin << std::endl;
+	std::cout << "y_max: " << yMax << std::endl;
+	std::cout << "y_min: " << yMin << std::endl;
+}
 
-	// print the matrix if the user asks to print
-	if(user_input["toPrint"]) print(M, Dx, Dy); 
+void printExtrema(const GradientExtrema & extrema)
+{
+	printExtrema(extrema.xMin, extrema.xMax, extrema.yMin, extrema.yMax);
+}
+
+/*
+* Description: The largest magnitude Dx and Dy of uint8 input can have, the histogram range
+* Implementation: 255 for [-1, 0, 1], times the sum of the smoothing taps for Sobel and Scharr
+* @returns: int, the limit
+*/
+int gradientLimit()
+{
+	if(options.engine != ENGINE_KERNEL || options.kernel == KERNEL_CENTRAL)
+	{
+		return 255;
+	}
+	return (options.kernel == KERNEL_SOBEL) ? 4*255 : 16*255;
+}
+
+/*
+* Description: Counts Dx and Dy into histograms for --percentiles, on the pool when it has threads
+* @params Dx, Dy, the results
+* @params pool, the thread pool
+* @params x, y, receive the histograms
+* @returns: None
+*/
+template <typename T>
+void histogramPass(MatrixView<T> Dx, MatrixView<T> Dy, ThreadPool & pool, GradientHistogram & x, GradientHistogram & y)
+{
+	const int limit = gradientLimit();
+	x = (pool.getThreads() > 1) ? computeHistogram(Dx, pool, -limit, limit) : computeHistogram(Dx, -limit, limit);
+	y = (pool.getThreads() > 1) ? computeHistogram(Dy, pool, -limit, limit) : computeHistogram(Dy, -limit, limit);
+}
+
+/*
+* Description: Prints the mean, variance and the --percentiles of Dx or Dy
+* @params axis, "x" or "y"
+* @params histogram, the histogram of Dx or Dy
+* @returns: None
+*/
+void printDistribution(const std::string & axis, const GradientHistogram & histogram)
+{
+	std::cout << axis << "_mean: " << histogram.getMean() << std::endl;
+	std::cout << axis << "_variance: " << histogram.getVariance() << std::endl;
+	for(double percent : options.percentiles)
+	{
+		std::cout << axis << "_p" << percent << ": " << histogram.getPercentile(percent) << std::endl;
+	}
+}
+
+/*
+* Description: Allocates a matrix whose elements are all overwritten before they are read
+* Implementation: FILL_NONE leaves the pages untouched, so the page faults of the first
+* write are counted in the stage that writes first, not in the alloc stage
+* @params rows, columns, the size of the matrix
+* @params layout, the layout of the matrix
+* @returns Matrix<T>, the matrix
+*/
+template <typename T>
+Matrix<T> allocateMatrix(int rows, int columns, const MatrixLayout & layout)
+{
+	PROFILE_STAGE(STAGE_ALLOC);
+	return Matrix<T>(rows, columns, layout, FILL_NONE);
+}
+
+/*
+* Description: Creates M, filled from the input file or with random values
+* Implementation: A matrix file is mapped by the Matrix(path) constructor and copied into
+* a matrix of the layout the engine wants, so the ghost-cell engine gets its ghost cells
+* for files too. The size of M then comes from the file.
+* Throws: std::runtime_error if the input file cannot be read
+* @params layout, the layout of M
+* @params seed, the seed of the random values
+* @params pool, the pool filling M
+* @returns Matrix<T>, M
+*/
+template <typename T>
+Matrix<T> createInput(const MatrixLayout & layout, uint64_t seed, ThreadPool & pool)
+{
+	if(options.input.empty())
+	{
+		Matrix<T> M = allocateMatrix<T>(options.rows, options.columns, layout);
+		PROFILE_STAGE_BYTES(STAGE_FILL, (double)options.rows*options.columns*sizeof(T));
+		M.fillRand(seed, pool);
+		return M;
+	}
+
+	//the file must hold elements of type T, Matrix(path) checks its element type
+	Matrix<T> file(options.input);
+	options.rows = file.getRows();
+	options.columns = file.getColumns();
+	Matrix<T> M = allocateMatrix<T>(options.rows, options.columns, layout);
+	PROFILE_STAGE_BYTES(STAGE_IO, (double)options.rows*options.columns*sizeof(T));
+	const MatrixView<T> from = file.view();
+	const MatrixView<T> to = M.view();
+	for(int i = 0; i < options.rows; i++)
+	{
+		std::memcpy(to.getRow(i), from.getRow(i), options.columns*sizeof(T));
+	}
+	M.refreshGhosts();
+	return M;
 }
 
-int main()
+/*
+* Description: Convolves a single matrix M with the engine the user selected
+* Throws: std::invalid_argument if M is too small for valid-only borders, std::runtime_error
+* if the input or output files cannot be used
+* @params seed, the seed of the random M
+* @params pool, the thread pool for the parallel engines and min/max
+* @returns: None
+*/
+void runMatrix(uint64_t seed, ThreadPool & pool)
 {
-	//1. gather user input
-	userinput(); 
-	//2. instantiate a matrix of size = rows x columns
-	Matrix<unsigned char> M(user_input["rows"], user_input["columns"]);
+	//1. instantiate a matrix of size = rows x columns
+	//the ghost-cell engine wants aligned, padded rows and a ring of wrap-around cells around M
+	MatrixLayout layout;
+	MatrixLayout ghostLayout;
+	if(options.engine == ENGINE_GHOST)
+	{
+		layout.padRows = true;
+		ghostLayout.padRows = true;
+		ghostLayout.ghost = 1;
+	}
+	//2. M is read from the input file, or filled with random unsigned chars through
+	//fillRand(), the same ones for the same seed, on all threads of the pool
+	Matrix<unsigned char> M = createInput<unsigned char>(ghostLayout, seed, pool);
+	if(options.engine == ENGINE_KERNEL && options.border == BORDER_VALID && (options.rows < 3 || options.columns < 3))
+	{
+		throw std::invalid_argument("valid-only borders need at least 3 rows and 3 columns");
+	}
+
 	//instantiate Dx and Dy to be of short ints to hold the negative values occuring
-	//when you applying convolution method.
-	Matrix<short int> Dx(user_input["rows"], user_input["columns"]);
-	Matrix<short int> Dy(user_input["rows"], user_input["columns"]);
-
-
-	//3. through Matrix member function fillRand(), M is filled with random unsigned chars 
-	//4. Applied convolution on x-axis and y-axis
-	//5. Stored results from step-4 in Dx and Dy
-	//6. Calculated time taken by convolution function
-	convolve(M, Dx, Dy);
-	
-	//7. Calculate the Min and Max of Dx and Dy matrix
-	std::cout << std::endl;
-	std::cout << "x_max: " << Dx.getMax() << std::endl;
-	std::cout << "x_min: " << Dx.getMin() << std::endl;
-	std::cout << "y_max: " << Dy.getMax() << std::endl;
-	std::cout << "y_min: " << Dy.getMin() << std::endl;
-}
\ No newline at end of file
+	//when you applying convolution method, every element is overwritten so they are not filled
+	int dxRows, dxColumns, dyRows, dyColumns;
+	resultSize(options.rows, options.columns, true, dxRows, dxColumns);
+	resultSize(options.rows, options.columns, false, dyRows, dyColumns);
+	Matrix<short int> Dx = allocateMatrix<short int>(dxRows, dxColumns, layout);
+	Matrix<short int> Dy = allocateMatrix<short int>(dyRows, dyColumns, layout);
+	std::unique_ptr<Matrix<short int> > magnitude;
+	std::unique_ptr<Matrix<unsigned char> > orientation;
+	if(options.engine == ENGINE_GRADIENT)
+	{
+		magnitude.reset(new Matrix<short int>(allocateMatrix<short int>(options.rows, options.columns, layout)));
+		orientation.reset(new Matrix<unsigned char>(allocateMatrix<unsigned char>(options.rows, options.columns, layout)));
+	}
+
+	//3. Applied convolution on x-axis and y-axis
+	//4. Stored results from step-3 in Dx and Dy
+	//5. Calculated time taken by convolution function
+	GradientExtrema extrema;
+	const std::vector<double> seconds = timeRepetitions(options.warmup, options.repetitions, [&]()
+	{
+		runEngine(M, Dx, Dy, magnitude ? magnitude->view() : MatrixView<short int>(),
+			orientation ? orientation->view() : MatrixView<unsigned char>(), extrema, pool);
+	});
+	const double bytesPerPixel = (options.engine == ENGINE_GRADIENT) ? 8.0 : 5.0;
+	reportTime(seconds, (double)options.rows*options.columns, bytesPerPixel, 0, pool);
+
+	// print the matrix if the user asks to print
+	if(options.toPrint)
+	{
+		PROFILE_STAGE(STAGE_IO);
+		print(M, Dx, Dy);
+	}
+	//the files are written on the writer thread while the min and max are computed below,
+	//nothing changes Dx, Dy, magnitude or orientation any more so they are not copied
+	AsyncWriter writer;
+	std::future<void> saved;
+	if(!options.output.empty())
+	{
+		saved = writer.submit([&]()
+		{
+			PROFILE_STAGE_BYTES(STAGE_IO, 2.0*((double)dxRows*dxColumns + (double)dyRows*dyColumns) + (magnitude ? 3.0*options.rows*options.columns : 0.0));
+			Dx.save(options.output + "_dx.cvmx");
+			Dy.save(options.output + "_dy.cvmx");
+			if(magnitude)
+			{
+				magnitude->save(options.output + "_magnitude.cvmx");
+				orientation->save(options.output + "_orientation.cvmx");
+			}
+		});
+	}
+
+	//6. Calculate the Min and Max of Dx and Dy matrix
+	//the fused engine already computed them in the same sweep as Dx and Dy,
+	//with --percentiles they come from the histograms with the rest of the statistics
+	GradientHistogram xHistogram, yHistogram;
+	if(!options.percentiles.empty())
+	{
+		PROFILE_STAGE_BYTES(STAGE_MINMAX, 2.0*((double)dxRows*dxColumns + (double)dyRows*dyColumns));
+		histogramPass(Dx.view(), Dy.view(), pool, xHistogram, yHistogram);
+		extrema = { (short int)xHistogram.getMin(), (short int)xHistogram.getMax(), (short int)yHistogram.getMin(), (short int)yHistogram.getMax() };
+	}
+	else if(options.engine != ENGINE_FUSED && pool.getThreads() > 1)
+	{
+		//getMin() and getMax() read every element once each
+		PROFILE_STAGE_BYTES(STAGE_MINMAX, 4.0*((double)dxRows*dxColumns + (double)dyRows*dyColumns));
+		extrema.xMax = Dx.getMax(pool);
+		extrema.xMin = Dx.getMin(pool);
+		extrema.yMax = Dy.getMax(pool);
+		extrema.yMin = Dy.getMin(pool);
+	}
+	else if(options.engine != ENGINE_FUSED)
+	{
+		PROFILE_STAGE_BYTES(STAGE_MINMAX, 4.0*((double)dxRows*dxColumns + (double)dyRows*dyColumns));
+		extrema.xMax = Dx.getMax();
+		extrema.xMin = Dx.getMin();
+		extrema.yMax = Dy.getMax();
+		extrema.yMin = Dy.getMin();
+	}
+	printExtrema(extrema);
+	if(!options.percentiles.empty())
+	{
+		printDistribution("x", xHistogram);
+		printDistribution("y", yHistogram);
+	}
+	if(magnitude)
+	{
+		std::cout << "magnitude_max: " << magnitude->getMax() << std::endl;
+	}
+	if(saved.valid())
+	{
+		//rethrows when a file could not be written
+		saved.get();
+	}
+}
+
+/*
+* Description: Convolves a single matrix M of a wider element type with the kernel engine
+* Implementation: The kernel engine path of runMatrix() for the element types other than
+* uint8. Dx and Dy are of type ConvolutionTypes<T>::Output, int for the 16-bit types so
+* the Sobel and Scharr sums cannot overflow, float or double for the floating point types.
+* Random floating point M are in [0, 1).
+* Throws: std::invalid_argument if M is too small for valid-only borders, std::runtime_error
+* if the input or output files cannot be used
+* @params seed, the seed of the random M
+* @params pool, the thread pool for min/max
+* @returns: None
+*/
+template <typename T>
+void runTyped(uint64_t seed, ThreadPool & pool)
+{
+	typedef typename ConvolutionTypes<T>::Output Result;
+	Matrix<T> M = createInput<T>(MatrixLayout(), seed, pool);
+	if(options.border == BORDER_VALID && (options.rows < 3 || options.columns < 3))
+	{
+		throw std::invalid_argument("valid-only borders need at least 3 rows and 3 columns");
+	}
+
+	int dxRows, dxColumns, dyRows, dyColumns;
+	resultSize(options.rows, options.columns, true, dxRows, dxColumns);
+	resultSize(options.rows, options.columns, false, dyRows, dyColumns);
+	Matrix<Result> Dx = allocateMatrix<Result>(dxRows, dxColumns, MatrixLayout());
+	Matrix<Result> Dy = allocateMatrix<Result>(dyRows, dyColumns, MatrixLayout());
+
+	const std::vector<double> seconds = timeRepetitions(options.warmup, options.repetitions, [&]()
+	{
+		runKernel(M.view(), Dx.view(), Dy.view());
+	});
+	reportTime(seconds, (double)options.rows*options.columns, (double)(sizeof(T) + 2*sizeof(Result)), 0, pool);
+
+	if(options.toPrint)
+	{
+		PROFILE_STAGE(STAGE_IO);
+		print(M, Dx, Dy);
+	}
+	if(!options.output.empty())
+	{
+		PROFILE_STAGE_BYTES(STAGE_IO, (double)sizeof(Result)*((double)dxRows*dxColumns + (double)dyRows*dyColumns));
+		Dx.save(options.output + "_dx.cvmx");
+		Dy.save(options.output + "_dy.cvmx");
+	}
+
+	PROFILE_STAGE_BYTES(STAGE_MINMAX, 2.0*sizeof(Result)*((double)dxRows*dxColumns + (double)dyRows*dyColumns));
+	if(pool.getThreads() > 1)
+	{
+		printExtrema(Dx.getMin(pool), Dx.getMax(pool), Dy.getMin(pool), Dy.getMax(pool));
+	}
+	else
+	{
+		printExtrema(Dx.getMin(), Dx.getMax(), Dy.getMin(), Dy.getMax());
+	}
+}
+
+/*
+* Description: Convolves a single matrix M with the compact engine
+* Implementation: Dx and Dy are signed chars narrowed as --narrow says, written to two
+* matrices of the size of M, or with --interleave as pairs to one matrix of twice its
+* columns. M is read once and 2 bytes are written per pixel either way.
+* Throws: std::runtime_error if the input or output files cannot be used
+* @params seed, the seed of the random M
+* @params pool, the thread pool for the row bands
+* @returns: None
+*/
+void runCompact(uint64_t seed, ThreadPool & pool)
+{
+	Matrix<unsigned char> M = createInput<unsigned char>(MatrixLayout(), seed, pool);
+	const CompactMode mode = (options.narrow == NARROW_HALVE) ? COMPACT_HALVE : COMPACT_SATURATE;
+	const bool parallel = pool.getThreads() > 1;
+
+	//the interleaved pairs go to Dx, twice as wide, and Dy is not used
+	Matrix<signed char> Dx = allocateMatrix<signed char>(options.rows, options.interleave ? 2*options.columns : options.columns, MatrixLayout());
+	std::unique_ptr<Matrix<signed char> > Dy;
+	if(!options.interleave)
+	{
+		Dy.reset(new Matrix<signed char>(allocateMatrix<signed char>(options.rows, options.columns, MatrixLayout())));
+	}
+
+	const std::vector<double> seconds = timeRepetitions(options.warmup, options.repetitions, [&]()
+	{
+		PROFILE_STAGE_BYTES(STAGE_CONVOLVE, 3.0*options.rows*options.columns);
+		if(options.interleave)
+		{
+			if(parallel) convolveInterleaved(M, Dx, mode, pool);
+			else convolveInterleaved(M, Dx, mode);
+		}
+		else
+		{
+			if(parallel) convolveCompact(M, Dx, *Dy, mode, pool);
+			else convolveCompact(M, Dx, *Dy, mode);
+		}
+	});
+	reportTime(seconds, (double)options.rows*options.columns, 3.0, 0, pool);
+
+	if(options.toPrint)
+	{
+		PROFILE_STAGE(STAGE_IO);
+		if(Dy)
+		{
+			print(M, Dx, *Dy);
+		}
+		else
+		{
+			std::cout << std::endl << std::endl << "Matrix M " << std::endl;
+			M.printMatrix();
+			std::cout << std::endl << "Matrix DxDy " << std::endl;
+			Dx.printMatrix();
+		}
+	}
+	if(!options.output.empty())
+	{
+		PROFILE_STAGE_BYTES(STAGE_IO, 2.0*options.rows*options.columns);
+		if(Dy)
+		{
+			Dx.save(options.output + "_dx.cvmx");
+			Dy->save(options.output + "_dy.cvmx");
+		}
+		else
+		{
+			Dx.save(options.output + "_dxdy.cvmx");
+		}
+	}
+
+	PROFILE_STAGE_BYTES(STAGE_MINMAX, 2.0*options.rows*options.columns);
+	if(!options.percentiles.empty())
+	{
+		GradientHistogram xHistogram, yHistogram;
+		histogramPass(Dx.view(), Dy->view(), pool, xHistogram, yHistogram);
+		printExtrema(xHistogram.getMin(), xHistogram.getMax(), yHistogram.getMin(), yHistogram.getMax());
+		printDistribution("x", xHistogram);
+		printDistribution("y", yHistogram);
+	}
+	else if(Dy)
+	{
+		printExtrema(+Dx.getMin(), +Dx.getMax(), +Dy->getMin(), +Dy->getMax());
+	}
+	else
+	{
+		printExtrema(getInterleavedExtrema(Dx));
+	}
+}
+
+/*
+* Description: Convolves a batch of random frames with convolveBatch()
+* Implementation: The frames are packed one after the other in one buffer, frame f being
+* filled like rows f*rows to (f+1)*rows - 1 of a random matrix. The min and max are
+* taken over all frames.
+* Throws: std::runtime_error if the output files cannot be written
+* @params seed, the seed of the random frames
+* @params pool, the thread pool the frames are convolved on
+* @returns: None
+*/
+void runBatch(uint64_t seed, ThreadPool & pool)
+{
+	const int rows = options.rows;
+	const int columns = options.columns;
+	const int count = options.frames;
+	const long frameElements = (long)rows*columns;
+	//the vectors are zeroed when they are created, so the alloc stage includes their page faults
+	std::vector<unsigned char> input;
+	std::vector<short int> dxData;
+	std::vector<short int> dyData;
+	{
+		PROFILE_STAGE(STAGE_ALLOC);
+		input.resize(count*frameElements);
+		dxData.resize(count*frameElements);
+		dyData.resize(count*frameElements);
+	}
+
+	{
+		PROFILE_STAGE_BYTES(STAGE_FILL, (double)count*frameElements);
+		//hashed like fillRand(), so frame 0 is the M of a single matrix with the same seed
+		const uint64_t mixedSeed = mixRandomBits(seed);
+		pool.run(count*rows, [&](int row)
+		{
+			fillRandomRow(&input[(long)row*columns], columns, mixedSeed, row);
+		});
+	}
+	const std::vector<MatrixView<unsigned char> > frames = frameViews(input.data(), count, rows, columns);
+	const std::vector<MatrixView<short int> > Dx = frameViews(dxData.data(), count, rows, columns);
+	const std::vector<MatrixView<short int> > Dy = frameViews(dyData.data(), count, rows, columns);
+
+	const std::vector<double> seconds = timeRepetitions(options.warmup, options.repetitions, [&]()
+	{
+		PROFILE_STAGE_BYTES(STAGE_CONVOLVE, 5.0*count*frameElements);
+		convolveBatch(frames, Dx, Dy, pool);
+	});
+	reportTime(seconds, (double)count*frameElements, 5.0, count, pool);
+
+	if(!options.output.empty())
+	{
+		PROFILE_STAGE_BYTES(STAGE_IO, 4.0*count*frameElements);
+		std::ofstream dxOut(options.output + "_dx.raw", std::ios::binary);
+		std::ofstream dyOut(options.output + "_dy.raw", std::ios::binary);
+		if(!dxOut || !dyOut)
+		{
+			throw std::runtime_error(options.output + ": cannot write the frame files");
+		}
+		StreamFrameSink sink(dxOut, dyOut);
+		for(int f = 0; f < count; f++)
+		{
+			sink.writeFrame(f, Dx[f], Dy[f]);
+		}
+	}
+
+	GradientExtrema extrema;
+	{
+		PROFILE_STAGE_BYTES(STAGE_MINMAX, 8.0*count*frameElements);
+		extrema = { Dx[0].getMin(), Dx[0].getMax(), Dy[0].getMin(), Dy[0].getMax() };
+		for(int f = 1; f < count; f++)
+		{
+			extrema.xMin = std::min(extrema.xMin, Dx[f].getMin());
+			extrema.xMax = std::max(extrema.xMax, Dx[f].getMax());
+			extrema.yMin = std::min(extrema.yMin, Dy[f].getMin());
+			extrema.yMax = std::max(extrema.yMax, Dy[f].getMax());
+		}
+	}
+	printExtrema(extrema);
+}
+
+/**
+* RowSink that drops the rows, for streaming runs that only want the time and the min/max
+*/
+class DiscardRowSink : public RowSink
+{
+public:
+	void writeRow(long, const short int *, int) {}
+};
+
+/*
+* Description: Convolves the raw rows of the input file with convolveStream()
+* Implementation: Every repetition reopens the input and, with --output, rewrites the raw
+* Dx and Dy files, so every repetition does the same reading and writing
+* Throws: std::runtime_error if the input or output files cannot be opened
+* @params pool, the thread pool, only reported, the stream engine runs on one thread
+* @returns: None
+*/
+void runStream(ThreadPool & pool)
+{
+	GradientExtrema extrema;
+	long rows = 0;
+	const std::vector<double> seconds = timeRepetitions(options.warmup, options.repetitions, [&]()
+	{
+		//the rows are read from the file between the rows being convolved, so the I/O is part of the stage
+		PROFILE_STAGE(STAGE_CONVOLVE);
+		std::ifstream in(options.input, std::ios::binary);
+		if(!in)
+		{
+			throw std::runtime_error(options.input + ": cannot open the input rows");
+		}
+		if(options.output.empty())
+		{
+			DiscardRowSink dxSink, dySink;
+			extrema = convolveStream(in, options.columns, dxSink, dySink, rows);
+			return;
+		}
+		std::ofstream dxOut(options.output + "_dx.raw", std::ios::binary | std::ios::trunc);
+		std::ofstream dyOut(options.output + "_dy.raw", std::ios::binary | std::ios::trunc);
+		if(!dxOut || !dyOut)
+		{
+			throw std::runtime_error(options.output + ": cannot write the row files");
+		}
+		StreamRowSink dxSink(dxOut), dySink(dyOut);
+		extrema = convolveStream(in, options.columns, dxSink, dySink, rows);
+	});
+	options.rows = (int)rows;
+	reportTime(seconds, (double)rows*options.columns, 5.0, 0, pool);
+	printExtrema(extrema);
+}
+
+#ifdef CONVOLUTION_INSTRUMENT
+/*
+* Description: Writes the stage statistics to options.stats, as CSV if the name ends in
+* ".csv" and as JSON otherwise
+* Throws: std::runtime_error if the file cannot be written
+* @returns: None
+*/
+void writeStats()
+{
+	std::ofstream out(options.stats);
+	if(!out)
+	{
+		throw std::runtime_error(options.stats + ": cannot write the statistics");
+	}
+	const std::string csv = ".csv";
+	if(options.stats.size() >= csv.size() && options.stats.compare(options.stats.size() - csv.size(), csv.size(), csv) == 0)
+	{
+		profiler().writeCsv(out);
+	}
+	else
+	{
+		profiler().writeJson(out);
+	}
+}
+#endif
+
+int main(int argc, char ** argv)
+{
+	try
+	{
+		//gather user input, from the command line or by asking for it
+		if(argc == 1)
+		{
+			userinput();
+		}
+		else
+		{
+			bool help;
+			options = parseArguments(argc, argv, help);
+			if(help)
+			{
+				printUsage(std::cout);
+				return 0;
+			}
+		}
+
+#ifndef CONVOLUTION_INSTRUMENT
+		if(!options.stats.empty())
+		{
+			throw std::invalid_argument("--stats needs a build with -DCONVOLUTION_INSTRUMENT");
+		}
+#endif
+
+		//start the worker threads before timing anything
+		ThreadPool pool(options.threads);
+		const uint64_t seed = (options.seed != 0) ? options.seed : (uint64_t)time(NULL);
+		switch(options.engine)
+		{
+			case ENGINE_BATCH: runBatch(seed, pool); break;
+			case ENGINE_STREAM: runStream(pool); break;
+			case ENGINE_COMPACT: runCompact(seed, pool); break;
+			default:
+				switch(options.dtype)
+				{
+					case ELEMENT_UINT8: runMatrix(seed, pool); break;
+					case ELEMENT_UINT16: runTyped<unsigned short int>(seed, pool); break;
+					case ELEMENT_INT16: runTyped<short int>(seed, pool); break;
+					case ELEMENT_FLOAT: runTyped<float>(seed, pool); break;
+					case ELEMENT_DOUBLE: runTyped<double>(seed, pool); break;
+				}
+				break;
+		}
+#ifdef CONVOLUTION_INSTRUMENT
+		if(!options.stats.empty())
+		{
+			writeStats();
+		}
+#endif
+	}
+	catch(const std::exception & e)
+	{
+		std::cout << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,337 @@
+#ifndef GRADIENT_CPP
+#define GRADIENT_CPP
+
+#include <cmath>
+#include <cfloat>
+#include <vector>
+#include <stdexcept>
+#include "Convolution.cpp"
+
+/*
+* Gradient magnitude and orientation computed in the same sweep as Dx and Dy.
+* Every row of Dx and Dy is produced by the SIMD row kernels and turned into magnitude
+* and orientation while it is still in the L1 cache, so Dx and Dy are never read back
+* from memory. When Dx and Dy themselves are not needed they are not stored at all:
+* the row kernels write into two scratch rows instead.
+*/
+
+/**
+* Norm of the gradient vector (Dx, Dy)
+* NORM_L1: |Dx| + |Dy|, at most 510
+* NORM_L2: sqrt(Dx^2 + Dy^2) rounded to the nearest integer, at most 361
+*/
+enum GradientNorm { NORM_L1, NORM_L2 };
+
+/**
+* How the orientation atan2(Dy, Dx) is computed
+* ORIENTATION_EXACT: std::atan2 for every pixel
+* ORIENTATION_FAST: polynomial approximation, error below 0.0003 radians, vectorized
+*/
+enum OrientationMode { ORIENTATION_EXACT, ORIENTATION_FAST };
+
+/**
+* Options of the gradient stage
+* bins: the orientation is quantized into 'bins' equal sectors of the full circle,
+* bin 0 is centered on the +x direction (Dx > 0, Dy = 0) and bins increase
+* counterclockwise toward +y, 2 <= bins <= 256
+*/
+struct GradientOptions
+{
+	GradientNorm norm = NORM_L2;
+	OrientationMode orientation = ORIENTATION_FAST;
+	int bins = 8;
+};
+
+///////////////////////////////////////
+//SCALAR GRADIENT ROWS
+///////////////////////////////////////
+/**
+* Description: Approximates atan2(y, x)
+* Implementation: Reduces the angle to [0, pi/4] as min(|x|,|y|) / max(|x|,|y|), evaluates a
+* 7th degree odd polynomial there and unfolds the result to the right octant.
+* @params y, the vertical component
+* @params x, the horizontal component
+* @returns float, the angle in [-pi, pi], 0 for (0, 0)
+*/
+inline float fastAtan2(float y, float x)
+{
+	const float ax = std::fabs(x);
+	const float ay = std::fabs(y);
+	const float a = std::min(ax, ay) / std::max(std::max(ax, ay), FLT_MIN);
+	const float s = a*a;
+	float r = ((-0.0464964749f*s + 0.15931422f)*s - 0.327622764f)*s*a + a;
+	if(ay > ax) r = 1.57079637f - r;
+	if(x < 0.0f) r = 3.14159274f - r;
+	if(y < 0.0f) r = -r;
+	return r;
+}
+
+/**
+* Description: Quantizes an angle into one of 'bins' sectors
+* Implementation: angle * bins / 2pi lies in [-bins/2, bins/2], shifting it by bins + 0.5
+* and truncating rounds it to the nearest sector, one subtraction wraps it into [0, bins)
+* (for bins >= 2, the float pi is slightly above pi and would need two for bins = 1)
+* @params angle, the angle in [-pi, pi]
+* @params bins, the number of sectors
+* @returns unsigned char, the sector index
+*/
+inline unsigned char orientationBin(float angle, int bins)
+{
+	int bin = (int)(angle * ((float)bins * 0.159154937f) + ((float)bins + 0.5f));
+	bin -= (bin >= bins) ? bins : 0;
+	return (unsigned char)bin;
+}
+
+/**
+* Description: Computes the magnitude and/or orientation of the columns [first, end) of one row
+* Preconditions: dx and dy hold the row of Dx and Dy
+* Postconditions: magnitude and orientation hold the results, a nullptr output is skipped
+* @params dx, the row of Dx
+* @params dy, the row of Dy
+* @params magnitude, the row of the magnitude, or nullptr
+* @params orientation, the row of the orientation, or nullptr
+* @params first, the first column
+* @params end, one past the last column
+* @params options, the norm, the orientation mode and the number of bins
+* @returns NONE
+*/
+void gradientRow(const short int * dx, const short int * dy, short int * magnitude, unsigned char * orientation, int first, int end, const GradientOptions & options)
+{
+	if(magnitude != nullptr && options.norm == NORM_L1)
+	{
+		for(int j = first; j < end; j++)
+		{
+			magnitude[j] = (short int)(std::abs(dx[j]) + std::abs(dy[j]));
+		}
+	}
+	else if(magnitude != nullptr)
+	{
+		for(int j = first; j < end; j++)
+		{
+			const float x = dx[j];
+			const float y = dy[j];
+			magnitude[j] = (short int)(int)(std::sqrt(x*x + y*y) + 0.5f);
+		}
+	}
+
+	if(orientation != nullptr && options.orientation == ORIENTATION_FAST)
+	{
+		for(int j = first; j < end; j++)
+		{
+			orientation[j] = orientationBin(fastAtan2(dy[j], dx[j]), options.bins);
+		}
+	}
+	else if(orientation != nullptr)
+	{
+		for(int j = first; j < end; j++)
+		{
+			orientation[j] = orientationBin(std::atan2((float)dy[j], (float)dx[j]), options.bins);
+		}
+	}
+}
+
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+///////////////////////////////////////
+//AVX2 GRADIENT ROWS
+///////////////////////////////////////
+/**
+* Description: fastAtan2() for 8 pixels, the same operations in the same order
+* @params y, the vertical components
+* @params x, the horizontal components
+* @returns __m256, the angles
+*/
+__attribute__((target("avx2")))
+inline __m256 fastAtan2Avx2(__m256 y, __m256 x)
+{
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 ax = _mm256_andnot_ps(signBit, x);
+	const __m256 ay = _mm256_andnot_ps(signBit, y);
+	const __m256 a = _mm256_div_ps(_mm256_min_ps(ax, ay), _mm256_max_ps(_mm256_max_ps(ax, ay), _mm256_set1_ps(FLT_MIN)));
+	const __m256 s = _mm256_mul_ps(a, a);
+
+	__m256 r = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(-0.0464964749f), s), _mm256_set1_ps(0.15931422f));
+	r = _mm256_sub_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(0.327622764f));
+	r = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(r, s), a), a);
+
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(1.57079637f), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(3.14159274f), r), _mm256_cmp_ps(x, zero, _CMP_LT_OQ));
+	r = _mm256_blendv_ps(r, _mm256_xor_ps(r, signBit), _mm256_cmp_ps(y, zero, _CMP_LT_OQ));
+	return r;
+}
+
+/**
+* Description: gradientRow() for whole blocks of 8 pixels, the remaining columns and the
+* exact orientation are left to gradientRow()
+* Implementation: Widens 8 Dx and 8 Dy values to 32 bit lanes, computes the magnitude in
+* integer (L1) or float (L2) lanes and the fast orientation in float lanes, then narrows
+* the results back to 16 and 8 bit
+* @returns int, the number of columns computed, a multiple of 8
+*/
+__attribute__((target("avx2")))
+int gradientRowAvx2(const short int * dx, const short int * dy, short int * magnitude, unsigned char * orientation, int columns, const GradientOptions & options)
+{
+	const bool fastOrientation = orientation != nullptr && options.orientation == ORIENTATION_FAST;
+	const __m256 scale = _mm256_set1_ps((float)options.bins * 0.159154937f);
+	const __m256 offset = _mm256_set1_ps((float)options.bins + 0.5f);
+	const __m256i bins = _mm256_set1_epi32(options.bins);
+	const __m256i binsMinusOne = _mm256_set1_epi32(options.bins - 1);
+
+	int j = 0;
+	for(; j + 8 <= columns; j += 8)
+	{
+		const __m256i ix = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(dx + j)));
+		const __m256i iy = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(dy + j)));
+		const __m256 x = _mm256_cvtepi32_ps(ix);
+		const __m256 y = _mm256_cvtepi32_ps(iy);
+
+		if(magnitude != nullptr)
+		{
+			__m256i m;
+			if(options.norm == NORM_L1)
+			{
+				m = _mm256_add_epi32(_mm256_abs_epi32(ix), _mm256_abs_epi32(iy));
+			}
+			else
+			{
+				const __m256 root = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)));
+				m = _mm256_cvttps_epi32(_mm256_add_ps(root, _mm256_set1_ps(0.5f)));
+			}
+			const __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1));
+			_mm_storeu_si128((__m128i *)(magnitude + j), packed);
+		}
+
+		if(fastOrientation)
+		{
+			const __m256 angle = fastAtan2Avx2(y, x);
+			__m256i bin = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(angle, scale), offset));
+			bin = _mm256_sub_epi32(bin, _mm256_and_si256(_mm256_cmpgt_epi32(bin, binsMinusOne), bins));
+			const __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(bin), _mm256_extracti128_si256(bin, 1));
+			_mm_storel_epi64((__m128i *)(orientation + j), _mm_packus_epi16(words, words));
+		}
+	}
+	return j;
+}
+#endif
+
+/**
+* Description: Computes the magnitude and orientation of one row with the widest code the CPU supports
+* @params dx, the row of Dx
+* @params dy, the row of Dy
+* @params magnitude, the row of the magnitude, or nullptr
+* @params orientation, the row of the orientation, or nullptr
+* @params columns, the column size of the matrix
+* @params options, the norm, the orientation mode and the number of bins
+* @returns NONE
+*/
+void gradientRowAuto(const short int * dx, const short int * dy, short int * magnitude, unsigned char * orientation, int columns, const GradientOptions & options)
+{
+	int done = 0;
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+	if(simdLevel() == SIMD_AVX2)
+	{
+		done = gradientRowAvx2(dx, dy, magnitude, orientation, columns, options);
+	}
+#endif
+	if(orientation != nullptr && options.orientation == ORIENTATION_EXACT)
+	{
+		//the vector code has no atan2, it only did the magnitude
+		gradientRow(dx, dy, nullptr, orientation, 0, columns, options);
+		gradientRow(dx, dy, magnitude, nullptr, done, columns, options);
+		return;
+	}
+	gradientRow(dx, dy, magnitude, orientation, done, columns, options);
+}
+
+///////////////////////////////////////
+//GRADIENT ENGINES
+///////////////////////////////////////
+/**
+* Description: Computes rows [firstRow, endRow) of Dx, Dy, the magnitude and the orientation
+* Implementation: For every row the SIMD row kernels compute Dx and Dy, with the usual
+* wrap-around, into the rows of Dx and Dy or into two scratch rows, and gradientRowAuto()
+* turns them into the magnitude and orientation right away.
+* @params M, the source matrix
+* @params Dx, Dy, the gradient outputs, or empty views to not store them
+* @params magnitude, the magnitude output, or an empty view
+* @params orientation, the orientation output, or an empty view
+* @params options, the norm, the orientation mode and the number of bins
+* @params firstRow, the first row to compute
+* @params endRow, one past the last row to compute
+* @return NONE
+*/
+void convolveGradientRange(MatrixView<unsigned char> M, MatrixView<short int> Dx, MatrixView<short int> Dy,
+	MatrixView<short int> magnitude, MatrixView<unsigned char> orientation, const GradientOptions & options, int firstRow, int endRow)
+{
+	const int rows = M.getRows();
+	const int columns = M.getColumns();
+	RowKernels kernels = simdRowKernels(simdLevel());
+	std::vector<short int> dxLine((Dx.getMatrix() == nullptr) ? columns : 0);
+	std::vector<short int> dyLine((Dy.getMatrix() == nullptr) ? columns : 0);
+
+	for(int i = firstRow; i < endRow; i++)
+	{
+		short int * dx = (Dx.getMatrix() != nullptr) ? Dx.getRow(i) : &dxLine[0];
+		short int * dy = (Dy.getMatrix() != nullptr) ? Dy.getRow(i) : &dyLine[0];
+
+		//the rows above the first and below the last row wrap around
+		kernels.dxRow(M.getRow(i), dx, columns);
+		kernels.dyRow(M.getRow((i == 0) ? rows - 1 : i - 1), M.getRow((i == rows - 1) ? 0 : i + 1), dy, columns);
+
+		gradientRowAuto(dx, dy, (magnitude.getMatrix() != nullptr) ? magnitude.getRow(i) : nullptr,
+			(orientation.getMatrix() != nullptr) ? orientation.getRow(i) : nullptr, columns, options);
+	}
+}
+
+/**
+* Description: Checks the options of the gradient stage
+* Throws: std::invalid_argument if the number of bins is outside [2, 256]
+*/
+void checkGradientOptions(const GradientOptions & options)
+{
+	if(options.bins < 2 || options.bins > 256)
+	{
+		throw std::invalid_argument("the number of orientation bins must be between 2 and 256");
+	}
+}
+
+/**
+* Description: Computes the gradient of M and its magnitude and quantized orientation in one sweep
+* Implementation: See convolveGradientRange(). Passing MatrixView<short int>() for Dx and
+* Dy computes the magnitude and orientation without storing the gradient, which saves
+* writing 4 bytes per pixel.
+* Throws: std::invalid_argument if the number of orientation bins is outside [2, 256]
+* Preconditions: every non-empty output has the row and column size of M
+* Postconditions: the non-empty outputs hold their results, Dx and Dy are identical to convolve()
+* @params M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params Dx, Dy, the gradient outputs, or empty views to not store them
+* @params magnitude, the magnitude output, or an empty view
+* @params orientation, the orientation bin output, or an empty view
+* @params options, the norm, the orientation mode and the number of bins
+* @return NONE
+*/
+void convolveGradient(MatrixView<unsigned char> M, MatrixView<short int> Dx, MatrixView<short int> Dy,
+	MatrixView<short int> magnitude, MatrixView<unsigned char> orientation, const GradientOptions & options)
+{
+	checkGradientOptions(options);
+	convolveGradientRange(M, Dx, Dy, magnitude, orientation, options, 0, M.getRows());
+}
+
+/**
+* Description: convolveGradient() on the row bands of a thread pool, banded as in convolveParallel()
+* @params pool, the thread pool to run the bands on
+*/
+void convolveGradient(MatrixView<unsigned char> M, MatrixView<short int> Dx, MatrixView<short int> Dy,
+	MatrixView<short int> magnitude, MatrixView<unsigned char> orientation, const GradientOptions & options, ThreadPool & pool)
+{
+	checkGradientOptions(options);
+	const int rows = M.getRows();
+	const int bands = std::min(rows, pool.getThreads());
+
+	pool.run(bands, [&](int band)
+	{
+		convolveGradientRange(M, Dx, Dy, magnitude, orientation, options, bandStart(rows, bands, band), bandStart(rows, bands, band+1));
+	});
+}
+
+#endif
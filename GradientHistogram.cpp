@@ -0,0 +1,376 @@
+#ifndef GRADIENT_HISTOGRAM_CPP
+#define GRADIENT_HISTOGRAM_CPP
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "MatrixView.cpp"
+#include "ThreadPool.cpp"
+
+/*
+* Statistics of Dx and Dy from one pass over them: an exact histogram of every value,
+* from which the min, max, mean, variance and any percentile follow without touching
+* the matrix again. The [-1, 0, 1] gradients of unsigned char input are in [-255, 255],
+* so the histogram has 511 bins and fits in L1; the Sobel and Scharr results of the
+* kernel engine need a wider range, given to the constructor.
+*
+* The pass is the counting alone. Counting is a scatter, so every value is counted in
+* one of LANES copies of the histogram in turn: a run of equal values, the common case
+* in flat regions, then increments LANES different counters instead of waiting on the
+* store of the previous increment of the same one. The parallel pass gives every row band
+* its own histogram and merges them when the bands are done, so the bands share nothing.
+*/
+
+class GradientHistogram
+{
+public:
+	/**
+	* The copies of the histogram consecutive values are counted in
+	*/
+	static const int LANES = 4;
+
+	/**
+	* @params lowest, highest, the range of values counted, [-255, 255] for the
+	* [-1, 0, 1] gradients of unsigned char input
+	*/
+	GradientHistogram(int lowest = -255, int highest = 255);
+
+	///////////////////////////////////////
+	//COUNTING
+	///////////////////////////////////////
+	template <typename T>
+	void add(const T * values, int count);
+	void merge(const GradientHistogram & other);
+
+	///////////////////////////////////////
+	//GETTERS
+	///////////////////////////////////////
+	int getLowest() const;
+	int getHighest() const;
+	long getTotal() const;
+	long getOutOfRange() const;
+	long getCount(int value) const;
+	std::vector<long> getCounts() const;
+	int getMin() const;
+	int getMax() const;
+	double getMean() const;
+	double getVariance() const;
+	int getPercentile(double percent) const;
+
+private:
+	int lowest;
+	int bins;
+
+	/**
+	* The LANES histograms one after the other, bin b of lane l at l*bins + b
+	*/
+	std::vector<long> counts;
+
+	long total;
+	long outOfRange;
+};
+
+GradientHistogram::GradientHistogram(int lowest, int highest)
+	: lowest(lowest), bins(highest - lowest + 1), counts((long)LANES*(highest - lowest + 1), 0), total(0), outOfRange(0)
+{
+	if(highest < lowest)
+	{
+		throw std::invalid_argument("the histogram range is empty");
+	}
+}
+
+/**
+* Description: Counts a run of values, normally one row of Dx or Dy
+* Implementation: Four values per step, one per lane. Values outside the range are not
+* counted, only their number is kept, see getOutOfRange().
+* @params values, the values
+* @params count, the number of values
+* @returns NONE
+*/
+template <typename T>
+void GradientHistogram::add(const T * values, int count)
+{
+	long * lane0 = counts.data();
+	long * lane1 = lane0 + bins;
+	long * lane2 = lane1 + bins;
+	long * lane3 = lane2 + bins;
+	const unsigned int range = (unsigned int)bins;
+	long missed = 0;
+
+	int j = 0;
+	for(; j + LANES <= count; j += LANES)
+	{
+		const unsigned int b0 = (unsigned int)((int)values[j] - lowest);
+		const unsigned int b1 = (unsigned int)((int)values[j+1] - lowest);
+		const unsigned int b2 = (unsigned int)((int)values[j+2] - lowest);
+		const unsigned int b3 = (unsigned int)((int)values[j+3] - lowest);
+		if(b0 < range) lane0[b0]++; else missed++;
+		if(b1 < range) lane1[b1]++; else missed++;
+		if(b2 < range) lane2[b2]++; else missed++;
+		if(b3 < range) lane3[b3]++; else missed++;
+	}
+	for(; j < count; j++)
+	{
+		const unsigned int b = (unsigned int)((int)values[j] - lowest);
+		if(b < range) lane0[b]++; else missed++;
+	}
+	total += count - missed;
+	outOfRange += missed;
+}
+
+/**
+* Description: Adds the counts of another histogram of the same range, the per-thread
+* histograms of the parallel pass are merged with it
+* Throws: std::invalid_argument if the ranges differ
+* @params other, the histogram to add
+* @returns NONE
+*/
+void GradientHistogram::merge(const GradientHistogram & other)
+{
+	if(other.lowest != lowest || other.bins != bins)
+	{
+		throw std::invalid_argument("cannot merge histograms of different ranges");
+	}
+	for(size_t k = 0; k < counts.size(); k++)
+	{
+		counts[k] += other.counts[k];
+	}
+	total += other.total;
+	outOfRange += other.outOfRange;
+}
+
+int GradientHistogram::getLowest() const
+{
+	return lowest;
+}
+
+int GradientHistogram::getHighest() const
+{
+	return lowest + bins - 1;
+}
+
+/**
+* Description: The number of values counted, not including those out of range
+*/
+long GradientHistogram::getTotal() const
+{
+	return total;
+}
+
+/**
+* Description: The number of values outside [getLowest(), getHighest()], which are not counted
+*/
+long GradientHistogram::getOutOfRange() const
+{
+	return outOfRange;
+}
+
+/**
+* Description: How often a value occurred
+* @params value, the value
+* @returns long, its count, 0 outside the range
+*/
+long GradientHistogram::getCount(int value) const
+{
+	const int bin = value - lowest;
+	if(bin < 0 || bin >= bins)
+	{
+		return 0;
+	}
+	long count = 0;
+	for(int lane = 0; lane < LANES; lane++)
+	{
+		count += counts[(long)lane*bins + bin];
+	}
+	return count;
+}
+
+/**
+* Description: The histogram with the lanes added up
+* @returns std::vector<long>, the count of value getLowest() + k at index k
+*/
+std::vector<long> GradientHistogram::getCounts() const
+{
+	std::vector<long> merged(counts.begin(), counts.begin() + bins);
+	for(int lane = 1; lane < LANES; lane++)
+	{
+		for(int bin = 0; bin < bins; bin++)
+		{
+			merged[bin] += counts[(long)lane*bins + bin];
+		}
+	}
+	return merged;
+}
+
+/**
+* Description: The least value counted, from the first non-empty bin
+* @returns int, the min, 0 if nothing was counted
+*/
+int GradientHistogram::getMin() const
+{
+	for(int bin = 0; bin < bins; bin++)
+	{
+		if(getCount(lowest + bin) > 0) return lowest + bin;
+	}
+	return 0;
+}
+
+/**
+* Description: The greatest value counted, from the last non-empty bin
+* @returns int, the max, 0 if nothing was counted
+*/
+int GradientHistogram::getMax() const
+{
+	for(int bin = bins - 1; bin >= 0; bin--)
+	{
+		if(getCount(lowest + bin) > 0) return lowest + bin;
+	}
+	return 0;
+}
+
+/**
+* Description: The mean of the values counted, exact up to the final division
+* @returns double, the mean, 0 if nothing was counted
+*/
+double GradientHistogram::getMean() const
+{
+	if(total == 0)
+	{
+		return 0.0;
+	}
+	long long sum = 0;
+	const std::vector<long> merged = getCounts();
+	for(int bin = 0; bin < bins; bin++)
+	{
+		sum += (long long)merged[bin]*(lowest + bin);
+	}
+	return (double)sum / total;
+}
+
+/**
+* Description: The population variance of the values counted
+* Implementation: Sums the squared distances of every bin from the mean, so there is no
+* cancellation as with the mean of the squares minus the squared mean
+* @returns double, the variance, 0 if nothing was counted
+*/
+double GradientHistogram::getVariance() const
+{
+	if(total == 0)
+	{
+		return 0.0;
+	}
+	const double mean = getMean();
+	double sum = 0.0;
+	const std::vector<long> merged = getCounts();
+	for(int bin = 0; bin < bins; bin++)
+	{
+		const double distance = lowest + bin - mean;
+		sum += merged[bin]*distance*distance;
+	}
+	return sum / total;
+}
+
+/**
+* Description: A percentile of the values counted, by the nearest-rank method
+* Implementation: The least value that at least percent % of the values are less than or
+* equal to, found by adding up the bins from the lowest, the 0th percentile is the min
+* and the 100th the max. Every percentile is one of the values counted.
+* Throws: std::invalid_argument if percent is not in [0, 100]
+* @params percent, the percentile, for example 99 or 99.9
+* @returns int, the value, 0 if nothing was counted
+*/
+int GradientHistogram::getPercentile(double percent) const
+{
+	if(!(percent >= 0.0 && percent <= 100.0))
+	{
+		throw std::invalid_argument("a percentile must be in [0, 100], got " + std::to_string(percent));
+	}
+	if(total == 0)
+	{
+		return 0;
+	}
+	const long rank = std::max(1L, (long)std::ceil(percent / 100.0 * total));
+	const std::vector<long> merged = getCounts();
+	long seen = 0;
+	for(int bin = 0; bin < bins; bin++)
+	{
+		seen += merged[bin];
+		if(seen >= rank) return lowest + bin;
+	}
+	return getMax();
+}
+
+///////////////////////////////////////
+//HISTOGRAM PASSES
+///////////////////////////////////////
+/**
+* Description: Throws if a histogram skipped values, after the pass that counted them
+*/
+void checkHistogramRange(const GradientHistogram & histogram)
+{
+	if(histogram.getOutOfRange() > 0)
+	{
+		throw std::out_of_range(std::to_string(histogram.getOutOfRange()) + " values are outside the histogram range ["
+			+ std::to_string(histogram.getLowest()) + ", " + std::to_string(histogram.getHighest()) + "]");
+	}
+}
+
+/**
+* Description: Counts every value of a matrix, in place of getMin() and getMax() when
+* more than the extrema is wanted
+* Throws: std::out_of_range if a value is outside [lowest, highest]
+* @params D, the matrix, normally Dx or Dy
+* @params lowest, highest, the range of its values
+* @returns GradientHistogram, the histogram
+*/
+template <typename T>
+GradientHistogram computeHistogram(MatrixView<T> D, int lowest = -255, int highest = 255)
+{
+	GradientHistogram histogram(lowest, highest);
+	for(int i = 0; i < D.getRows(); i++)
+	{
+		histogram.add(D.getRow(i), D.getColumns());
+	}
+	checkHistogramRange(histogram);
+	return histogram;
+}
+
+/**
+* Description: computeHistogram() using every thread of the pool
+* Implementation: One band of rows per thread, as getMin(pool), every band counts into
+* its own histogram and the histograms are merged once all bands are done
+* Throws: std::out_of_range if a value is outside [lowest, highest]
+* @params D, the matrix, normally Dx or Dy
+* @params pool, the thread pool to run the bands on
+* @params lowest, highest, the range of its values
+* @returns GradientHistogram, the histogram
+*/
+template <typename T>
+GradientHistogram computeHistogram(MatrixView<T> D, ThreadPool & pool, int lowest = -255, int highest = 255)
+{
+	const int rows = D.getRows();
+	const int parts = std::max(1, std::min(rows, pool.getThreads()));
+	std::vector<GradientHistogram> partial(parts, GradientHistogram(lowest, highest));
+
+	pool.run(parts, [&](int part)
+	{
+		const int first = (int)((long)rows*part / parts);
+		const int end = (int)((long)rows*(part+1) / parts);
+		for(int i = first; i < end; i++)
+		{
+			partial[part].add(D.getRow(i), D.getColumns());
+		}
+	});
+
+	//combine the per-thread histograms, the range is checked once on the merged one
+	for(int part = 1; part < parts; part++)
+	{
+		partial[0].merge(partial[part]);
+	}
+	checkHistogramRange(partial[0]);
+	return partial[0];
+}
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef INCREMENTAL_CONVOLUTION_CPP
+#define INCREMENTAL_CONVOLUTION_CPP
+
+#include "Convolution.cpp"
+#include "DirtyRegions.cpp"
+#include <vector>
+
+/*
+* Incremental convolution for a matrix of which only a few rectangles changed since Dx
+* and Dy were last computed (see DirtyRegions.cpp and Matrix::markDirty()).
+*
+* A pixel of M is a neighbor of the pixels left and right of it in Dx and above and
+* below it in Dy, so for a changed rectangle Dx is recomputed over its rows widened by
+* one column on each side and Dy over its columns widened by one row on each side. The
+* halo wraps around exactly like the full engines: a rectangle touching column 0 also
+* recomputes Dx of the last column, one touching row 0 also recomputes Dy of the last row.
+*
+* ExtremaCounts keeps the min and max of Dx and Dy up to date without a full pass: it
+* counts how often every value from -255 to 255 occurs, and every recomputed pixel moves
+* one count from its old value to its new one. A min or max that disappears is then
+* found by looking for the next non-empty count, at most 511 steps, instead of reading
+* the whole matrix.
+*
+* When the changed area is more than half the matrix, the full SIMD engine is faster
+* than the rectangle walk and is used instead.
+*/
+
+///////////////////////////////////////
+//EXTREMA COUNTS
+///////////////////////////////////////
+/**
+* How often every Dx and every Dy value occurs, to update their min and max incrementally
+*/
+class ExtremaCounts
+{
+public:
+	/**
+	* The values of Dx and Dy of an unsigned char matrix are in [-255, 255]
+	*/
+	static const int OFFSET = 255;
+	static const int BINS = 2*OFFSET + 1;
+
+	ExtremaCounts() : xCounts(BINS, 0), yCounts(BINS, 0)
+	{
+	}
+
+	/**
+	* Description: Counts every value of Dx and Dy, replacing the previous counts
+	* @params Dx, Dy, the convolution results
+	* @returns NONE
+	*/
+	void build(MatrixView<short int> Dx, MatrixView<short int> Dy)
+	{
+		countAll(Dx, xCounts);
+		countAll(Dy, yCounts);
+	}
+
+	/**
+	* Description: Copies the new values of a Dx segment over the old ones and moves their counts
+	* @params dst, the segment in Dx
+	* @params values, the new values
+	* @params count, the length of the segment
+	* @returns NONE
+	*/
+	void replaceDx(short int * dst, const short int * values, int count)
+	{
+		replace(xCounts, dst, values, count);
+	}
+
+	void replaceDy(short int * dst, const short int * values, int count)
+	{
+		replace(yCounts, dst, values, count);
+	}
+
+	/**
+	* Description: The min and max of Dx and Dy, from the first and last non-empty counts
+	* @returns GradientExtrema, the min and max values, 0 if nothing was counted
+	*/
+	GradientExtrema getExtrema() const
+	{
+		GradientExtrema extrema = { lowest(xCounts), greatest(xCounts), lowest(yCounts), greatest(yCounts) };
+		return extrema;
+	}
+
+private:
+	static void countAll(MatrixView<short int> D, std::vector<long> & counts)
+	{
+		std::fill(counts.begin(), counts.end(), 0);
+		for(int i = 0; i < D.getRows(); i++)
+		{
+			const short int * line = D.getMatrix() + (long)i*D.getStride();
+			for(int j = 0; j < D.getColumns(); j++)
+			{
+				counts[line[j] + OFFSET]++;
+			}
+		}
+	}
+
+	static void replace(std::vector<long> & counts, short int * dst, const short int * values, int count)
+	{
+		for(int j = 0; j < count; j++)
+		{
+			counts[dst[j] + OFFSET]--;
+			counts[values[j] + OFFSET]++;
+			dst[j] = values[j];
+		}
+	}
+
+	static short int lowest(const std::vector<long> & counts)
+	{
+		for(int k = 0; k < BINS; k++)
+		{
+			if(counts[k] > 0) return (short int)(k - OFFSET);
+		}
+		return 0;
+	}
+
+	static short int greatest(const std::vector<long> & counts)
+	{
+		for(int k = BINS-1; k >= 0; k--)
+		{
+			if(counts[k] > 0) return (short int)(k - OFFSET);
+		}
+		return 0;
+	}
+
+	std::vector<long> xCounts;
+	std::vector<long> yCounts;
+};
+
+///////////////////////////////////////
+//WRAPPED RANGES
+///////////////////////////////////////
+/**
+* Description: Folds a range that can reach past either end of [0, size) back into it
+* Implementation: A range as long as the whole dimension covers all of it, otherwise its
+* start is taken modulo size and the part past the end continues at 0
+* Preconditions: first < end, size > 0
+* @params first, end, the range [first, end), first can be negative
+* @params size, the row or column size of the matrix
+* @params ranges, receives up to two ranges [ranges[k][0], ranges[k][1]) inside [0, size)
+* @returns int, the number of ranges, 1 or 2
+*/
+int wrapRange(int first, int end, int size, int ranges[2][2])
+{
+	const int length = end - first;
+	if(length >= size)
+	{
+		ranges[0][0] = 0;
+		ranges[0][1] = size;
+		return 1;
+	}
+	const int start = ((first % size) + size) % size;
+	if(start + length <= size)
+	{
+		ranges[0][0] = start;
+		ranges[0][1] = start + length;
+		return 1;
+	}
+	ranges[0][0] = start;
+	ranges[0][1] = size;
+	ranges[1][0] = 0;
+	ranges[1][1] = start + length - size;
+	return 2;
+}
+
+///////////////////////////////////////
+//INCREMENTAL CONVOLUTION ENGINE
+///////////////////////////////////////
+/**
+* Description: Recomputes Dx and Dy around one changed rectangle
+* Implementation: Dx of the rectangle's rows over its columns plus the halo, then Dy of
+* its columns over its rows plus the halo, each split into at most two wrapped ranges.
+* With counts the new values go through a scratch row so their counts can be moved,
+* without them they are written straight into Dx and Dy.
+* @params M, the changed matrix
+* @params rect, the changed rectangle, inside M
+* @params Dx, Dy, the results to bring up to date
+* @params kernels, the row kernels to use
+* @params counts, the counts to keep up to date, or nullptr
+* @params scratch, a row of at least M.getColumns() values
+* @returns NONE
+*/
+void convolveDirtyRect(MatrixView<unsigned char> M, const DirtyRect & rect, MatrixView<short int> Dx, MatrixView<short int> Dy, const RowKernels & kernels, ExtremaCounts * counts, short int * scratch)
+{
+	const int rows = M.getRows();
+	const int columns = M.getColumns();
+	const unsigned char * m = M.getMatrix();
+	const long mStride = M.getStride();
+
+	int ranges[2][2];
+	const int columnRanges = wrapRange(rect.column - 1, rect.column + rect.columns + 1, columns, ranges);
+	for(int i = rect.row; i < rect.row + rect.rows; i++)
+	{
+		const unsigned char * src = m + i*mStride;
+		short int * dst = Dx.getMatrix() + i*(long)Dx.getStride();
+		for(int k = 0; k < columnRanges; k++)
+		{
+			const int first = ranges[k][0];
+			const int end = ranges[k][1];
+			if(counts == nullptr)
+			{
+				convolveSegmentDx(src, dst, columns, first, end, kernels);
+				continue;
+			}
+			convolveSegmentDx(src, scratch, columns, first, end, kernels);
+			counts->replaceDx(dst + first, scratch + first, end - first);
+		}
+	}
+
+	const int rowRanges = wrapRange(rect.row - 1, rect.row + rect.rows + 1, rows, ranges);
+	for(int k = 0; k < rowRanges; k++)
+	{
+		for(int i = ranges[k][0]; i < ranges[k][1]; i++)
+		{
+			//the '-1' and '1' neighbor rows wrap around, as in convolveRowRange()
+			const unsigned char * above = m + ((i + rows - 1) % rows)*mStride + rect.column;
+			const unsigned char * below = m + ((i + 1) % rows)*mStride + rect.column;
+			short int * dst = Dy.getMatrix() + i*(long)Dy.getStride() + rect.column;
+			if(counts == nullptr)
+			{
+				kernels.rowDy(above, below, dst, rect.columns);
+				continue;
+			}
+			kernels.rowDy(above, below, scratch, rect.columns);
+			counts->replaceDy(dst, scratch, rect.columns);
+		}
+	}
+}
+
+/**
+* Description: Brings Dx and Dy up to date after the rectangles of 'dirty' changed in M
+* Implementation: Runs convolveDirtyRect() for every rectangle, or the full SIMD engine
+* when the rectangles cover more than half of M. Rectangles never overlap, but their
+* halos can, those pixels are then simply computed twice.
+* Preconditions: Dx and Dy hold the convolution of M as it was before the changes,
+* M, Dx and Dy have the same row and column size, the rectangles are inside M
+* Postconditions: Dx and Dy hold the convolution of M, the same as any full engine,
+* the caller clears the dirty regions
+* @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params dirty, the changed rectangles, normally M.getDirtyRegions()
+* @params Matrix Dx, covolution result of filter [-1, 0, 1] on horizontal axis
+* @params Matrix Dy, covolution result of filter [-1, 0, 1] on vertical axis
+* @return NONE
+*/
+void convolveDirty(MatrixView<unsigned char> M, const DirtyRegions & dirty, MatrixView<short int> Dx, MatrixView<short int> Dy)
+{
+	if(2*dirty.getArea() > (long)M.getRows()*M.getColumns())
+	{
+		convolveSimd(M, Dx, Dy);
+		return;
+	}
+	const RowKernels kernels = simdRowKernels(simdLevel());
+	for(const DirtyRect & rect : dirty.getRects())
+	{
+		convolveDirtyRect(M, rect, Dx, Dy, kernels, nullptr, nullptr);
+	}
+}
+
+/**
+* Description: convolveDirty() that also keeps the min and max of Dx and Dy up to date
+* Implementation: Every recomputed value moves one count of 'counts', the full engine
+* fallback recounts everything
+* Preconditions: as convolveDirty(), and counts were built from Dx and Dy before the changes
+* Postconditions: as convolveDirty(), and counts match the new Dx and Dy
+* @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params dirty, the changed rectangles, normally M.getDirtyRegions()
+* @params Matrix Dx, covolution result of filter [-1, 0, 1] on horizontal axis
+* @params Matrix Dy, covolution result of filter [-1, 0, 1] on vertical axis
+* @params counts, the counts of the values of Dx and Dy
+* @return GradientExtrema, the min and max values of the new Dx and Dy
+*/
+GradientExtrema convolveDirty(MatrixView<unsigned char> M, const DirtyRegions & dirty, MatrixView<short int> Dx, MatrixView<short int> Dy, ExtremaCounts & counts)
+{
+	if(2*dirty.getArea() > (long)M.getRows()*M.getColumns())
+	{
+		convolveSimd(M, Dx, Dy);
+		counts.build(Dx, Dy);
+		return counts.getExtrema();
+	}
+	const RowKernels kernels = simdRowKernels(simdLevel());
+	std::vector<short int> scratch(M.getColumns());
+	for(const DirtyRect & rect : dirty.getRects())
+	{
+		convolveDirtyRect(M, rect, Dx, Dy, kernels, &counts, scratch.data());
+	}
+	return counts.getExtrema();
+}
+
+#endif
@@ -0,0 +1,323 @@
+#ifndef INSTRUMENTATION_CPP
+#define INSTRUMENTATION_CPP
+
+/*
+* Per-stage instrumentation of the driver: wall-clock time, call count and, on Linux,
+* the hardware counters cycles, instructions and last-level cache misses of every stage
+* (allocation, fill, Dx, Dy, min/max, I/O), exported as JSON or CSV.
+*
+* Everything is compiled out unless CONVOLUTION_INSTRUMENT is defined: PROFILE_STAGE()
+* and PROFILE_STAGE_BYTES() then expand to nothing, so the stages cost nothing in a
+* normal build. With it, a stage costs two clock reads and, when the counters are open,
+* six read() system calls, so the stages are placed around whole sweeps and never
+* inside a row loop.
+*
+* The counters follow the thread that opened them, the one running main(). The engines
+* run their first band on that thread and the rest on the workers of the pool, so the
+* counters cover the whole engine only with a single thread (--threads 1).
+*
+* Reading the results: the bytes of a stage over its time is the bandwidth it reached.
+* Close to the bandwidth of the machine with few instructions per cycle and many LLC
+* misses means memory-bound. Far below it with a high instructions per cycle means
+* compute-bound.
+*/
+
+#ifdef CONVOLUTION_INSTRUMENT
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+* Stages of a run
+* STAGE_CONVOLVE is Dx and Dy computed in the same sweep, which most engines do,
+* STAGE_DX and STAGE_DY are used by engines that compute them one after the other
+*/
+enum ProfileStage { STAGE_ALLOC, STAGE_FILL, STAGE_DX, STAGE_DY, STAGE_CONVOLVE, STAGE_MINMAX, STAGE_IO, STAGE_COUNT };
+const char * const STAGE_NAMES[] = { "alloc", "fill", "dx", "dy", "convolve", "minmax", "io" };
+
+enum HardwareCounter { COUNTER_CYCLES, COUNTER_INSTRUCTIONS, COUNTER_LLC_MISSES, COUNTER_COUNT };
+const char * const COUNTER_NAMES[] = { "cycles", "instructions", "llc_misses" };
+
+/**
+* One reading of every hardware counter
+*/
+struct CounterValues
+{
+	uint64_t values[COUNTER_COUNT];
+};
+
+///////////////////////////////////////
+//HARDWARE COUNTERS
+///////////////////////////////////////
+/**
+* The hardware counters of the calling thread, through the Linux perf_event interface.
+* Opening them fails without a PMU or when perf_event_paranoid forbids it (containers,
+* most virtual machines), the counters are then unavailable and read zero.
+*/
+class HardwareCounters
+{
+public:
+	HardwareCounters()
+	{
+		for(int k = 0; k < COUNTER_COUNT; k++)
+		{
+			fds[k] = -1;
+		}
+#ifdef __linux__
+		const uint64_t configs[COUNTER_COUNT] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES };
+		for(int k = 0; k < COUNTER_COUNT; k++)
+		{
+			struct perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.size = sizeof(attr);
+			attr.config = configs[k];
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			fds[k] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+			if(fds[k] < 0)
+			{
+				//all or nothing, a partial set would make the ratios meaningless
+				close();
+				return;
+			}
+		}
+#endif
+	}
+
+	~HardwareCounters()
+	{
+		close();
+	}
+
+	HardwareCounters(const HardwareCounters &) = delete;
+	HardwareCounters & operator=(const HardwareCounters &) = delete;
+
+	bool isAvailable() const
+	{
+		return fds[0] >= 0;
+	}
+
+	CounterValues read() const
+	{
+		CounterValues reading = { { 0, 0, 0 } };
+#ifdef __linux__
+		for(int k = 0; k < COUNTER_COUNT && isAvailable(); k++)
+		{
+			uint64_t value = 0;
+			if(::read(fds[k], &value, sizeof(value)) == (ssize_t)sizeof(value))
+			{
+				reading.values[k] = value;
+			}
+		}
+#endif
+		return reading;
+	}
+
+private:
+	void close()
+	{
+		for(int k = 0; k < COUNTER_COUNT; k++)
+		{
+#ifdef __linux__
+			if(fds[k] >= 0)
+			{
+				::close(fds[k]);
+			}
+#endif
+			fds[k] = -1;
+		}
+	}
+
+	int fds[COUNTER_COUNT];
+};
+
+///////////////////////////////////////
+//STAGE STATISTICS
+///////////////////////////////////////
+/**
+* Totals of one stage over every time it ran
+*/
+struct StageStats
+{
+	long calls;
+	double seconds;
+	double bytes;
+	uint64_t counters[COUNTER_COUNT];
+};
+
+/**
+* The totals of every stage of the run, filled by ScopedStage
+*/
+class Profiler
+{
+public:
+	Profiler() : stats()
+	{
+	}
+
+	const HardwareCounters & getCounters() const
+	{
+		return counters;
+	}
+
+	void add(ProfileStage stage, double seconds, double bytes, const CounterValues & start, const CounterValues & end)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		StageStats & total = stats[stage];
+		total.calls++;
+		total.seconds += seconds;
+		total.bytes += bytes;
+		for(int k = 0; k < COUNTER_COUNT; k++)
+		{
+			total.counters[k] += end.values[k] - start.values[k];
+		}
+	}
+
+	/**
+	* Description: Writes the stages that ran as a JSON object
+	* @params out, the stream to write to
+	* @returns NONE
+	*/
+	void writeJson(std::ostream & out) const
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		out << "{" << std::endl;
+		out << "  \"counters_available\": " << (counters.isAvailable() ? "true" : "false") << "," << std::endl;
+		out << "  \"stages\": [";
+		bool first = true;
+		for(int s = 0; s < STAGE_COUNT; s++)
+		{
+			const StageStats & total = stats[s];
+			if(total.calls == 0)
+			{
+				continue;
+			}
+			out << (first ? "" : ",") << std::endl;
+			first = false;
+			out << "    { \"stage\": \"" << STAGE_NAMES[s] << "\", \"calls\": " << total.calls
+				<< ", \"seconds\": " << total.seconds << ", \"bytes\": " << (long long)total.bytes
+				<< ", \"gb_per_s\": " << bandwidth(total);
+			if(counters.isAvailable())
+			{
+				for(int k = 0; k < COUNTER_COUNT; k++)
+				{
+					out << ", \"" << COUNTER_NAMES[k] << "\": " << total.counters[k];
+				}
+				out << ", \"ipc\": " << instructionsPerCycle(total);
+			}
+			out << " }";
+		}
+		out << std::endl << "  ]" << std::endl << "}" << std::endl;
+	}
+
+	/**
+	* Description: Writes the stages that ran as CSV, one row per stage, the counter
+	* columns are empty when the counters are unavailable
+	* @params out, the stream to write to
+	* @returns NONE
+	*/
+	void writeCsv(std::ostream & out) const
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		out << "stage,calls,seconds,bytes,gb_per_s,cycles,instructions,llc_misses,ipc" << std::endl;
+		for(int s = 0; s < STAGE_COUNT; s++)
+		{
+			const StageStats & total = stats[s];
+			if(total.calls == 0)
+			{
+				continue;
+			}
+			out << STAGE_NAMES[s] << ',' << total.calls << ',' << total.seconds << ',' << (long long)total.bytes << ',' << bandwidth(total);
+			for(int k = 0; k < COUNTER_COUNT; k++)
+			{
+				out << ',';
+				if(counters.isAvailable()) out << total.counters[k];
+			}
+			out << ',';
+			if(counters.isAvailable()) out << instructionsPerCycle(total);
+			out << std::endl;
+		}
+	}
+
+private:
+	static double bandwidth(const StageStats & total)
+	{
+		return (total.seconds > 0.0) ? total.bytes / total.seconds / 1e9 : 0.0;
+	}
+
+	static double instructionsPerCycle(const StageStats & total)
+	{
+		return (total.counters[COUNTER_CYCLES] > 0) ? (double)total.counters[COUNTER_INSTRUCTIONS] / total.counters[COUNTER_CYCLES] : 0.0;
+	}
+
+	HardwareCounters counters;
+	StageStats stats[STAGE_COUNT];
+	mutable std::mutex lock;
+};
+
+/**
+* Description: The profiler of the process, created with its counters on first use
+* @returns Profiler &, the profiler
+*/
+Profiler & profiler()
+{
+	static Profiler instance;
+	return instance;
+}
+
+/**
+* Times a stage from its construction to the end of its scope
+*/
+class ScopedStage
+{
+public:
+	/**
+	* @params stage, the stage
+	* @params bytes, the bytes the stage reads and writes, for its bandwidth
+	*/
+	ScopedStage(ProfileStage stage, double bytes = 0.0) : stage(stage), bytes(bytes)
+	{
+		counters = profiler().getCounters().read();
+		start = std::chrono::steady_clock::now();
+	}
+
+	~ScopedStage()
+	{
+		const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		const CounterValues endCounters = profiler().getCounters().read();
+		profiler().add(stage, std::chrono::duration<double>(end - start).count(), bytes, counters, endCounters);
+	}
+
+	ScopedStage(const ScopedStage &) = delete;
+	ScopedStage & operator=(const ScopedStage &) = delete;
+
+private:
+	ProfileStage stage;
+	double bytes;
+	CounterValues counters;
+	std::chrono::steady_clock::time_point start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_STAGE(stage) ScopedStage PROFILE_CONCAT(profileStage, __LINE__)(stage)
+#define PROFILE_STAGE_BYTES(stage, bytes) ScopedStage PROFILE_CONCAT(profileStage, __LINE__)(stage, (double)(bytes))
+
+#else
+
+#define PROFILE_STAGE(stage)
+#define PROFILE_STAGE_BYTES(stage, bytes)
+
+#endif
+
+#endif
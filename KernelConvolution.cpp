@@ -0,0 +1,522 @@
+#ifndef KERNEL_CONVOLUTION_CPP
+#define KERNEL_CONVOLUTION_CPP
+
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include "MatrixView.cpp"
+#include "SimdKernels.cpp"
+#include "BorderPolicy.cpp"
+
+/*
+* Separable convolution with arbitrary odd-sized kernels.
+* A compile-time kernel such as Kernel<-1, 0, 1> carries its taps in its type: every
+* tap becomes a constant in the unrolled sum, zero taps disappear and taps of 1/-1
+* become plain additions/subtractions, so convolveHorizontal<Kernel<-1, 0, 1> >()
+* compiles to the same loop as the hand-written Dx kernel. RuntimeKernel holds its
+* taps in a vector for filters that are only known at runtime.
+*
+* Like convolve() in NaiveConvolution.cpp the kernel is applied as
+*   D(i, j) = sum over k of taps[k] * M(i, j + k - radius)      (horizontal)
+*   D(i, j) = sum over k of taps[k] * M(i + k - radius, j)      (vertical)
+* Taps outside the matrix are resolved by a border policy (BorderPolicy.cpp), by default
+* the "WRAP-AROUND" of convolve(), so Kernel<-1, 0, 1> gives exactly Dx and Dy.
+*
+* The engine is generic over the element type of M: unsigned char, unsigned short, short,
+* float and double. ConvolutionTypes<T> picks the type the sums are accumulated in and the
+* type of the results, wide enough that no kernel of this file overflows: int for the
+* integer types, which holds the Sobel/Scharr sums of 16-bit data, and the element type
+* itself for float and double. The span loops are plain loops over these types, so the
+* compiler vectorizes every one of them, with 256 bit vectors in the AVX2 builds.
+*/
+
+///////////////////////////////////////
+//ELEMENT TYPES
+///////////////////////////////////////
+/**
+* The accumulator and the result type of a kernel applied to elements of type T.
+* Only the types below are supported, any other T fails to compile.
+*/
+template <typename T>
+struct ConvolutionTypes;
+
+/**
+* Dx and Dy of unsigned chars are in [-255, 255], so the results stay short ints as in
+* convolve(), kernels with larger sums write into an int matrix instead
+*/
+template <> struct ConvolutionTypes<unsigned char> { typedef int Accumulator; typedef short int Output; };
+template <> struct ConvolutionTypes<unsigned short int> { typedef int Accumulator; typedef int Output; };
+template <> struct ConvolutionTypes<short int> { typedef int Accumulator; typedef int Output; };
+template <> struct ConvolutionTypes<int> { typedef int Accumulator; typedef int Output; };
+template <> struct ConvolutionTypes<float> { typedef float Accumulator; typedef float Output; };
+template <> struct ConvolutionTypes<double> { typedef double Accumulator; typedef double Output; };
+
+///////////////////////////////////////
+//COMPILE-TIME KERNELS
+///////////////////////////////////////
+/**
+* Unrolled sum over the taps of a kernel, one template level per tap.
+* Index is the position of the first remaining tap in the kernel.
+*/
+template <int Index, int... Taps>
+struct KernelTaps
+{
+	template <typename T>
+	static inline typename ConvolutionTypes<T>::Accumulator apply(const T *) { return 0; }
+
+	template <typename T>
+	static inline typename ConvolutionTypes<T>::Accumulator applyRows(const T * const *, int) { return 0; }
+
+	template <typename Border, typename T>
+	static inline typename ConvolutionTypes<T>::Accumulator applyBorder(const T *, int, int) { return 0; }
+};
+
+template <int Index, int Tap, int... Rest>
+struct KernelTaps<Index, Tap, Rest...>
+{
+	/**
+	* Description: sum of Tap_k * p[k] over the remaining taps
+	*/
+	template <typename T>
+	static inline typename ConvolutionTypes<T>::Accumulator apply(const T * p)
+	{
+		typedef typename ConvolutionTypes<T>::Accumulator Sum;
+		return ((Tap == 0) ? Sum(0) : Tap * (Sum)p[Index]) + KernelTaps<Index + 1, Rest...>::apply(p);
+	}
+
+	/**
+	* Description: sum of Tap_k * rows[k][column] over the remaining taps
+	*/
+	template <typename T>
+	static inline typename ConvolutionTypes<T>::Accumulator applyRows(const T * const * rows, int column)
+	{
+		typedef typename ConvolutionTypes<T>::Accumulator Sum;
+		return ((Tap == 0) ? Sum(0) : Tap * (Sum)rows[Index][column]) + KernelTaps<Index + 1, Rest...>::applyRows(rows, column);
+	}
+
+	/**
+	* Description: sum of Tap_k * p[Border::index(first + k, columns)] over the remaining taps
+	*/
+	template <typename Border, typename T>
+	static inline typename ConvolutionTypes<T>::Accumulator applyBorder(const T * p, int first, int columns)
+	{
+		typedef typename ConvolutionTypes<T>::Accumulator Sum;
+		const int column = Border::index(first + Index, columns);
+		return ((Tap == 0 || column < 0) ? Sum(0) : Tap * (Sum)p[column])
+			+ KernelTaps<Index + 1, Rest...>::template applyBorder<Border>(p, first, columns);
+	}
+};
+
+/**
+* Kernel whose taps are compile-time constants, e.g. Kernel<-1, 0, 1> or Kernel<1, 4, 6, 4, 1>
+*/
+template <int... Taps>
+struct Kernel
+{
+	static_assert(sizeof...(Taps) % 2 == 1, "a kernel needs an odd number of taps");
+
+	static const bool compileTime = true;
+
+	int getSize() const { return (int)sizeof...(Taps); }
+	int getRadius() const { return (int)sizeof...(Taps) / 2; }
+
+	/**
+	* Description: Applies the kernel to p[0] through p[size-1]
+	*/
+	template <typename T>
+	typename ConvolutionTypes<T>::Accumulator apply(const T * p) const { return KernelTaps<0, Taps...>::apply(p); }
+
+	/**
+	* Description: Applies the kernel to column 'column' of rows[0] through rows[size-1]
+	*/
+	template <typename T>
+	typename ConvolutionTypes<T>::Accumulator applyRows(const T * const * rows, int column) const { return KernelTaps<0, Taps...>::applyRows(rows, column); }
+
+	/**
+	* Description: Applies the kernel to p[first] through p[first+size-1], the indices outside
+	* [0, columns) resolved by the border policy
+	*/
+	template <typename Border, typename T>
+	typename ConvolutionTypes<T>::Accumulator applyBorder(const T * p, int first, int columns) const { return KernelTaps<0, Taps...>::template applyBorder<Border>(p, first, columns); }
+};
+
+/**
+* Common kernels: the central difference of Dx/Dy, and the smoothing halves of the
+* separable Sobel and Scharr operators and of the 5-tap binomial Gaussian
+*/
+typedef Kernel<-1, 0, 1> CentralDifferenceKernel;
+typedef Kernel<1, 2, 1> SobelSmoothKernel;
+typedef Kernel<3, 10, 3> ScharrSmoothKernel;
+typedef Kernel<1, 4, 6, 4, 1> Gaussian5Kernel;
+
+///////////////////////////////////////
+//RUNTIME KERNEL
+///////////////////////////////////////
+/**
+* Kernel whose taps are only known at runtime. Same interface as Kernel<...>,
+* but every pixel loops over the taps, so it is slower than a compile-time kernel.
+*/
+class RuntimeKernel
+{
+public:
+	static const bool compileTime = false;
+
+	/**
+	* Constructor
+	* Throws: std::invalid_argument if the number of taps is not odd
+	* @params taps, the kernel coefficients, taps[radius] is the center
+	*/
+	RuntimeKernel(const std::vector<int> & taps) : taps(taps)
+	{
+		if(taps.size() % 2 != 1)
+		{
+			throw std::invalid_argument("a kernel needs an odd number of taps");
+		}
+	}
+
+	int getSize() const { return (int)taps.size(); }
+	int getRadius() const { return (int)taps.size() / 2; }
+
+	template <typename T>
+	typename ConvolutionTypes<T>::Accumulator apply(const T * p) const
+	{
+		typename ConvolutionTypes<T>::Accumulator sum = 0;
+		for(size_t k = 0; k < taps.size(); k++)
+		{
+			sum += taps[k] * (typename ConvolutionTypes<T>::Accumulator)p[k];
+		}
+		return sum;
+	}
+
+	template <typename T>
+	typename ConvolutionTypes<T>::Accumulator applyRows(const T * const * rows, int column) const
+	{
+		typename ConvolutionTypes<T>::Accumulator sum = 0;
+		for(size_t k = 0; k < taps.size(); k++)
+		{
+			sum += taps[k] * (typename ConvolutionTypes<T>::Accumulator)rows[k][column];
+		}
+		return sum;
+	}
+
+	template <typename Border, typename T>
+	typename ConvolutionTypes<T>::Accumulator applyBorder(const T * p, int first, int columns) const
+	{
+		typename ConvolutionTypes<T>::Accumulator sum = 0;
+		for(int k = 0; k < (int)taps.size(); k++)
+		{
+			const int column = Border::index(first + k, columns);
+			sum += (column < 0) ? 0 : taps[k] * (typename ConvolutionTypes<T>::Accumulator)p[column];
+		}
+		return sum;
+	}
+
+private:
+	std::vector<int> taps;
+};
+
+///////////////////////////////////////
+//ROW LOOPS
+///////////////////////////////////////
+/**
+* Number of pixels per block of the interior loops. The inner loop of a block has a
+* constant trip count, which lets the compiler vectorize it completely at -O2.
+*/
+const int KERNEL_BLOCK = 32;
+
+/**
+* Description: Applies a kernel horizontally to the pixels [first, end) of one row
+* Preconditions: src[first - radius] through src[end - 1 + radius] are readable
+* @params kernel, the kernel
+* @params src, pointer to column 0 of the source row
+* @params dst, pointer to column 0 of the destination row
+* @params first, the first column to compute
+* @params end, one past the last column to compute
+* @returns NONE
+*/
+template <typename K, typename TIn, typename TOut>
+inline void kernelRowSpan(const K & kernel, const TIn * src, TOut * dst, int first, int end)
+{
+	const int radius = kernel.getRadius();
+	int j = first;
+	for(; j + KERNEL_BLOCK <= end; j += KERNEL_BLOCK)
+	{
+		//the block is computed into a local array, which cannot overlap the source,
+		//so the compiler vectorizes it without runtime alias checks
+		TOut block[KERNEL_BLOCK];
+		for(int b = 0; b < KERNEL_BLOCK; b++)
+		{
+			block[b] = (TOut)kernel.apply(src + j + b - radius);
+		}
+		std::memcpy(dst + j, block, sizeof(block));
+	}
+	for(; j < end; j++)
+	{
+		dst[j] = (TOut)kernel.apply(src + j - radius);
+	}
+}
+
+/**
+* Description: Applies a kernel vertically to the columns [0, columns) of one row
+* Preconditions: rows[0] through rows[size-1] point to at least 'columns' elements
+* @params kernel, the kernel
+* @params rows, the source rows under the taps, top to bottom
+* @params dst, pointer to column 0 of the destination row
+* @params columns, the column size of the matrix
+* @returns NONE
+*/
+template <typename K, typename TIn, typename TOut>
+inline void kernelColumnSpan(const K & kernel, const TIn * const * rows, TOut * dst, int columns)
+{
+	int j = 0;
+	for(; j + KERNEL_BLOCK <= columns; j += KERNEL_BLOCK)
+	{
+		TOut block[KERNEL_BLOCK];
+		for(int b = 0; b < KERNEL_BLOCK; b++)
+		{
+			block[b] = (TOut)kernel.applyRows(rows, j + b);
+		}
+		std::memcpy(dst + j, block, sizeof(block));
+	}
+	for(; j < columns; j++)
+	{
+		dst[j] = (TOut)kernel.applyRows(rows, j);
+	}
+}
+
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+/**
+* AVX2 builds of the span loops, the same code compiled for 256 bit vectors
+*/
+template <typename K, typename TIn, typename TOut>
+__attribute__((target("avx2")))
+void kernelRowSpanAvx2(const K & kernel, const TIn * src, TOut * dst, int first, int end)
+{
+	kernelRowSpan(kernel, src, dst, first, end);
+}
+
+template <typename K, typename TIn, typename TOut>
+__attribute__((target("avx2")))
+void kernelColumnSpanAvx2(const K & kernel, const TIn * const * rows, TOut * dst, int columns)
+{
+	kernelColumnSpan(kernel, rows, dst, columns);
+}
+#endif
+
+/**
+* Description: Runs the AVX2 or the default build of kernelRowSpan()
+*/
+template <typename K, typename TIn, typename TOut>
+inline void kernelRowSpanAuto(const K & kernel, const TIn * src, TOut * dst, int first, int end, bool avx2)
+{
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+	if(avx2)
+	{
+		kernelRowSpanAvx2(kernel, src, dst, first, end);
+	}
+	else
+#endif
+	{
+		(void)avx2;
+		kernelRowSpan(kernel, src, dst, first, end);
+	}
+}
+
+/**
+* Description: Applies a kernel horizontally to one row
+* Implementation: The interior columns [radius, columns-radius) run the span loop,
+* only the 'radius' columns at each end go through the border policy. With ValidBorder
+* there are no border columns: dst[0] is the result for column 'radius' of src.
+* @params kernel, the kernel
+* @params src, pointer to column 0 of the source row
+* @params dst, pointer to column 0 of the destination row
+* @params columns, the column size of the source row
+* @params avx2, true to run the AVX2 build of the span loop
+* @returns NONE
+*/
+template <typename Border, typename K, typename TIn, typename TOut>
+void kernelRow(const K & kernel, const TIn * src, TOut * dst, int columns, bool avx2)
+{
+	const int radius = kernel.getRadius();
+	if(Border::valid)
+	{
+		//shifting src by the radius makes column j of dst the kernel centered on column j+radius
+		kernelRowSpanAuto(kernel, src + radius, dst, 0, columns - 2*radius, avx2);
+		return;
+	}
+	const int left = std::min(radius, columns);
+	const int right = std::max(left, columns - radius);
+
+	for(int j = 0; j < left; j++)
+	{
+		dst[j] = (TOut)kernel.template applyBorder<Border>(src, j - radius, columns);
+	}
+	kernelRowSpanAuto(kernel, src, dst, left, right, avx2);
+	for(int j = right; j < columns; j++)
+	{
+		dst[j] = (TOut)kernel.template applyBorder<Border>(src, j - radius, columns);
+	}
+}
+
+/**
+* Description: Applies a kernel vertically to one row
+* @params kernel, the kernel
+* @params rows, the source rows under the taps, top to bottom, border rows already resolved
+* @params dst, pointer to column 0 of the destination row
+* @params columns, the column size of the matrix
+* @params avx2, true to run the AVX2 build of the span loop
+* @returns NONE
+*/
+template <typename K, typename TIn, typename TOut>
+void kernelColumn(const K & kernel, const TIn * const * rows, TOut * dst, int columns, bool avx2)
+{
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+	if(avx2)
+	{
+		kernelColumnSpanAvx2(kernel, rows, dst, columns);
+		return;
+	}
+#endif
+	(void)avx2;
+	kernelColumnSpan(kernel, rows, dst, columns);
+}
+
+/**
+* Description: Points rows[k] at the source row under tap k for output row 'row'
+* Implementation: The border policy picks the rows above the first and below the last row,
+* a tap that reads zeros gets a row of zeros. With ValidBorder output row 'row' is
+* centered on source row row+radius.
+* @params M, the source matrix
+* @params row, the output row
+* @params radius, the radius of the kernel
+* @params zeros, a row of at least M.getColumns() zeros
+* @params rows, receives 2*radius+1 row pointers
+* @returns NONE
+*/
+template <typename Border, typename T>
+void kernelSourceRows(MatrixView<T> M, int row, int radius, const T * zeros, std::vector<const T *> & rows)
+{
+	const int count = M.getRows();
+	const int first = Border::valid ? row : row - radius;
+	for(int k = 0; k <= 2*radius; k++)
+	{
+		const int source = Border::index(first + k, count);
+		rows[k] = (source < 0) ? zeros : M.getRow(source);
+	}
+}
+
+/**
+* Description: Returns the row or column size of the result along the convolved axis
+* @params size, the row or column size of M
+* @params radius, the radius of the kernel
+* @returns int, size, or size - 2*radius (at least 0) for ValidBorder
+*/
+template <typename Border>
+int kernelOutputSize(int size, int radius)
+{
+	return Border::valid ? std::max(0, size - 2*radius) : size;
+}
+
+/**
+* Description: True if the compile-time span loops should use their AVX2 build.
+* The runtime kernel's tap loop does not vectorize, so it always takes the default build.
+*/
+template <typename K>
+bool kernelUsesAvx2(const K &)
+{
+	return K::compileTime && simdLevel() == SIMD_AVX2;
+}
+
+///////////////////////////////////////
+//SEPARABLE CONVOLUTION
+///////////////////////////////////////
+/**
+* Description: Convolves every row of M with a kernel (the horizontal axis)
+* Preconditions: D has the row size of M and the column size
+* kernelOutputSize<Border>(M.getColumns(), radius)
+* Postconditions: D holds the horizontal convolution of M
+* @params M, the source matrix
+* @params D, receives the result, normally of type ConvolutionTypes<TIn>::Output
+* @params kernel, the kernel, Kernel<...> or RuntimeKernel
+* @return NONE
+*/
+template <typename K, typename Border = WrapBorder, typename TIn, typename TOut>
+void convolveHorizontal(MatrixView<TIn> M, MatrixView<TOut> D, const K & kernel = K())
+{
+	const bool avx2 = kernelUsesAvx2(kernel);
+	if(kernelOutputSize<Border>(M.getColumns(), kernel.getRadius()) == 0)
+	{
+		return;
+	}
+	for(int i = 0; i < M.getRows(); i++)
+	{
+		kernelRow<Border>(kernel, M.getRow(i), D.getRow(i), M.getColumns(), avx2);
+	}
+}
+
+/**
+* Description: Convolves every column of M with a kernel (the vertical axis)
+* Preconditions: D has the column size of M and the row size
+* kernelOutputSize<Border>(M.getRows(), radius)
+* Postconditions: D holds the vertical convolution of M
+* @params M, the source matrix
+* @params D, receives the result, normally of type ConvolutionTypes<TIn>::Output
+* @params kernel, the kernel, Kernel<...> or RuntimeKernel
+* @return NONE
+*/
+template <typename K, typename Border = WrapBorder, typename TIn, typename TOut>
+void convolveVertical(MatrixView<TIn> M, MatrixView<TOut> D, const K & kernel = K())
+{
+	const bool avx2 = kernelUsesAvx2(kernel);
+	const int outputRows = kernelOutputSize<Border>(M.getRows(), kernel.getRadius());
+	const std::vector<TIn> zeros(M.getColumns(), 0);
+	std::vector<const TIn *> rows(kernel.getSize());
+	for(int i = 0; i < outputRows; i++)
+	{
+		kernelSourceRows<Border>(M, i, kernel.getRadius(), &zeros[0], rows);
+		kernelColumn(kernel, &rows[0], D.getRow(i), M.getColumns(), avx2);
+	}
+}
+
+/**
+* Description: Convolves M with the 2D kernel vertical x horizontal, e.g. the Sobel x
+* operator is convolveSeparable<CentralDifferenceKernel, SobelSmoothKernel>()
+* Implementation: Every output row is computed on its own: the vertical kernel is applied
+* to the rows around it into one row of accumulators, then the horizontal kernel to that
+* row, so the intermediate result is a single row that stays in the L1 cache.
+* Preconditions: D has the size of M along both axes as given by kernelOutputSize<Border>(),
+* the sums fit in TOut, e.g. the 5x5 Gaussian of unsigned chars (up to 256 * 255) needs
+* an int D rather than the short int of ConvolutionTypes<unsigned char>::Output
+* Postconditions: D holds the 2D convolution of M
+* @params M, the source matrix
+* @params D, receives the result
+* @params horizontal, the kernel along the rows
+* @params vertical, the kernel along the columns
+* @return NONE
+*/
+template <typename H, typename V, typename Border = WrapBorder, typename TIn, typename TOut>
+void convolveSeparable(MatrixView<TIn> M, MatrixView<TOut> D, const H & horizontal = H(), const V & vertical = V())
+{
+	typedef typename ConvolutionTypes<TIn>::Accumulator Sum;
+	const int columns = M.getColumns();
+	const int outputRows = kernelOutputSize<Border>(M.getRows(), vertical.getRadius());
+	if(kernelOutputSize<Border>(columns, horizontal.getRadius()) == 0)
+	{
+		return;
+	}
+	const bool avx2H = kernelUsesAvx2(horizontal);
+	const bool avx2V = kernelUsesAvx2(vertical);
+	const std::vector<TIn> zeros(columns, 0);
+	std::vector<const TIn *> rows(vertical.getSize());
+	std::vector<Sum> line(columns);
+
+	for(int i = 0; i < outputRows; i++)
+	{
+		kernelSourceRows<Border>(M, i, vertical.getRadius(), &zeros[0], rows);
+		kernelColumn(vertical, &rows[0], &line[0], columns, avx2V);
+		kernelRow<Border>(horizontal, &line[0], D.getRow(i), columns, avx2H);
+	}
+}
+
+#endif
@@ -1,6 +1,33 @@
+#ifndef MATRIX_CPP
+#define MATRIX_CPP
+
 #include <iostream>
 #include <limits>
 #include <time.h>
+#include <vector>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ThreadPool.cpp"
+#include "MatrixFile.cpp"
+#include "MatrixArena.cpp"
+#include "MatrixView.cpp"
+#include "MatrixText.cpp"
+#include "MatrixRandom.cpp"
+#include "DirtyRegions.cpp"
+
+/**
+* How a new Matrix is initialized: FILL_RANDOM fills it with random values seeded from
+* the clock, FILL_NONE leaves the memory as allocated, for outputs such as Dx and Dy that
+* are overwritten anyway or inputs filled later with a reproducible seed
+*/
+enum MatrixFill
+{
+	FILL_RANDOM,
+	FILL_NONE
+};
 
 template <typename T> 
 class Matrix { 
@@ -9,18 +36,49 @@ public:
 	//CONSTRUCTORS AND DESTRUCTORS
 	///////////////////////////////////////
 	Matrix(int rows, int columns);
+	Matrix(int rows, int columns, const MatrixLayout & layout);
+	Matrix(int rows, int columns, const MatrixLayout & layout, MatrixFill fill);
+	Matrix(const std::string & path);
+	Matrix(Matrix<T> && other);
+	Matrix<T> & operator=(Matrix<T> && other);
 	~Matrix();
 
+	//copying would free the matrix array twice, use views to share it instead
+	Matrix(const Matrix<T> &) = delete;
+	Matrix<T> & operator=(const Matrix<T> &) = delete;
+
 	///////////////////////////////////////
 	//GETTERS
 	///////////////////////////////////////
 	T * getMatrix(); 
+	int getRows() const;
+	int getColumns() const;
+	int getStride() const;
+	int getGhost() const;
+
+	///////////////////////////////////////
+	//VIEWS
+	///////////////////////////////////////
+	MatrixView<T> view() const;
+	MatrixView<T> view(int firstRow, int firstColumn, int rows, int columns) const;
+	operator MatrixView<T>() const;
 
 	///////////////////////////////////////
 	//MATRIX ACCESSORS AND MUTATORS
 	///////////////////////////////////////
 	T get(int row, int column);
 	void put(int row, int column, T data);
+	void refreshGhosts();
+	void fillRand(uint64_t seed);
+	void fillRand(uint64_t seed, ThreadPool & pool);
+
+	///////////////////////////////////////
+	//DIRTY REGIONS
+	///////////////////////////////////////
+	void markDirty(int row, int column, int rows, int columns);
+	const DirtyRegions & getDirtyRegions() const;
+	void clearDirty();
+	void setDirtyTracking(bool enabled);
 
 	///////////////////////////////////////
 	//EDGE-CHECK CONDITIONS
@@ -35,12 +93,19 @@ public:
 	///////////////////////////////////////
 	T getMin() const;
 	T getMax() const;
+	T getMin(ThreadPool & pool) const;
+	T getMax(ThreadPool & pool) const;
 
 	///////////////////////////////////////
 	//MATRIX VISUALIZATION
 	///////////////////////////////////////
 	void printMatrix() const;
 
+	///////////////////////////////////////
+	//MATRIX FILE I/O
+	///////////////////////////////////////
+	void save(const std::string & path) const;
+
 private:
 	///////////////////////////////////////
 	//PRIVATE DATA VARIABLES
@@ -49,6 +114,7 @@ private:
 	* input matrix that represents an "image" 
 	* dynamically allocated at runtime from userinput
 	* to perform convolution operation on.
+	* Points at the element in row 0, column 0; row i starts at matrix + i*stride
 	*/
 	T * matrix;
 
@@ -62,11 +128,50 @@ private:
 	*/
 	int column;
 
+	/**
+	* The distance in elements from the start of one row to the start of the next,
+	* equal to column unless the rows are padded or have ghost cells
+	*/
+	int stride;
+
+	/**
+	* The width of the ring of ghost cells around the matrix, 0 or 1
+	*/
+	int ghost;
+
+	/**
+	* The aligned block holding the matrix array including padding and ghost cells,
+	* its size in bytes, and the arena it came from (nullptr if allocated directly)
+	*/
+	void * storage;
+	size_t storageBytes;
+	MatrixArena * arena;
+
+	/**
+	* The memory-mapped matrix file the matrix array points into,
+	* nullptr when the matrix array is in 'storage'
+	*/
+	void * mapping;
+
+	/**
+	* The size of the mapping in bytes
+	*/
+	size_t mappingBytes;
+
+	/**
+	* The rectangles changed since the last clearDirty(), for the incremental convolution
+	* of IncrementalConvolution.cpp, and whether put() and fillRand() add to them
+	*/
+	DirtyRegions dirty;
+	bool trackPuts = false;
+
 	/////////////////////////////////////////
 	//PRIVATE HELPER METHODS
 	/////////////////////////////////////////
-	int indexMap(int row, int column); 
-	void fillRand();
+	long indexMap(int row, int column); 
+	void allocate(int rows, int columns, const MatrixLayout & layout);
+	void release();
+	void takeFrom(Matrix<T> & other);
 };
 
 ///////////////////////////////////////
@@ -75,7 +180,7 @@ private:
 /**
 * Constructor
 * Description: Initializes the matrix with the given user input
-* Implementation: Dynamically allocates an array with the given Data 
+* Implementation: Dynamically allocates a 64 byte aligned array with the given Data 
 * Type and initializes the given row and column data variables
 * Preconditions: NONE
 * Postconditions: Initializes an Array of size row * column 
@@ -85,30 +190,184 @@ private:
 template <typename T> 
 Matrix<T>::Matrix(int rows, int columns)
 {
-	//initialize the row and column variables
-	this->row = rows;
-	this->column = columns;
+	allocate(rows, columns, MatrixLayout());
 
-	//dynamically allocate the internal array of size = row*column
-	int matrixSize = row*column;
-	this->matrix = new T[matrixSize];
+	//populate the matrix with random values between MIN_VALUE and MAX_VALUE of given data-type
+	fillRand((uint64_t)time(NULL));
+}
+
+/**
+* Constructor
+* Description: Initializes the matrix with the given user input and storage layout
+* Implementation: Allocates the array as described by the layout (see MatrixArena.cpp):
+* optionally padded rows, optionally a ring of ghost cells, optionally from an arena
+* Preconditions: NONE
+* Postconditions: Initializes an Array of size row * column, ghost cells hold the wrap-around values
+* @params rows, the number of rows of the given matrix
+* @params columns, the number of columns of the given matrix 
+* @params layout, the storage layout
+*/
+template <typename T> 
+Matrix<T>::Matrix(int rows, int columns, const MatrixLayout & layout)
+{
+	allocate(rows, columns, layout);
 
 	//populate the matrix with random values between MIN_VALUE and MAX_VALUE of given data-type
-	fillRand();
+	fillRand((uint64_t)time(NULL));
+}
+
+/**
+* Constructor
+* Description: Initializes the matrix with the given user input and storage layout,
+* filled with random values or not filled at all
+* Implementation: Allocates the array as described by the layout, then fills it only
+* for FILL_RANDOM. With FILL_NONE the elements and ghost cells are indeterminate until
+* they are written, and the pages of a large matrix are not even touched yet.
+* Preconditions: NONE
+* Postconditions: Initializes an Array of size row * column
+* @params rows, the number of rows of the given matrix
+* @params columns, the number of columns of the given matrix 
+* @params layout, the storage layout
+* @params fill, FILL_RANDOM or FILL_NONE
+*/
+template <typename T> 
+Matrix<T>::Matrix(int rows, int columns, const MatrixLayout & layout, MatrixFill fill)
+{
+	allocate(rows, columns, layout);
+
+	if(fill == FILL_RANDOM)
+	{
+		fillRand((uint64_t)time(NULL));
+	}
+}
+
+/**
+* Constructor
+* Description: Initializes the matrix from a matrix file (see MatrixFile.cpp)
+* Implementation: Maps the file into memory with mmap and points the matrix array at
+* the elements after the header, so no element is read or copied up front. The mapping
+* is private: put() changes the matrix in memory but never the file.
+* Throws: std::runtime_error if the file cannot be opened or mapped, is not a matrix file,
+* or holds another element type
+* Preconditions: NONE
+* Postconditions: The matrix array shows the elements of the file
+* @params path, the path of the matrix file
+*/
+template <typename T> 
+Matrix<T>::Matrix(const std::string & path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		throw std::runtime_error(path + ": cannot open matrix file");
+	}
+	struct stat status;
+	if(fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(MatrixFileHeader))
+	{
+		close(fd);
+		throw std::runtime_error(path + ": not a matrix file");
+	}
+
+	//the descriptor is not needed once the mapping exists
+	void * map = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED)
+	{
+		throw std::runtime_error(path + ": cannot map matrix file");
+	}
+
+	const MatrixFileHeader & header = *(const MatrixFileHeader *)map;
+	try
+	{
+		checkMatrixFileHeader(header, status.st_size, MatrixDType<T>::code, sizeof(T), path);
+	}
+	catch(...)
+	{
+		munmap(map, status.st_size);
+		throw;
+	}
+
+	this->row = (int)header.rows;
+	this->column = (int)header.columns;
+	this->stride = (int)header.stride;
+	this->ghost = 0;
+	this->storage = nullptr;
+	this->storageBytes = 0;
+	this->arena = nullptr;
+	this->mapping = map;
+	this->mappingBytes = status.st_size;
+	this->matrix = (T *)((char *)map + header.headerBytes);
+}
+
+/**
+* Move Constructor
+* Description: Takes over the matrix array of another matrix without copying it
+* Preconditions: NONE
+* Postconditions: 'other' is an empty 0 x 0 matrix that owns nothing
+* @params other, the matrix to move from
+*/
+template <typename T> 
+Matrix<T>::Matrix(Matrix<T> && other)
+{
+	takeFrom(other);
+}
+
+/**
+* Move Assignment
+* Description: Frees this matrix array and takes over the matrix array of another matrix
+* Preconditions: NONE
+* Postconditions: 'other' is an empty 0 x 0 matrix that owns nothing
+* @params other, the matrix to move from
+* @returns Matrix<T>&, this matrix
+*/
+template <typename T> 
+Matrix<T> & Matrix<T>::operator=(Matrix<T> && other)
+{
+	if(this != &other)
+	{
+		release();
+		takeFrom(other);
+	}
+	return *this;
 }
 
 /**
 * Destructor
 * Description: Deletes the matrix object
-* Implementation: Frees the memory from the heap the data variable 'matrix pointer points to'
+* Implementation: Frees the memory from the heap the data variable 'matrix pointer points to',
+* gives it back to the arena it came from, or unmaps the matrix file the matrix was loaded from
 * Preconditions: NONE
 * Postconditions: Deallocates the matrix array from the Heap 
 */
 template <typename T> 
 Matrix<T>::~Matrix()
 {
-	//deallocate the matrix pointer from memory
-	delete this->matrix;
+	release();
+}
+
+/**
+* Description: Frees the matrix array, whichever way it was obtained
+* Preconditions: NONE
+* Postconditions: the storage or mapping of the matrix is released
+* @params NONE
+* @returns NONE
+*/
+template <typename T> 
+void Matrix<T>::release()
+{
+	if(this->mapping != nullptr)
+	{
+		munmap(this->mapping, this->mappingBytes);
+	}
+	else if(this->arena != nullptr)
+	{
+		this->arena->release(this->storage, this->storageBytes);
+	}
+	else
+	{
+		//deallocate the matrix storage from memory
+		freeAligned(this->storage);
+	}
 }
 
 ///////////////////////////////////////
@@ -128,6 +387,106 @@ T * Matrix<T>::getMatrix()
 	return this->matrix;
 }
 
+/**
+* Description: Returns the number of rows of the matrix.
+* Implementation: Returns the row data variable.
+* Preconditions: NONE
+* Postconditions: NONE
+* @params NONE
+* @returns int, the row size of the matrix
+*/
+template <typename T> 
+int Matrix<T>::getRows() const
+{
+	return this->row;
+}
+
+/**
+* Description: Returns the number of columns of the matrix.
+* Implementation: Returns the column data variable.
+* Preconditions: NONE
+* Postconditions: NONE
+* @params NONE
+* @returns int, the column size of the matrix
+*/
+template <typename T> 
+int Matrix<T>::getColumns() const
+{
+	return this->column;
+}
+
+/**
+* Description: Returns the distance in elements between the starts of two consecutive rows.
+* Row i of the matrix array starts at getMatrix() + i*getStride().
+* Preconditions: NONE
+* Postconditions: NONE
+* @params NONE
+* @returns int, the row stride of the matrix
+*/
+template <typename T> 
+int Matrix<T>::getStride() const
+{
+	return this->stride;
+}
+
+/**
+* Description: Returns the width of the ring of ghost cells around the matrix.
+* With a ghost width of 1, row -1, row getRows(), column -1 and column getColumns()
+* can be read through getMatrix() and hold the wrap-around values after refreshGhosts().
+* Preconditions: NONE
+* Postconditions: NONE
+* @params NONE
+* @returns int, 0 or 1
+*/
+template <typename T> 
+int Matrix<T>::getGhost() const
+{
+	return this->ghost;
+}
+
+///////////////////////////////////////
+//VIEWS
+///////////////////////////////////////
+/**
+* Description: Returns a non-owning view of the whole matrix
+* Preconditions: NONE
+* Postconditions: NONE
+* @params NONE
+* @returns MatrixView<T>, the view, valid as long as the matrix is
+*/
+template <typename T> 
+MatrixView<T> Matrix<T>::view() const
+{
+	return MatrixView<T>(this->matrix, this->row, this->column, this->stride);
+}
+
+/**
+* Description: Returns a non-owning view of a rectangular region (ROI) of the matrix
+* Preconditions: the region lies inside the matrix
+* Postconditions: NONE
+* @params firstRow, the row where the region starts
+* @params firstColumn, the column where the region starts
+* @params rows, the row size of the region
+* @params columns, the column size of the region
+* @returns MatrixView<T>, the view of the region, valid as long as the matrix is
+*/
+template <typename T> 
+MatrixView<T> Matrix<T>::view(int firstRow, int firstColumn, int rows, int columns) const
+{
+	return view().subView(firstRow, firstColumn, rows, columns);
+}
+
+/**
+* Description: Converts the matrix to a view of itself, so a Matrix can be passed
+* to every function taking a MatrixView
+* @returns MatrixView<T>, the view of the whole matrix
+*/
+template <typename T> 
+Matrix<T>::operator MatrixView<T>() const
+{
+	return view();
+}
+
 ///////////////////////////////////////
 //MATRIX ACCESSORS AND MUTATORS
 ///////////////////////////////////////
@@ -145,10 +504,158 @@ template <typename T>
 void Matrix<T>::put(int row, int column, T data) 
 {
 	//calculate the mapped index
-	int mappedIndex = indexMap(row, column);
+	long mappedIndex = indexMap(row, column);
 
 	//place the data variable in matrix[mappedIndex]
 	this->matrix[mappedIndex] = data;
+
+	if(this->trackPuts)
+	{
+		this->dirty.add(row, column, 1, 1);
+	}
+}
+
+/*
+* Description: copies the wrap-around values into the ghost cells around the matrix
+* Implementation: column -1 of every row gets the last column and column 'column' the first
+* column, then row -1 (including its ghost cells) gets the last row and row 'row' the first row
+* @Preconditions: NONE
+* @Postcondtions: The ghost cells match the matrix, does nothing if the matrix has no ghost cells
+* @params: NONE
+* @returns: None
+*/
+template <typename T> 
+void Matrix<T>::refreshGhosts()
+{
+	if(this->ghost == 0)
+	{
+		return;
+	}
+	for(int i = 0; i < row; i++)
+	{
+		T * line = matrix + (long)i*stride;
+		line[-1] = line[column-1];
+		line[column] = line[0];
+	}
+	const size_t lineBytes = (column + 2)*sizeof(T);
+	std::memcpy(matrix - stride - 1, matrix + (long)(row-1)*stride - 1, lineBytes);
+	std::memcpy(matrix + (long)row*stride - 1, matrix - 1, lineBytes);
+}
+
+/**
+* Description: Populates the matrix with random values of the data type
+* Implementation: Fills every row with the counter-based generator of MatrixRandom.cpp.
+* Integer types get every value of the type with the same probability, from
+* numeric_limits<T>::min() to numeric_limits<T>::max() inclusive.
+* @Preconditions: NONE
+* @Postconditions: matrix array will now be populated with random values, the same
+* values for the same seed and matrix size
+* @params seed, the seed of the random values
+* @return NONE
+*/
+template <typename T> 
+void Matrix<T>::fillRand(uint64_t seed)
+{
+	const uint64_t mixedSeed = mixRandomBits(seed);
+	for(int i = 0; i < row; i++)
+	{
+		fillRandomRow(matrix + (long)i*stride, column, mixedSeed, i);
+ 	}
+
+	//the ghost cells mirror the new values
+	refreshGhosts();
+
+	if(this->trackPuts)
+	{
+		this->dirty.add(0, 0, row, column);
+	}
+}
+
+/**
+* Description: Populates the matrix with random values using every thread of the pool
+* Implementation: Every thread fills one band of rows. A row's values only depend on
+* the seed and the row index, so the result is the same as fillRand(seed) for any
+* number of threads, and every thread first touches the pages of its own rows.
+* @Preconditions: NONE
+* @Postconditions: matrix array will now be populated with the values of fillRand(seed)
+* @params seed, the seed of the random values
+* @params pool, the thread pool to run the bands on
+* @return NONE
+*/
+template <typename T> 
+void Matrix<T>::fillRand(uint64_t seed, ThreadPool & pool)
+{
+	const uint64_t mixedSeed = mixRandomBits(seed);
+	const int parts = std::max(1, std::min(row, pool.getThreads()));
+
+	pool.run(parts, [&](int part)
+	{
+		const int first = (int)((long)row*part / parts);
+		const int end = (int)((long)row*(part+1) / parts);
+		for(int i = first; i < end; i++)
+		{
+			fillRandomRow(matrix + (long)i*stride, column, mixedSeed, i);
+		}
+	});
+
+	//the ghost cells mirror the new values
+	refreshGhosts();
+
+	if(this->trackPuts)
+	{
+		this->dirty.add(0, 0, row, column);
+	}
+}
+
+///////////////////////////////////////
+//DIRTY REGIONS
+///////////////////////////////////////
+/**
+* Description: Marks a rectangle as changed, for values written through getMatrix() or
+* a view where put() cannot see them
+* Implementation: Clips the rectangle to the matrix and adds it to the dirty regions
+* @Preconditions: NONE
+* @Postconditions: getDirtyRegions() covers the rectangle
+* @params row, column, the top-left corner
+* @params rows, columns, the size of the rectangle
+* @return NONE
+*/
+template <typename T> 
+void Matrix<T>::markDirty(int row, int column, int rows, int columns)
+{
+	const int firstRow = std::max(row, 0);
+	const int firstColumn = std::max(column, 0);
+	const int endRow = std::min(row + rows, this->row);
+	const int endColumn = std::min(column + columns, this->column);
+	this->dirty.add(firstRow, firstColumn, endRow - firstRow, endColumn - firstColumn);
+}
+
+template <typename T> 
+const DirtyRegions & Matrix<T>::getDirtyRegions() const
+{
+	return this->dirty;
+}
+
+/**
+* Description: Forgets the dirty regions, once the results are up to date with the matrix
+* @return NONE
+*/
+template <typename T> 
+void Matrix<T>::clearDirty()
+{
+	this->dirty.clear();
+}
+
+/**
+* Description: Makes put() and fillRand() mark what they change, off by default so
+* put() stays a plain store
+* @params enabled, true to track the changes
+* @return NONE
+*/
+template <typename T> 
+void Matrix<T>::setDirtyTracking(bool enabled)
+{
+	this->trackPuts = enabled;
 }
 
 /*
@@ -165,7 +672,7 @@ template <typename T>
 T Matrix<T>::get(int row, int column)
 {
 	//calculate the mapped index
-	int mappedIndex = indexMap(row, column);
+	long mappedIndex = indexMap(row, column);
 
 	//return the data variable in matrix[mappedIndex]
 	return matrix[mappedIndex];
@@ -272,11 +779,15 @@ T Matrix<T>::getMin() const
 	T lowestFoundSoFar = std::numeric_limits<T>::max();
 
 	//loop through the matrix array and return the lowest value
-	for(int i = 0; i < row*column; i++)
+	for(int i = 0; i < row; i++)
 	{
-		//check to see which value is minimum
-		//our stored value or the value in the specified index in the matrix
-		lowestFoundSoFar = std::min(lowestFoundSoFar, matrix[i]);
+		const T * line = matrix + (long)i*stride;
+		for(int j = 0; j < column; j++)
+		{
+			//check to see which value is minimum
+			//our stored value or the value in the specified index in the matrix
+			lowestFoundSoFar = std::min(lowestFoundSoFar, line[j]);
+		}
 	}
 	return lowestFoundSoFar;
 }
@@ -293,33 +804,67 @@ T Matrix<T>::getMin() const
 template <typename T> 
 T Matrix<T>::getMax() const
 {
-	T greatestFoundSoFar = std::numeric_limits<T>::min();
+	T greatestFoundSoFar = std::numeric_limits<T>::lowest();
 
 	//loop through the matrix array and return the greatest value
-	for(int i = 0; i < row*column; i++)
+	for(int i = 0; i < row; i++)
 	{
-		//check to see which value is greater
-		//our stored value or the value in the specified index in the matrix
-		greatestFoundSoFar = std::max(greatestFoundSoFar, matrix[i]);
+		const T * line = matrix + (long)i*stride;
+		for(int j = 0; j < column; j++)
+		{
+			//check to see which value is greater
+			//our stored value or the value in the specified index in the matrix
+			greatestFoundSoFar = std::max(greatestFoundSoFar, line[j]);
+		}
 	}
 	return greatestFoundSoFar;
 }
 
+/**
+* Description: Returns the minimum value in the matrix using every thread of the pool.
+* Implementation: see MatrixView<T>::getMin(ThreadPool &), each thread
+* keeps its own "lowest found so far" over one band of rows
+* @Preconditions: NONE
+* @Postconditions: NONE
+* @params: pool, the thread pool to run the bands on
+* @returns: T, the lowest value in the matric array
+*/
+template <typename T> 
+T Matrix<T>::getMin(ThreadPool & pool) const
+{
+	return view().getMin(pool);
+}
+
+/**
+* Description: Returns the maximum value in the matrix using every thread of the pool.
+* Implementation: see MatrixView<T>::getMax(ThreadPool &), each thread
+* keeps its own "greatest found so far" over one band of rows
+* @Preconditions: NONE
+* @Postconditions: NONE
+* @params: pool, the thread pool to run the bands on
+* @returns: T, the greatest value in the matric array
+*/
+template <typename T> 
+T Matrix<T>::getMax(ThreadPool & pool) const
+{
+	return view().getMax(pool);
+}
+
 /////////////////////////////////////////
 //PRIVATE HELPER METHODS
 /////////////////////////////////////////
 /**
 * Description: converts the row and column input to the correct corresponding index in the matrix array
 * Implementation: To calculate the index of the corresponding row and column query, 
-* we use the formula "index = row*this->row + column"
+* we use the formula "index = row*this->stride + column"
 * @Preconditions: Needs instantiated matrix array
 * @Postcondtions: NONE
 * @params: int row, input row from user
 * @params: int column, input column from user
-* @returns: int, index mapped to the matrix array
+* @returns: long, index mapped to the matrix array
 */
 template <typename T> 
-int Matrix<T>::indexMap(int row, int column) 
+long Matrix<T>::indexMap(int row, int column) 
 {
 	try
 	{
@@ -341,38 +886,96 @@ int Matrix<T>::indexMap(int row, int column)
 	}
 
 	//return the mapped index from user row and column input
-	return (row*this->column) + column;
+	return ((long)row*this->stride) + column;
 }
 
 /**
-* Description: Populates the matrix with random values of the data type
-* Implementation: Initialize a seed random variable and loop through the
-* max values of that particular data type
-* @Preconditions: NONE
-* @Postconditions: matrix array will now be populated with random values
-* @params NONE
+* Description: Moves every data variable of another matrix into this one
+* Implementation: Copies the pointers and sizes, then leaves 'other' as an empty
+* matrix whose release() does nothing
+* @Preconditions: this matrix owns nothing
+* @Postconditions: this matrix owns what 'other' owned
+* @params other, the matrix to move from
 * @return NONE
 */
 template <typename T> 
-void Matrix<T>::fillRand()
+void Matrix<T>::takeFrom(Matrix<T> & other)
 {
-	//set a random seed
-	srand(time(NULL));
+	this->matrix = other.matrix;
+	this->row = other.row;
+	this->column = other.column;
+	this->stride = other.stride;
+	this->ghost = other.ghost;
+	this->storage = other.storage;
+	this->storageBytes = other.storageBytes;
+	this->arena = other.arena;
+	this->mapping = other.mapping;
+	this->mappingBytes = other.mappingBytes;
+	this->dirty = std::move(other.dirty);
+	this->trackPuts = other.trackPuts;
+
+	other.matrix = nullptr;
+	other.row = 0;
+	other.column = 0;
+	other.stride = 0;
+	other.ghost = 0;
+	other.storage = nullptr;
+	other.storageBytes = 0;
+	other.arena = nullptr;
+	other.mapping = nullptr;
+	other.mappingBytes = 0;
+	other.dirty.clear();
+	other.trackPuts = false;
+}
 
-	//populate the matrix with random values of the given type
-	for(int i = 0; i < row*column; i++)
+/**
+* Description: Allocates the matrix array as described by the layout
+* Implementation: Without padding or ghost cells the rows are packed (stride = columns).
+* Padded rows round the stride up to whole 64 byte cache lines. Ghost cells add a row
+* above and below and a cell left and right of every row; the left ghost cell sits at
+* the end of a full cache line of lead-in so column 0 of every row stays 64 byte aligned.
+* The block comes from the layout's arena, or from allocateAligned() without one.
+* @Preconditions: NONE
+* @Postconditions: matrix points at row 0, column 0 of a 64 byte aligned block
+* @params rows, the number of rows of the given matrix
+* @params columns, the number of columns of the given matrix 
+* @params layout, the storage layout
+* @return NONE
+*/
+template <typename T> 
+void Matrix<T>::allocate(int rows, int columns, const MatrixLayout & layout)
+{
+	//initialize the row and column variables
+	this->row = rows;
+	this->column = columns;
+	this->ghost = (layout.ghost > 0) ? 1 : 0;
+	this->arena = layout.arena;
+	this->mapping = nullptr;
+	this->mappingBytes = 0;
+
+	//lay out the rows
+	const int elementsPerLine = std::max<int>(1, MATRIX_ALIGNMENT / sizeof(T));
+	const int lead = ghost ? elementsPerLine : 0;
+	this->stride = lead + columns + ghost;
+	if(layout.padRows || ghost)
 	{
-		matrix[i] = rand() % std::numeric_limits<T>::max();
- 	}
-} 
+		this->stride = (stride + elementsPerLine - 1) / elementsPerLine * elementsPerLine;
+	}
+
+	//dynamically allocate the internal array including padding and ghost rows
+	this->storageBytes = (size_t)(rows + 2*ghost)*stride*sizeof(T);
+	this->storage = (arena != nullptr) ? arena->acquire(storageBytes) : allocateAligned(storageBytes);
+	this->matrix = (T *)storage + (long)ghost*stride + lead;
+}
 
 ///////////////////////////////////////
 //MATRIX VISUALIZATION
 ///////////////////////////////////////
 /**
 * Description: Prints to console the matrix in "Row x Column" form.
-* Implementation: Loops through the matrix array and prints each value in the index.
-* if the row length is reached, a newline is added to the console print.
+* Implementation: The values of a row are separated by spaces and every row ends with
+* a newline. The text is built in large buffers by writeMatrixText() (MatrixText.cpp)
+* and the console is flushed once at the end, not after every row.
 * Preconditions: NONE
 * Postconditions: NONE
 * @params NONE
@@ -381,16 +984,37 @@ void Matrix<T>::fillRand()
 template <typename T> 
 void Matrix<T>::printMatrix() const 
 {
-	for(int i = 0; i < row*column; i++)
-	{
-		if((i+1)%column == 0 && i!=0)//reached end of row length, 'print the value' and 'endline'
-		{
-			std::cout << +(matrix[i]) << std::endl;
-		}
-		else
-		{
-			std::cout << +(matrix[i]) << " ";
-		}
+	writeMatrixText(view(), std::cout);
+}
 
+///////////////////////////////////////
+//MATRIX FILE I/O
+///////////////////////////////////////
+/**
+* Description: Writes the matrix to a matrix file (see MatrixFile.cpp)
+* Implementation: Writes the 64 byte header followed by the rows without their padding
+* or ghost cells, the file can then be mapped back with the Matrix(path) constructor
+* Throws: std::runtime_error if the file cannot be written
+* Preconditions: NONE
+* Postconditions: The file at 'path' holds the matrix
+* @params path, the path of the matrix file, replaced if it exists
+* @returns NONE
+*/
+template <typename T> 
+void Matrix<T>::save(const std::string & path) const
+{
+	std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+	MatrixFileHeader header = makeMatrixFileHeader(MatrixDType<T>::code, row, column, column);
+	out.write((const char *)&header, sizeof(header));
+	for(int i = 0; i < row; i++)
+	{
+		out.write((const char *)(matrix + (long)i*stride), (long)column*sizeof(T));
+	}
+	out.close();
+	if(!out)
+	{
+		throw std::runtime_error(path + ": cannot write matrix file");
 	}
 }
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef MATRIX_ARENA_CPP
+#define MATRIX_ARENA_CPP
+
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+
+/*
+* 64 byte aligned storage for Matrix<T> and a reusable pool of such blocks.
+* A per-frame loop that creates M, Dx and Dy of the same size every frame gets
+* the blocks of the previous frame back from the arena instead of going to the
+* heap, and the pages of those blocks are already mapped, so no page faults.
+*/
+
+/**
+* Alignment of every matrix allocation in bytes, one cache line and one AVX-512 vector
+*/
+const size_t MATRIX_ALIGNMENT = 64;
+
+/**
+* Description: Allocates a block of memory aligned to MATRIX_ALIGNMENT
+* Throws: std::bad_alloc if the memory is not available
+* @params bytes, the size of the block
+* @returns void*, the block, released with freeAligned()
+*/
+void * allocateAligned(size_t bytes)
+{
+	void * block = nullptr;
+	if(posix_memalign(&block, MATRIX_ALIGNMENT, (bytes > 0) ? bytes : 1) != 0)
+	{
+		throw std::bad_alloc();
+	}
+	return block;
+}
+
+/**
+* Description: Releases a block from allocateAligned()
+* @params block, the block to release
+* @returns NONE
+*/
+void freeAligned(void * block)
+{
+	free(block);
+}
+
+/**
+* Pool of aligned blocks that are handed out again for requests of the same size.
+* Blocks stay owned by the arena until it is destroyed, so an arena must outlive
+* every Matrix allocated from it. Safe to use from several threads.
+*/
+class MatrixArena
+{
+public:
+	MatrixArena() {}
+
+	/**
+	* Destructor
+	* Description: Frees every block currently held by the arena
+	*/
+	~MatrixArena()
+	{
+		for(std::multimap<size_t, void *>::iterator it = freeBlocks.begin(); it != freeBlocks.end(); ++it)
+		{
+			freeAligned(it->second);
+		}
+	}
+
+	/**
+	* Description: Hands out a block of exactly 'bytes' bytes
+	* Implementation: Reuses a released block of the same size if there is one,
+	* otherwise allocates a new aligned block
+	* @params bytes, the size of the block
+	* @returns void*, the block, given back with release()
+	*/
+	void * acquire(size_t bytes)
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			std::multimap<size_t, void *>::iterator it = freeBlocks.find(bytes);
+			if(it != freeBlocks.end())
+			{
+				void * block = it->second;
+				freeBlocks.erase(it);
+				return block;
+			}
+		}
+		return allocateAligned(bytes);
+	}
+
+	/**
+	* Description: Gives a block back to the arena for reuse
+	* @params block, a block from acquire()
+	* @params bytes, the size the block was acquired with
+	* @returns NONE
+	*/
+	void release(void * block, size_t bytes)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		freeBlocks.insert(std::make_pair(bytes, block));
+	}
+
+	/**
+	* Description: Returns the number of blocks waiting to be reused
+	* @params NONE
+	* @returns size_t, the number of free blocks
+	*/
+	size_t freeBlockCount()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return freeBlocks.size();
+	}
+
+private:
+	MatrixArena(const MatrixArena &);
+	MatrixArena & operator=(const MatrixArena &);
+
+	/**
+	* Released blocks by size
+	*/
+	std::multimap<size_t, void *> freeBlocks;
+	std::mutex lock;
+};
+
+/**
+* How a Matrix lays out its storage
+* padRows: round every row up to whole 64 byte cache lines, so every row starts aligned
+* ghost: 0, or 1 to add a ring of ghost cells around the matrix that refreshGhosts()
+* fills with the wrap-around neighbors, letting a convolution read row -1, row 'rows',
+* column -1 and column 'columns' without any edge handling
+* arena: the arena to take the storage from, nullptr for a plain aligned allocation
+*/
+struct MatrixLayout
+{
+	bool padRows = false;
+	int ghost = 0;
+	MatrixArena * arena = nullptr;
+};
+
+#endif
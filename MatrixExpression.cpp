@@ -0,0 +1,773 @@
+#ifndef MATRIX_EXPRESSION_CPP
+#define MATRIX_EXPRESSION_CPP
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Matrix.cpp"
+#include "SimdKernels.cpp"
+#include "ThreadPool.cpp"
+
+/*
+* Lazy per-pixel pipelines. abs(gradientX(M)) + abs(gradientY(M)) does not compute anything:
+* it builds a small object that describes the chain, and the whole chain runs in one loop
+* over the pixels when it is stored with evaluate() or reduced with getMin(), getExtrema(),
+* getSum() and the like. No stage between M and the result is written to memory, so a
+* chain of gradient, abs, threshold and min/max reads M once and allocates nothing.
+*
+* Every expression is evaluated one row at a time: row(i) returns a cursor that gives the
+* value of column j with at(j) for the interior columns [1, columns-2] and with edge(j) for
+* the first and last column, where the [-1, 0, 1] gradients wrap around to the opposite end
+* of the row like every engine. The loop over the interior columns has no branches and no
+* calls left once the cursors are inlined, so the compiler vectorizes it for the fused
+* chain as it would for a hand-written one (at -O3). Like the span loops of the kernel
+* engine, the loops are also built for AVX2, which has the 32 bit abs, min and max and the
+* widening loads the default SSE2 build emulates, and that build runs when simdLevel()
+* reports AVX2. The parallel passes split the rows into one band per thread like getMin(pool).
+*
+* The values follow the C++ arithmetic rules: gradients of unsigned char are int, short int
+* + short int is int, and evaluate() converts the final value to the element type of the
+* output with a plain cast. Expressions keep copies of their operands, views and functors,
+* so a chain can be stored in a variable and evaluated later, as long as the matrices its
+* views point into are still alive. New per-pixel stages are functors given to map() or zip().
+*/
+
+///////////////////////////////////////
+//EXPRESSION BASE
+///////////////////////////////////////
+/**
+* Base of every expression, it only marks the types the operators below apply to.
+* An expression E has a typedef Value, getRows(), getColumns() and row(i), whose cursor
+* has Value at(int j) for the interior columns and Value edge(int j) for any column.
+*/
+template <typename E>
+struct Expression
+{
+	const E & self() const
+	{
+		return static_cast<const E &>(*this);
+	}
+};
+
+/**
+* Description: Throws if two operands of an expression or an expression and its output differ in shape
+* Throws: std::invalid_argument
+*/
+inline void checkExpressionShape(int rows, int columns, int otherRows, int otherColumns)
+{
+	if(rows != otherRows || columns != otherColumns)
+	{
+		throw std::invalid_argument("matrix expression of " + std::to_string(rows) + "x" + std::to_string(columns)
+			+ " used with " + std::to_string(otherRows) + "x" + std::to_string(otherColumns));
+	}
+}
+
+///////////////////////////////////////
+//LEAVES
+///////////////////////////////////////
+/**
+* The elements of a view as they are
+*/
+template <typename T>
+class ViewExpression : public Expression<ViewExpression<T> >
+{
+public:
+	typedef T Value;
+
+	struct Row
+	{
+		const T * line;
+		T at(int j) const { return line[j]; }
+		T edge(int j) const { return line[j]; }
+	};
+
+	explicit ViewExpression(MatrixView<T> view) : view(view) {}
+
+	int getRows() const { return view.getRows(); }
+	int getColumns() const { return view.getColumns(); }
+	Row row(int i) const { return Row{ view.getRow(i) }; }
+
+private:
+	MatrixView<T> view;
+};
+
+/**
+* Dx of M, the horizontal [-1, 0, 1] gradient with wrap-around
+*/
+class GradientXExpression : public Expression<GradientXExpression>
+{
+public:
+	typedef int Value;
+
+	struct Row
+	{
+		const unsigned char * line;
+		int columns;
+		int at(int j) const { return line[j+1] - line[j-1]; }
+		//a single column wraps onto itself, both neighbors are the same value
+		int edge(int j) const { return line[(j == columns-1) ? 0 : j+1] - line[(j == 0) ? columns-1 : j-1]; }
+	};
+
+	explicit GradientXExpression(MatrixView<unsigned char> M) : M(M) {}
+
+	int getRows() const { return M.getRows(); }
+	int getColumns() const { return M.getColumns(); }
+	Row row(int i) const { return Row{ M.getRow(i), M.getColumns() }; }
+
+private:
+	MatrixView<unsigned char> M;
+};
+
+/**
+* Dy of M, the vertical [-1, 0, 1] gradient with wrap-around
+*/
+class GradientYExpression : public Expression<GradientYExpression>
+{
+public:
+	typedef int Value;
+
+	struct Row
+	{
+		const unsigned char * above;
+		const unsigned char * below;
+		int at(int j) const { return below[j] - above[j]; }
+		int edge(int j) const { return below[j] - above[j]; }
+	};
+
+	explicit GradientYExpression(MatrixView<unsigned char> M) : M(M) {}
+
+	int getRows() const { return M.getRows(); }
+	int getColumns() const { return M.getColumns(); }
+
+	//the first and last row take their wrap-around neighbor from the opposite end
+	Row row(int i) const
+	{
+		const int rows = M.getRows();
+		return Row{ M.getRow((i == 0) ? rows-1 : i-1), M.getRow((i == rows-1) ? 0 : i+1) };
+	}
+
+private:
+	MatrixView<unsigned char> M;
+};
+
+///////////////////////////////////////
+//ELEMENTWISE NODES
+///////////////////////////////////////
+/**
+* f(value) of every element of an expression
+*/
+template <typename E, typename F>
+class MapExpression : public Expression<MapExpression<E, F> >
+{
+public:
+	typedef decltype(std::declval<const F &>()(std::declval<typename E::Value>())) Value;
+
+	struct Row
+	{
+		typename E::Row operand;
+		F f;
+		Value at(int j) const { return f(operand.at(j)); }
+		Value edge(int j) const { return f(operand.edge(j)); }
+	};
+
+	MapExpression(const E & operand, const F & f) : operand(operand), f(f) {}
+
+	int getRows() const { return operand.getRows(); }
+	int getColumns() const { return operand.getColumns(); }
+	Row row(int i) const { return Row{ operand.row(i), f }; }
+
+private:
+	E operand;
+	F f;
+};
+
+/**
+* f(a, b) of the elements at the same position of two expressions of the same shape
+*/
+template <typename A, typename B, typename F>
+class ZipExpression : public Expression<ZipExpression<A, B, F> >
+{
+public:
+	typedef decltype(std::declval<const F &>()(std::declval<typename A::Value>(), std::declval<typename B::Value>())) Value;
+
+	struct Row
+	{
+		typename A::Row a;
+		typename B::Row b;
+		F f;
+		Value at(int j) const { return f(a.at(j), b.at(j)); }
+		Value edge(int j) const { return f(a.edge(j), b.edge(j)); }
+	};
+
+	/**
+	* Throws: std::invalid_argument if a and b differ in shape
+	*/
+	ZipExpression(const A & a, const B & b, const F & f) : a(a), b(b), f(f)
+	{
+		checkExpressionShape(a.getRows(), a.getColumns(), b.getRows(), b.getColumns());
+	}
+
+	int getRows() const { return a.getRows(); }
+	int getColumns() const { return a.getColumns(); }
+	Row row(int i) const { return Row{ a.row(i), b.row(i), f }; }
+
+private:
+	A a;
+	B b;
+	F f;
+};
+
+///////////////////////////////////////
+//FUNCTORS
+///////////////////////////////////////
+struct PlusFunctor
+{
+	template <typename A, typename B>
+	auto operator()(A a, B b) const -> decltype(a + b) { return a + b; }
+};
+
+struct MinusFunctor
+{
+	template <typename A, typename B>
+	auto operator()(A a, B b) const -> decltype(a - b) { return a - b; }
+};
+
+struct TimesFunctor
+{
+	template <typename A, typename B>
+	auto operator()(A a, B b) const -> decltype(a * b) { return a * b; }
+};
+
+struct MinimumFunctor
+{
+	template <typename A, typename B>
+	typename std::common_type<A, B>::type operator()(A a, B b) const
+	{
+		typedef typename std::common_type<A, B>::type C;
+		return ((C)b < (C)a) ? (C)b : (C)a;
+	}
+};
+
+struct MaximumFunctor
+{
+	template <typename A, typename B>
+	typename std::common_type<A, B>::type operator()(A a, B b) const
+	{
+		typedef typename std::common_type<A, B>::type C;
+		return ((C)a < (C)b) ? (C)b : (C)a;
+	}
+};
+
+struct NegateFunctor
+{
+	template <typename A>
+	auto operator()(A a) const -> decltype(-a) { return -a; }
+};
+
+struct AbsoluteFunctor
+{
+	template <typename A>
+	auto operator()(A a) const -> decltype(+a) { return (a < 0) ? -a : +a; }
+};
+
+/**
+* Keeps the values at or above the level and sets the others to 0
+*/
+template <typename S>
+struct ThresholdFunctor
+{
+	S level;
+
+	template <typename A>
+	A operator()(A a) const { return (a < level) ? A(0) : a; }
+};
+
+/**
+* A binary functor with its right or left operand fixed to a scalar, for expression op scalar
+* and scalar op expression
+*/
+template <typename F, typename S>
+struct BindRight
+{
+	F f;
+	S scalar;
+
+	template <typename A>
+	auto operator()(A a) const -> decltype(f(a, scalar)) { return f(a, scalar); }
+};
+
+template <typename F, typename S>
+struct BindLeft
+{
+	F f;
+	S scalar;
+
+	template <typename A>
+	auto operator()(A a) const -> decltype(f(scalar, a)) { return f(scalar, a); }
+};
+
+///////////////////////////////////////
+//BUILDING EXPRESSIONS
+///////////////////////////////////////
+/**
+* Description: Starts an expression from the elements of a view or matrix
+* @params view, the view, it must outlive the expression
+* @returns ViewExpression<T>, the expression
+*/
+template <typename T>
+ViewExpression<T> lazy(MatrixView<T> view)
+{
+	return ViewExpression<T>(view);
+}
+
+template <typename T>
+ViewExpression<T> lazy(const Matrix<T> & M)
+{
+	return ViewExpression<T>(M.view());
+}
+
+/**
+* Description: Starts an expression from Dx or Dy of M, as convolve() computes them
+* @params M, the matrix, it must outlive the expression
+* @returns GradientXExpression or GradientYExpression, the expression, of int values
+*/
+inline GradientXExpression gradientX(MatrixView<unsigned char> M)
+{
+	return GradientXExpression(M);
+}
+
+inline GradientYExpression gradientY(MatrixView<unsigned char> M)
+{
+	return GradientYExpression(M);
+}
+
+/**
+* Description: Applies a function to every element, the extension point for new per-pixel stages
+* @params e, the expression
+* @params f, a copyable callable taking a value of e, inlined into the loop
+* @returns MapExpression<E, F>, the expression of f(value)
+*/
+template <typename E, typename F>
+MapExpression<E, F> map(const Expression<E> & e, F f)
+{
+	return MapExpression<E, F>(e.self(), f);
+}
+
+/**
+* Description: Applies a function to the elements at the same position of two expressions
+* Throws: std::invalid_argument if a and b differ in shape
+* @params a, b, the expressions
+* @params f, a copyable callable taking a value of a and a value of b
+* @returns ZipExpression<A, B, F>, the expression of f(a, b)
+*/
+template <typename A, typename B, typename F>
+ZipExpression<A, B, F> zip(const Expression<A> & a, const Expression<B> & b, F f)
+{
+	return ZipExpression<A, B, F>(a.self(), b.self(), f);
+}
+
+/**
+* The binary operations, between two expressions of the same shape or between an
+* expression and a scalar, on either side
+*/
+#define MATRIX_EXPRESSION_BINARY(NAME, FUNCTOR) \
+	template <typename A, typename B> \
+	ZipExpression<A, B, FUNCTOR> NAME(const Expression<A> & a, const Expression<B> & b) \
+	{ \
+		return ZipExpression<A, B, FUNCTOR>(a.self(), b.self(), FUNCTOR()); \
+	} \
+	template <typename A, typename S, typename = typename std::enable_if<std::is_arithmetic<S>::value>::type> \
+	MapExpression<A, BindRight<FUNCTOR, S> > NAME(const Expression<A> & a, S scalar) \
+	{ \
+		return MapExpression<A, BindRight<FUNCTOR, S> >(a.self(), BindRight<FUNCTOR, S>{ FUNCTOR(), scalar }); \
+	} \
+	template <typename S, typename B, typename = typename std::enable_if<std::is_arithmetic<S>::value>::type> \
+	MapExpression<B, BindLeft<FUNCTOR, S> > NAME(S scalar, const Expression<B> & b) \
+	{ \
+		return MapExpression<B, BindLeft<FUNCTOR, S> >(b.self(), BindLeft<FUNCTOR, S>{ FUNCTOR(), scalar }); \
+	}
+
+MATRIX_EXPRESSION_BINARY(operator+, PlusFunctor)
+MATRIX_EXPRESSION_BINARY(operator-, MinusFunctor)
+MATRIX_EXPRESSION_BINARY(operator*, TimesFunctor)
+MATRIX_EXPRESSION_BINARY(minimum, MinimumFunctor)
+MATRIX_EXPRESSION_BINARY(maximum, MaximumFunctor)
+
+#undef MATRIX_EXPRESSION_BINARY
+
+template <typename E>
+MapExpression<E, NegateFunctor> operator-(const Expression<E> & e)
+{
+	return MapExpression<E, NegateFunctor>(e.self(), NegateFunctor());
+}
+
+template <typename E>
+MapExpression<E, AbsoluteFunctor> abs(const Expression<E> & e)
+{
+	return MapExpression<E, AbsoluteFunctor>(e.self(), AbsoluteFunctor());
+}
+
+/**
+* Description: Sets the values below a level to 0 and keeps the others
+* @params e, the expression
+* @params level, the least value kept
+* @returns MapExpression, the expression of the thresholded values
+*/
+template <typename E, typename S>
+MapExpression<E, ThresholdFunctor<S> > threshold(const Expression<E> & e, S level)
+{
+	return MapExpression<E, ThresholdFunctor<S> >(e.self(), ThresholdFunctor<S>{ level });
+}
+
+///////////////////////////////////////
+//EVALUATION
+///////////////////////////////////////
+/**
+* Description: Stores the rows [firstRow, endRow) of an expression
+* Implementation: The first and last column through edge(), the interior columns through
+* at() in a loop without branches
+* @params e, the expression
+* @params out, the output, the shape of e
+* @params firstRow, endRow, the rows to store
+* @returns NONE
+*/
+template <typename E, typename T>
+void evaluateRows(const E & e, MatrixView<T> out, int firstRow, int endRow)
+{
+	const int columns = e.getColumns();
+	if(columns == 0)
+	{
+		return;
+	}
+	for(int i = firstRow; i < endRow; i++)
+	{
+		const typename E::Row row = e.row(i);
+		T * line = out.getRow(i);
+		line[0] = (T)row.edge(0);
+		for(int j = 1; j < columns-1; j++)
+		{
+			line[j] = (T)row.at(j);
+		}
+		if(columns > 1)
+		{
+			line[columns-1] = (T)row.edge(columns-1);
+		}
+	}
+}
+
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+/**
+* AVX2 build of evaluateRows(), the same code compiled for 256 bit vectors. flatten inlines
+* the loop and every cursor of the chain into it, the loop is too large to be inlined on its
+* own and the AVX2 build would only call the default one.
+*/
+template <typename E, typename T>
+__attribute__((target("avx2"), flatten))
+void evaluateRowsAvx2(const E & e, MatrixView<T> out, int firstRow, int endRow)
+{
+	evaluateRows(e, out, firstRow, endRow);
+}
+#endif
+
+/**
+* Description: Runs the AVX2 or the default build of evaluateRows()
+*/
+template <typename E, typename T>
+inline void evaluateRowsAuto(const E & e, MatrixView<T> out, int firstRow, int endRow, bool avx2)
+{
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+	if(avx2)
+	{
+		evaluateRowsAvx2(e, out, firstRow, endRow);
+		return;
+	}
+#endif
+	(void)avx2;
+	evaluateRows(e, out, firstRow, endRow);
+}
+
+/**
+* Description: Computes an expression and stores it, the one loop that runs the whole chain
+* Preconditions: out is not a matrix a gradient of the expression reads, the gradients read
+* the neighbors of the element being stored; an elementwise chain can write over its input
+* Throws: std::invalid_argument if out is not the shape of the expression
+* @params e, the expression
+* @params out, the output, every value converted to T with a cast
+* @returns NONE
+*/
+template <typename E, typename T>
+void evaluate(const Expression<E> & e, MatrixView<T> out)
+{
+	checkExpressionShape(e.self().getRows(), e.self().getColumns(), out.getRows(), out.getColumns());
+	evaluateRowsAuto(e.self(), out, 0, out.getRows(), simdLevel() == SIMD_AVX2);
+}
+
+/**
+* Description: evaluate() using every thread of the pool, one band of rows per thread
+* Throws: std::invalid_argument if out is not the shape of the expression
+* @params e, the expression
+* @params out, the output, every value converted to T with a cast
+* @params pool, the thread pool to run the bands on
+* @returns NONE
+*/
+template <typename E, typename T>
+void evaluate(const Expression<E> & e, MatrixView<T> out, ThreadPool & pool)
+{
+	checkExpressionShape(e.self().getRows(), e.self().getColumns(), out.getRows(), out.getColumns());
+	const int rows = out.getRows();
+	const int parts = std::max(1, std::min(rows, pool.getThreads()));
+	const bool avx2 = simdLevel() == SIMD_AVX2;
+	pool.run(parts, [&](int part)
+	{
+		evaluateRowsAuto(e.self(), out, (int)((long)rows*part / parts), (int)((long)rows*(part+1) / parts), avx2);
+	});
+}
+
+///////////////////////////////////////
+//REDUCTIONS
+///////////////////////////////////////
+/*
+* A reduction R has a typedef Result, Result identity() for an empty range,
+* Result operator()(Result, Value) that adds one value, and Result combine(Result, Result)
+* that joins the results of two bands. Its operator() is inlined into the row loop.
+*/
+
+template <typename V>
+struct MinReduction
+{
+	typedef V Result;
+	Result identity() const { return std::numeric_limits<V>::max(); }
+	Result operator()(Result result, V value) const { return (value < result) ? value : result; }
+	Result combine(Result a, Result b) const { return (*this)(a, b); }
+};
+
+template <typename V>
+struct MaxReduction
+{
+	typedef V Result;
+	Result identity() const { return std::numeric_limits<V>::lowest(); }
+	Result operator()(Result result, V value) const { return (result < value) ? value : result; }
+	Result combine(Result a, Result b) const { return (*this)(a, b); }
+};
+
+/**
+* The min and max of an expression from one pass
+*/
+template <typename V>
+struct ExpressionExtrema
+{
+	V min;
+	V max;
+};
+
+template <typename V>
+struct ExtremaReduction
+{
+	typedef ExpressionExtrema<V> Result;
+	Result identity() const { return Result{ std::numeric_limits<V>::max(), std::numeric_limits<V>::lowest() }; }
+	Result operator()(Result result, V value) const
+	{
+		result.min = (value < result.min) ? value : result.min;
+		result.max = (result.max < value) ? value : result.max;
+		return result;
+	}
+	Result combine(Result a, Result b) const
+	{
+		return Result{ std::min(a.min, b.min), std::max(a.max, b.max) };
+	}
+};
+
+/**
+* The sum in long long for integer values and in double for floating point values
+*/
+template <typename V>
+struct SumReduction
+{
+	typedef typename std::conditional<std::is_integral<V>::value, long long, double>::type Result;
+	Result identity() const { return 0; }
+	Result operator()(Result result, V value) const { return result + value; }
+	Result combine(Result a, Result b) const { return a + b; }
+};
+
+template <typename V>
+struct CountNonZeroReduction
+{
+	typedef long Result;
+	Result identity() const { return 0; }
+	Result operator()(Result result, V value) const { return result + (value != 0); }
+	Result combine(Result a, Result b) const { return a + b; }
+};
+
+/**
+* Description: Reduces the rows [firstRow, endRow) of an expression
+* Implementation: The running result is a local, so the loop over the interior columns
+* keeps it in registers and the compiler can vectorize min, max and sums
+* @params e, the expression
+* @params reduction, the reduction
+* @params firstRow, endRow, the rows to reduce
+* @returns R::Result, the result, reduction.identity() for no elements
+*/
+template <typename E, typename R>
+typename R::Result reduceRows(const E & e, const R & reduction, int firstRow, int endRow)
+{
+	typename R::Result result = reduction.identity();
+	const int columns = e.getColumns();
+	if(columns == 0)
+	{
+		return result;
+	}
+	for(int i = firstRow; i < endRow; i++)
+	{
+		const typename E::Row row = e.row(i);
+		result = reduction(result, row.edge(0));
+		for(int j = 1; j < columns-1; j++)
+		{
+			result = reduction(result, row.at(j));
+		}
+		if(columns > 1)
+		{
+			result = reduction(result, row.edge(columns-1));
+		}
+	}
+	return result;
+}
+
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+/**
+* AVX2 build of reduceRows()
+*/
+template <typename E, typename R>
+__attribute__((target("avx2"), flatten))
+typename R::Result reduceRowsAvx2(const E & e, const R & reduction, int firstRow, int endRow)
+{
+	return reduceRows(e, reduction, firstRow, endRow);
+}
+#endif
+
+/**
+* Description: Runs the AVX2 or the default build of reduceRows()
+*/
+template <typename E, typename R>
+inline typename R::Result reduceRowsAuto(const E & e, const R & reduction, int firstRow, int endRow, bool avx2)
+{
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+	if(avx2)
+	{
+		return reduceRowsAvx2(e, reduction, firstRow, endRow);
+	}
+#endif
+	(void)avx2;
+	return reduceRows(e, reduction, firstRow, endRow);
+}
+
+/**
+* Description: Reduces every element of an expression in one pass, the extension point for
+* new reductions
+* @params e, the expression
+* @params reduction, the reduction
+* @returns R::Result, the result
+*/
+template <typename E, typename R>
+typename R::Result reduce(const Expression<E> & e, const R & reduction)
+{
+	return reduceRowsAuto(e.self(), reduction, 0, e.self().getRows(), simdLevel() == SIMD_AVX2);
+}
+
+/**
+* Description: reduce() using every thread of the pool
+* Implementation: One band of rows per thread, as getMin(pool), every band keeps its own
+* result and the results are combined once all bands are done
+* @params e, the expression
+* @params reduction, the reduction
+* @params pool, the thread pool to run the bands on
+* @returns R::Result, the result
+*/
+template <typename E, typename R>
+typename R::Result reduce(const Expression<E> & e, const R & reduction, ThreadPool & pool)
+{
+	const int rows = e.self().getRows();
+	const int parts = std::max(1, std::min(rows, pool.getThreads()));
+	std::vector<typename R::Result> partial(parts, reduction.identity());
+	const bool avx2 = simdLevel() == SIMD_AVX2;
+
+	pool.run(parts, [&](int part)
+	{
+		partial[part] = reduceRowsAuto(e.self(), reduction, (int)((long)rows*part / parts), (int)((long)rows*(part+1) / parts), avx2);
+	});
+
+	//combine the per-thread results
+	typename R::Result result = partial[0];
+	for(int part = 1; part < parts; part++)
+	{
+		result = reduction.combine(result, partial[part]);
+	}
+	return result;
+}
+
+/**
+* The common reductions, serial and on a pool
+*/
+template <typename E>
+typename E::Value getMin(const Expression<E> & e)
+{
+	return reduce(e, MinReduction<typename E::Value>());
+}
+
+template <typename E>
+typename E::Value getMin(const Expression<E> & e, ThreadPool & pool)
+{
+	return reduce(e, MinReduction<typename E::Value>(), pool);
+}
+
+template <typename E>
+typename E::Value getMax(const Expression<E> & e)
+{
+	return reduce(e, MaxReduction<typename E::Value>());
+}
+
+template <typename E>
+typename E::Value getMax(const Expression<E> & e, ThreadPool & pool)
+{
+	return reduce(e, MaxReduction<typename E::Value>(), pool);
+}
+
+template <typename E>
+ExpressionExtrema<typename E::Value> getExtrema(const Expression<E> & e)
+{
+	return reduce(e, ExtremaReduction<typename E::Value>());
+}
+
+template <typename E>
+ExpressionExtrema<typename E::Value> getExtrema(const Expression<E> & e, ThreadPool & pool)
+{
+	return reduce(e, ExtremaReduction<typename E::Value>(), pool);
+}
+
+template <typename E>
+typename SumReduction<typename E::Value>::Result getSum(const Expression<E> & e)
+{
+	return reduce(e, SumReduction<typename E::Value>());
+}
+
+template <typename E>
+typename SumReduction<typename E::Value>::Result getSum(const Expression<E> & e, ThreadPool & pool)
+{
+	return reduce(e, SumReduction<typename E::Value>(), pool);
+}
+
+template <typename E>
+long countNonZero(const Expression<E> & e)
+{
+	return reduce(e, CountNonZeroReduction<typename E::Value>());
+}
+
+template <typename E>
+long countNonZero(const Expression<E> & e, ThreadPool & pool)
+{
+	return reduce(e, CountNonZeroReduction<typename E::Value>(), pool);
+}
+
+#endif
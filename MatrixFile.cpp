@@ -0,0 +1,136 @@
+#ifndef MATRIX_FILE_CPP
+#define MATRIX_FILE_CPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+
+/*
+* Binary on-disk format of a Matrix<T>, read with Matrix<T>::Matrix(path) and written
+* with Matrix<T>::save(path).
+*
+*   offset  0  char[4]   magic "CVMX"
+*   offset  4  uint32    format version (1)
+*   offset  8  uint32    element type, see MatrixDType
+*   offset 12  uint32    size of the header in bytes, a multiple of 64, the elements start here
+*   offset 16  uint64    rows
+*   offset 24  uint64    columns
+*   offset 32  uint64    row stride in elements (>= columns)
+*   offset 40  padding up to 64 bytes
+*
+* All fields are in the byte order of the machine that wrote the file. The header is
+* 64 bytes, so when the file is mapped at a page boundary the elements are 64 byte aligned.
+*/
+
+/**
+* Element type codes stored in the header
+*/
+enum MatrixDTypeCode
+{
+	DTYPE_UINT8 = 1,
+	DTYPE_INT16 = 2,
+	DTYPE_UINT16 = 3,
+	DTYPE_INT32 = 4,
+	DTYPE_FLOAT32 = 5,
+	DTYPE_FLOAT64 = 6,
+	DTYPE_INT8 = 7
+};
+
+/**
+* Maps an element type to its MatrixDTypeCode, only the types below can be stored
+*/
+template <typename T> struct MatrixDType;
+template <> struct MatrixDType<unsigned char> { static const uint32_t code = DTYPE_UINT8; };
+template <> struct MatrixDType<short int> { static const uint32_t code = DTYPE_INT16; };
+template <> struct MatrixDType<unsigned short int> { static const uint32_t code = DTYPE_UINT16; };
+template <> struct MatrixDType<int> { static const uint32_t code = DTYPE_INT32; };
+template <> struct MatrixDType<float> { static const uint32_t code = DTYPE_FLOAT32; };
+template <> struct MatrixDType<double> { static const uint32_t code = DTYPE_FLOAT64; };
+template <> struct MatrixDType<signed char> { static const uint32_t code = DTYPE_INT8; };
+
+/**
+* Header at the start of every matrix file
+*/
+struct MatrixFileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t dtype;
+	uint32_t headerBytes;
+	uint64_t rows;
+	uint64_t columns;
+	uint64_t stride;
+	unsigned char padding[24];
+};
+
+/**
+* Magic bytes and current version of the format
+*/
+const char MATRIX_FILE_MAGIC[4] = { 'C', 'V', 'M', 'X' };
+const uint32_t MATRIX_FILE_VERSION = 1;
+
+/**
+* Description: Builds the header of a matrix file
+* @params dtype, the MatrixDTypeCode of the elements
+* @params rows, the row size of the matrix
+* @params columns, the column size of the matrix
+* @params stride, the row stride in elements
+* @returns MatrixFileHeader, the filled in header
+*/
+MatrixFileHeader makeMatrixFileHeader(uint32_t dtype, uint64_t rows, uint64_t columns, uint64_t stride)
+{
+	MatrixFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic));
+	header.version = MATRIX_FILE_VERSION;
+	header.dtype = dtype;
+	header.headerBytes = sizeof(MatrixFileHeader);
+	header.rows = rows;
+	header.columns = columns;
+	header.stride = stride;
+	return header;
+}
+
+/**
+* Description: Checks that a header read from a file of 'fileBytes' bytes describes a
+* valid matrix of elements with the given type and size
+* Throws: std::runtime_error naming the path and the problem
+* @params header, the header read from the start of the file
+* @params fileBytes, the total size of the file
+* @params dtype, the expected MatrixDTypeCode
+* @params elementBytes, sizeof the element type
+* @params path, the file path used in the error message
+* @returns NONE
+*/
+void checkMatrixFileHeader(const MatrixFileHeader & header, uint64_t fileBytes, uint32_t dtype, uint64_t elementBytes, const std::string & path)
+{
+	if(std::memcmp(header.magic, MATRIX_FILE_MAGIC, sizeof(header.magic)) != 0)
+	{
+		throw std::runtime_error(path + ": not a matrix file");
+	}
+	if(header.version != MATRIX_FILE_VERSION)
+	{
+		throw std::runtime_error(path + ": unsupported matrix file version");
+	}
+	if(header.dtype != dtype)
+	{
+		throw std::runtime_error(path + ": element type does not match the matrix type");
+	}
+	if(header.headerBytes < sizeof(MatrixFileHeader) || header.rows < 1 || header.columns < 1
+		|| header.stride < header.columns || header.rows > 0x7fffffff || header.stride > 0x7fffffff)
+	{
+		throw std::runtime_error(path + ": invalid matrix size in header");
+	}
+	//the elements must stay 64 byte aligned in the mapping, a T * at any other offset may be misaligned
+	if(header.headerBytes % 64 != 0)
+	{
+		throw std::runtime_error(path + ": header size is not a multiple of 64 bytes");
+	}
+	if(header.headerBytes > fileBytes || header.rows > (fileBytes - header.headerBytes) / (header.stride*elementBytes))
+	{
+		throw std::runtime_error(path + ": file is shorter than the header says");
+	}
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef MATRIX_RANDOM_CPP
+#define MATRIX_RANDOM_CPP
+
+#include <cstdint>
+#include <cstring>
+
+/*
+* Counter-based random numbers for filling matrices with synthetic data.
+* Every 64-bit random word is a hash (the SplitMix64 finalizer) of the seed and the
+* word's position in the matrix, so any row can be generated on its own: the rows can
+* be filled by any number of threads in any order and the matrix is always the same
+* for the same seed. There is no generator state to carry from one element to the
+* next, so the inner loop is a few multiplies and shifts per 8 bytes of output.
+*/
+
+/**
+* Description: Hashes a 64-bit value with the SplitMix64 finalizer
+* @params z, the value to hash
+* @returns uint64_t, the hashed value, every input bit affects every output bit
+*/
+inline uint64_t mixRandomBits(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/**
+* Description: Returns the random word number 'counter' of the stream selected by 'seed'
+* @params seed, the seed of the stream, already hashed with mixRandomBits()
+* @params counter, the position of the word in the stream
+* @returns uint64_t, 64 random bits
+*/
+inline uint64_t counterRandom(uint64_t seed, uint64_t counter)
+{
+	return mixRandomBits(seed + (counter + 1)*0x9E3779B97F4A7C15ULL);
+}
+
+/**
+* Converts the low bits of a random word to an element of type T.
+* Integer types take their low sizeof(T) bytes, so every value of the type, including
+* numeric_limits<T>::max(), is equally likely. Floating point types get a value in [0, 1).
+*/
+template <typename T>
+inline T randomElement(uint64_t bits)
+{
+	T value;
+	std::memcpy(&value, &bits, sizeof(T));
+	return value;
+}
+
+template <>
+inline float randomElement<float>(uint64_t bits)
+{
+	return (float)(bits & 0xFFFFFF) * (1.0f / 16777216.0f);
+}
+
+template <>
+inline double randomElement<double>(uint64_t bits)
+{
+	return (double)(bits >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+* Description: Fills one row of a matrix with random elements
+* Implementation: One random word is split into 8/sizeof(T) elements (8 for unsigned char),
+* float uses 32 bits of a word per element and double a whole word. The counter of the
+* first word of a row only depends on the row index and the column size, which is what
+* makes the rows independent.
+* @params line, pointer to column 0 of the row
+* @params columns, the column size of the matrix
+* @params seed, the seed, already hashed with mixRandomBits()
+* @params row, the index of the row in the matrix
+* @returns NONE
+*/
+template <typename T>
+void fillRandomRow(T * line, int columns, uint64_t seed, long row)
+{
+	const int perWord = (sizeof(T) < 8) ? (int)(8 / sizeof(T)) : 1;
+	const int elementBits = (sizeof(T) < 8) ? (int)(8 * sizeof(T)) : 0;
+	const long wordsPerRow = (columns + perWord - 1) / perWord;
+	uint64_t counter = (uint64_t)row * wordsPerRow;
+
+	int j = 0;
+	//whole words
+	for(; j + perWord <= columns; j += perWord, counter++)
+	{
+		uint64_t bits = counterRandom(seed, counter);
+		for(int k = 0; k < perWord; k++)
+		{
+			line[j + k] = randomElement<T>(bits);
+			bits = (elementBits > 0) ? bits >> elementBits : bits;
+		}
+	}
+	//the last, partial word of the row
+	if(j < columns)
+	{
+		uint64_t bits = counterRandom(seed, counter);
+		for(; j < columns; j++)
+		{
+			line[j] = randomElement<T>(bits);
+			bits = (elementBits > 0) ? bits >> elementBits : bits;
+		}
+	}
+}
+
+#endif
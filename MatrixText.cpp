@@ -0,0 +1,124 @@
+#ifndef MATRIX_TEXT_CPP
+#define MATRIX_TEXT_CPP
+
+#include <cstdio>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+#include "MatrixView.cpp"
+
+/*
+* Text output of a matrix, the rows of printMatrix(): the values of a row separated by
+* spaces, one row per line. The values are converted to text by hand into a large
+* buffer that is handed to the stream in one write() when it fills up, and the stream
+* is flushed once at the end, instead of formatting every value through operator<< and
+* flushing every row with std::endl. Writing a 4Kx4K result then costs about as much as
+* writing the same number of bytes.
+*/
+
+/**
+* The bytes of text collected before they are written to the stream
+*/
+const size_t TEXT_BUFFER_BYTES = 1 << 20;
+
+/**
+* The most characters one value can take, with its separator: 20 digits and a sign for
+* a 64 bit integer, "-1.23457e-308" for a double
+*/
+const size_t TEXT_VALUE_BYTES = 32;
+
+/**
+* Description: Writes an integer in decimal
+* Implementation: The digits are produced from the last one into a small scratch array
+* and copied out in order
+* @params value, the value
+* @params out, where the text goes, at least TEXT_VALUE_BYTES free
+* @returns char *, one past the last character written
+*/
+inline char * formatInteger(long long value, char * out)
+{
+	unsigned long long magnitude = (unsigned long long)value;
+	if(value < 0)
+	{
+		*out++ = '-';
+		magnitude = 0ULL - magnitude;
+	}
+	char digits[20];
+	int count = 0;
+	do
+	{
+		digits[count++] = (char)('0' + magnitude % 10);
+		magnitude /= 10;
+	} while(magnitude != 0);
+	while(count > 0)
+	{
+		*out++ = digits[--count];
+	}
+	return out;
+}
+
+/**
+* Description: Writes one value as text, integers as formatInteger(), floating point
+* values with 6 significant digits like the default operator<<
+* @params value, the value
+* @params out, where the text goes, at least TEXT_VALUE_BYTES free
+* @returns char *, one past the last character written
+*/
+template <typename T>
+inline char * formatValue(T value, char * out)
+{
+	return formatInteger((long long)value, out);
+}
+
+template <>
+inline char * formatValue<float>(float value, char * out)
+{
+	return out + std::snprintf(out, TEXT_VALUE_BYTES, "%g", value);
+}
+
+template <>
+inline char * formatValue<double>(double value, char * out)
+{
+	return out + std::snprintf(out, TEXT_VALUE_BYTES, "%g", value);
+}
+
+/**
+* Description: Writes a view as text, one row per line
+* Implementation: Formats into a TEXT_BUFFER_BYTES buffer, writes it out whenever it
+* cannot take another value, and flushes the stream once after the last row
+* Throws: std::runtime_error if the stream fails
+* @params view, the matrix or region to write
+* @params out, the stream to write to
+* @returns NONE
+*/
+template <typename T>
+void writeMatrixText(MatrixView<T> view, std::ostream & out)
+{
+	std::vector<char> buffer(TEXT_BUFFER_BYTES);
+	char * const begin = buffer.data();
+	char * const limit = begin + buffer.size() - TEXT_VALUE_BYTES;
+	char * next = begin;
+
+	for(int i = 0; i < view.getRows(); i++)
+	{
+		const T * line = view.getRow(i);
+		for(int j = 0; j < view.getColumns(); j++)
+		{
+			if(next > limit)
+			{
+				out.write(begin, next - begin);
+				next = begin;
+			}
+			next = formatValue(line[j], next);
+			*next++ = (j == view.getColumns()-1) ? '\n' : ' ';
+		}
+	}
+	out.write(begin, next - begin);
+	out.flush();
+	if(!out)
+	{
+		throw std::runtime_error("cannot write the matrix text");
+	}
+}
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef MATRIX_VIEW_CPP
+#define MATRIX_VIEW_CPP
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "ThreadPool.cpp"
+
+/*
+* Non-owning view of a matrix or of a rectangular region (ROI) of a matrix.
+* A view is just a pointer to row 0, column 0, the row/column size and the row stride,
+* so it is cheap to copy and pass by value. It never allocates or frees anything: the
+* Matrix (or other memory) it points into must outlive it.
+* The convolution engines and the min/max functions take views, and a Matrix converts
+* to a view of itself implicitly, so a whole Matrix and an ROI are handled the same way.
+* An ROI is treated as a matrix of its own: the wrap-around at its borders uses the
+* ROI's own first/last row and column, not the surrounding pixels of the frame.
+*/
+template <typename T>
+class MatrixView {
+public:
+	///////////////////////////////////////
+	//CONSTRUCTORS
+	///////////////////////////////////////
+	MatrixView();
+	MatrixView(T * data, int rows, int columns, int stride);
+
+	///////////////////////////////////////
+	//GETTERS
+	///////////////////////////////////////
+	T * getMatrix() const;
+	int getRows() const;
+	int getColumns() const;
+	int getStride() const;
+	T * getRow(int row) const;
+
+	///////////////////////////////////////
+	//SUB-VIEWS
+	///////////////////////////////////////
+	MatrixView<T> subView(int firstRow, int firstColumn, int rows, int columns) const;
+
+	///////////////////////////////////////
+	//MIN/MAX FUNCTIONS
+	///////////////////////////////////////
+	T getMin() const;
+	T getMax() const;
+	T getMin(ThreadPool & pool) const;
+	T getMax(ThreadPool & pool) const;
+
+private:
+	///////////////////////////////////////
+	//PRIVATE DATA VARIABLES
+	///////////////////////////////////////
+	/**
+	* Pointer to the element in row 0, column 0 of the view
+	*/
+	T * data;
+
+	/**
+	* The row and column size of the view
+	*/
+	int rows;
+	int columns;
+
+	/**
+	* The distance in elements between the starts of two consecutive rows
+	*/
+	int stride;
+};
+
+///////////////////////////////////////
+//CONSTRUCTORS
+///////////////////////////////////////
+/**
+* Constructor
+* Description: Creates an empty view that points at nothing
+*/
+template <typename T>
+MatrixView<T>::MatrixView() : data(nullptr), rows(0), columns(0), stride(0)
+{
+}
+
+/**
+* Constructor
+* Description: Creates a view of 'rows' rows of 'columns' elements, the rows 'stride' elements apart
+* Preconditions: data points at rows*stride readable elements (the last row needs only 'columns')
+* @params data, pointer to the element in row 0, column 0
+* @params rows, the row size of the view
+* @params columns, the column size of the view
+* @params stride, the distance in elements between the starts of two consecutive rows
+*/
+template <typename T>
+MatrixView<T>::MatrixView(T * data, int rows, int columns, int stride)
+	: data(data), rows(rows), columns(columns), stride(stride)
+{
+}
+
+///////////////////////////////////////
+//GETTERS
+///////////////////////////////////////
+/**
+* Description: Returns a pointer to row 0, column 0 of the view
+* @returns T*, pointer to the first element
+*/
+template <typename T>
+T * MatrixView<T>::getMatrix() const
+{
+	return data;
+}
+
+/**
+* Description: Returns the number of rows of the view
+* @returns int, the row size
+*/
+template <typename T>
+int MatrixView<T>::getRows() const
+{
+	return rows;
+}
+
+/**
+* Description: Returns the number of columns of the view
+* @returns int, the column size
+*/
+template <typename T>
+int MatrixView<T>::getColumns() const
+{
+	return columns;
+}
+
+/**
+* Description: Returns the distance in elements between the starts of two consecutive rows
+* @returns int, the row stride
+*/
+template <typename T>
+int MatrixView<T>::getStride() const
+{
+	return stride;
+}
+
+/**
+* Description: Returns a pointer to the first element of a row
+* @params row, the row index, 0 <= row < getRows()
+* @returns T*, pointer to column 0 of the row
+*/
+template <typename T>
+T * MatrixView<T>::getRow(int row) const
+{
+	return data + (long)row*stride;
+}
+
+///////////////////////////////////////
+//SUB-VIEWS
+///////////////////////////////////////
+/**
+* Description: Returns a view of a rectangular region of this view
+* Implementation: Moves the data pointer to the first element of the region and keeps the stride,
+* nothing is copied
+* Preconditions: the region lies inside the view
+* @params firstRow, the row of the view where the region starts
+* @params firstColumn, the column of the view where the region starts
+* @params rows, the row size of the region
+* @params columns, the column size of the region
+* @returns MatrixView<T>, the view of the region
+*/
+template <typename T>
+MatrixView<T> MatrixView<T>::subView(int firstRow, int firstColumn, int rows, int columns) const
+{
+	return MatrixView<T>(getRow(firstRow) + firstColumn, rows, columns, stride);
+}
+
+///////////////////////////////////////
+//MIN/MAX FUNCTIONS
+///////////////////////////////////////
+/**
+* Description: Returns the minimum value in the view.
+* Implementation: loops through the rows and keeps track
+* of the "lowest found so far" value and returns that value in the end
+* @returns: T, the lowest value in the view
+*/
+template <typename T>
+T MatrixView<T>::getMin() const
+{
+	T lowestFoundSoFar = std::numeric_limits<T>::max();
+	for(int i = 0; i < rows; i++)
+	{
+		const T * line = getRow(i);
+		for(int j = 0; j < columns; j++)
+		{
+			lowestFoundSoFar = std::min(lowestFoundSoFar, line[j]);
+		}
+	}
+	return lowestFoundSoFar;
+}
+
+/**
+* Description: Returns the maximum value in the view.
+* Implementation: loops through the rows and keeps track
+* of the "greatest found so far" value and returns that value in the end
+* @returns: T, the greatest value in the view
+*/
+template <typename T>
+T MatrixView<T>::getMax() const
+{
+	T greatestFoundSoFar = std::numeric_limits<T>::lowest();
+	for(int i = 0; i < rows; i++)
+	{
+		const T * line = getRow(i);
+		for(int j = 0; j < columns; j++)
+		{
+			greatestFoundSoFar = std::max(greatestFoundSoFar, line[j]);
+		}
+	}
+	return greatestFoundSoFar;
+}
+
+/**
+* Description: Returns the minimum value in the view using every thread of the pool.
+* Implementation: splits the view into one band of rows per thread,
+* each thread keeps its own "lowest found so far" partial result, and the
+* partial results are combined once all threads are done
+* @params: pool, the thread pool to run the bands on
+* @returns: T, the lowest value in the view
+*/
+template <typename T>
+T MatrixView<T>::getMin(ThreadPool & pool) const
+{
+	const int parts = std::max(1, std::min(rows, pool.getThreads()));
+	std::vector<T> partial(parts, std::numeric_limits<T>::max());
+
+	pool.run(parts, [&](int part)
+	{
+		const int first = (int)((long)rows*part / parts);
+		const int end = (int)((long)rows*(part+1) / parts);
+		partial[part] = subView(first, 0, end - first, columns).getMin();
+	});
+
+	//combine the per-thread results
+	return *std::min_element(partial.begin(), partial.end());
+}
+
+/**
+* Description: Returns the maximum value in the view using every thread of the pool.
+* Implementation: splits the view into one band of rows per thread,
+* each thread keeps its own "greatest found so far" partial result, and the
+* partial results are combined once all threads are done
+* @params: pool, the thread pool to run the bands on
+* @returns: T, the greatest value in the view
+*/
+template <typename T>
+T MatrixView<T>::getMax(ThreadPool & pool) const
+{
+	const int parts = std::max(1, std::min(rows, pool.getThreads()));
+	std::vector<T> partial(parts, std::numeric_limits<T>::lowest());
+
+	pool.run(parts, [&](int part)
+	{
+		const int first = (int)((long)rows*part / parts);
+		const int end = (int)((long)rows*(part+1) / parts);
+		partial[part] = subView(first, 0, end - first, columns).getMax();
+	});
+
+	//combine the per-thread results
+	return *std::max_element(partial.begin(), partial.end());
+}
+
+#endif
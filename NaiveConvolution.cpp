@@ -0,0 +1,106 @@
+#ifndef NAIVE_CONVOLUTION_CPP
+#define NAIVE_CONVOLUTION_CPP
+
+#include "Matrix.cpp"
+
+/*
+* The original per-pixel convolution. Every other engine is checked against it by the
+* equivalence tests, so it stays as simple as it was written and is not optimized.
+*/
+
+/*
+* Description: Calculate the horizontal and vertical convolultion result using filter [-1, 0, 1]
+* and store the resultant horizontal result in Dx and resultant vertical result in Dy
+* Implementation: for-loop implementation taking O(n) time to calculate the left and right 
+* sum. loop through each index of Matrix M and calculate Dx convolution and Dy convolution
+* and store them in the approriate index. 
+* EDGE CASE HANDLING: To deal with the edges of the matrix, we employ "WRAP-AROUND"
+* The reason for "WRAP-AROUND" is that I expect that matrices resemble around* the same values
+* on one-side of the edge as the other.
+*
+* Dx EDGE-CASE: For Dx edge-case, the edges are one the leftmost column and the rightmost column.
+* For the leftmost column, we need to assume a postive '1' value, so we take it from the rightmost column same row.
+* imagine like a wrap around, taking the matrix and bending it on the vertical axis so that the left and right edges touch.
+* For the rightmost column, we do the exact same thing but make the '-1' assumption for the leftmost column same row.
+*
+* Dy EDGE-CASE: For Dy edge-case, the edges are the topmost and bottommost row. This is the top and bottom row respectively.
+* When we convolve on the topmost row, our '-1' filter value will be the bottommost row same column
+* When we convolve on the bottommost row, our '1' filter value will be the topmost row same column
+* Employ the same assumption of the Wrap-Around method, assume that the matrix is like a picture and bend it across the 
+* horizontal access so that the topmost and bottommost rows touch.
+*
+* The caller times the run and prints the matrices, so the loop does nothing but convolve.
+*
+* Preconditions: NONE
+* Postconditions: Dx and Dy will hold the respective horizontal and vertical convolution.
+* @params Matrix M, convolve with filter [-1, 0, 1] on horizontal and vertical axis
+* @params Matrix Dx, covolution result of filter [-1, 0, 1] on horizontal axis
+* @params Matrix Dy, covolution result of filter [-1, 0, 1] on vertical axis
+* @return NONE
+*/
+void convolve(Matrix<unsigned char> & M, Matrix<short int> & Dx, Matrix<short int> & Dy)
+{
+	const int rows = M.getRows();
+	const int columns = M.getColumns();
+
+	//Value after summing the filter neighbors
+	short int xValAccumalator;
+	short int yValAccumalator;
+	//mirror value to deal with value being at edges of matrix
+	short int xMirror;
+	short int yMirror;
+
+	//loop through the matrix, calculate the convolution result for Dx and Dy
+	//by summing the neighbors of M with the given filter kernel [-1, 0, 1]
+	//and store the value in Dx and Dy which are passed in by references
+	for(int i = 0; i < rows; i++)//start the outer loop at first row and make our way down
+	{
+		for(int j = 0; j < columns; j++)// for each row, loop through each value
+		{
+			// first calculate Dx and then calculate Dy
+			// Start of Dx calculation
+			if(M.leftEdge(i, j))// Dx calculation, value is on the leftmost edge so our "assumed -1 filter is the rightmost-edge mirror"
+			{
+				xMirror = M.get(i, columns-1); //mirror value is on 'same row' and last column
+				xValAccumalator = (-1*xMirror) + M.get(i, j+1);
+				Dx.put(i, j, xValAccumalator);
+			}
+			else if(M.rightEdge(i, j))// Dx calculation, value is the rightmost edge so our "assumed 1 filter is the leftmost-edge mirror"
+			{
+				xMirror = M.get(i, 0); //mirror value is on 'same row' and 0th column
+				xValAccumalator = (-1*M.get(i, j-1)) + xMirror;
+				Dx.put(i, j, xValAccumalator);
+			}
+			else// calculate the Dx value normally [-1, 0, 1] as the filter values exist -- no assuming values (not at critical edge)
+			{
+				xValAccumalator = (-1*M.get(i, j-1)) + M.get(i, j+1); //no edge case, -1*left of index + right of index = new value of index at Dx
+				Dx.put(i, j, xValAccumalator);
+			}
+			//End of Dx calculation
+			/*
+			* 
+			*/
+			// Start of Dy calculation
+			if(M.topEdge(i, j))// Dy Calculation, value is on the topmost edge so our assumed -1 filter is the bottommost-edge mirror"
+			{
+				yMirror = M.get(rows-1, j);//y Mirror for the '-1' counterpart on the filter will be on the bottommost edge on the same column
+				yValAccumalator = (-1*yMirror) + M.get(i+1, j);
+				Dy.put(i, j, yValAccumalator);
+			}
+			else if(M.bottomEdge(i, j))// Dy Calculation, value is on the bottommost edge so our assumed 1 filter is the topmost-edge mirror"
+			{
+				yMirror = M.get(0, j);// yMirror for the '1' counterpart is on the same column on the 0th row
+				yValAccumalator = (-1*M.get(i-1, j)) + yMirror;
+				Dy.put(i, j, yValAccumalator);
+			}
+			else// calculate the Dx value normally [-1, 0, 1] as the filter values exist -- no assuming values (not at critical edge)
+			{
+				yValAccumalator = -1*M.get(i-1, j) + M.get(i+1, j);
+				Dy.put(i, j, yValAccumalator);
+			}
+			// End of Dy calculation
+		}
+	}
+}
+
+#endif
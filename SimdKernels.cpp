@@ -0,0 +1,399 @@
+#ifndef SIMD_KERNELS_CPP
+#define SIMD_KERNELS_CPP
+
+/*
+* SSE4.1 and AVX2 row kernels for the filter K = [-1, 0, 1] on unsigned char input.
+* The kernels are compiled with per-function target attributes, so the program
+* still builds with a plain "g++ -std=c++14" and only executes the wider
+* instructions after simdLevel() has confirmed the CPU supports them.
+* On other compilers or architectures only SIMD_SCALAR is reported.
+*/
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONVOLUTION_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+
+/**
+* Instruction set levels the row kernels can be dispatched to
+*/
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE41, SIMD_AVX2 };
+
+/**
+* Description: Detects the widest instruction set the row kernels can use on this CPU
+* Implementation: Queries the CPU once through __builtin_cpu_supports and caches the answer
+* Preconditions: NONE
+* Postconditions: NONE
+* @params NONE
+* @returns SimdLevel, SIMD_AVX2, SIMD_SSE41 or SIMD_SCALAR
+*/
+SimdLevel simdLevel()
+{
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+	static const SimdLevel level = __builtin_cpu_supports("avx2") ? SIMD_AVX2
+		: __builtin_cpu_supports("sse4.1") ? SIMD_SSE41 : SIMD_SCALAR;
+	return level;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+/**
+* Description: Returns a printable name of a SimdLevel
+* @params level, the instruction set level
+* @returns const char*, "avx2", "sse4.1" or "scalar"
+*/
+const char * simdLevelName(SimdLevel level)
+{
+	switch(level)
+	{
+		case SIMD_AVX2: return "avx2";
+		case SIMD_SSE41: return "sse4.1";
+		default: return "scalar";
+	}
+}
+
+#ifdef CONVOLUTION_HAVE_X86_SIMD
+///////////////////////////////////////
+//SSE4.1 ROW KERNELS
+///////////////////////////////////////
+/**
+* Description: Calculates 16 gradients plus - minus from 16 bytes at each pointer
+* Implementation: Widens both halves of each load to 16 bit with _mm_cvtepu8_epi16
+* and subtracts them
+* @params plus, pointer to the values multiplied by the '1' filter value
+* @params minus, pointer to the values multiplied by the '-1' filter value
+* @params lo, receives the gradients of the first 8 values
+* @params hi, receives the gradients of the last 8 values
+* @returns NONE
+*/
+__attribute__((target("sse4.1")))
+inline void gradient16Sse41(const unsigned char * plus, const unsigned char * minus, __m128i & lo, __m128i & hi)
+{
+	__m128i p = _mm_loadu_si128((const __m128i *)plus);
+	__m128i m = _mm_loadu_si128((const __m128i *)minus);
+	lo = _mm_sub_epi16(_mm_cvtepu8_epi16(p), _mm_cvtepu8_epi16(m));
+	hi = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(p, 8)), _mm_cvtepu8_epi16(_mm_srli_si128(m, 8)));
+}
+
+/**
+* Description: Folds the 8 lanes of the min/max accumulators into lowest and greatest
+* @params vmin, the vector of lowest values found so far
+* @params vmax, the vector of greatest values found so far
+* @params lowest, the lowest value found so far, updated in place
+* @params greatest, the greatest value found so far, updated in place
+* @returns NONE
+*/
+__attribute__((target("sse4.1")))
+inline void reduceMinMaxSse41(__m128i vmin, __m128i vmax, short int & lowest, short int & greatest)
+{
+	short int lanesMin[8], lanesMax[8];
+	_mm_storeu_si128((__m128i *)lanesMin, vmin);
+	_mm_storeu_si128((__m128i *)lanesMax, vmax);
+	for(int k = 0; k < 8; k++)
+	{
+		lowest = std::min(lowest, lanesMin[k]);
+		greatest = std::max(greatest, lanesMax[k]);
+	}
+}
+
+/**
+* Description: Calculates 'count' Dx values starting at src[1] with SSE4.1
+* Implementation: Subtracts the 16 bytes at src+j-1 from the 16 bytes at src+j+1.
+* The leftover columns that do not fill a full vector are computed with scalar code.
+* Preconditions: src[0] through src[count+1] are readable
+* Postconditions: dst[1] through dst[count] hold right - left
+* @params src, pointer to the first element of the row in M
+* @params dst, pointer to the first element of the row in Dx
+* @params count, the number of interior columns
+* @returns NONE
+*/
+__attribute__((target("sse4.1")))
+void convolveInteriorDxSse41(const unsigned char * src, short int * dst, int count)
+{
+	int j = 1;
+	for(; j + 16 <= count + 1; j += 16)
+	{
+		__m128i lo, hi;
+		gradient16Sse41(src + j + 1, src + j - 1, lo, hi);
+		_mm_storeu_si128((__m128i *)(dst + j), lo);
+		_mm_storeu_si128((__m128i *)(dst + j + 8), hi);
+	}
+	for(; j <= count; j++)
+	{
+		dst[j] = src[j+1] - src[j-1];
+	}
+}
+
+/**
+* Description: Calculates one row of Dy with SSE4.1
+* Implementation: Subtracts 16 bytes of the row above from the row below.
+* The leftover columns are computed with scalar code.
+* Preconditions: above, below and dst point to at least 'columns' elements
+* Postconditions: dst holds below - above
+* @params above, pointer to the row in M multiplied by the '-1' filter value
+* @params below, pointer to the row in M multiplied by the '1' filter value
+* @params dst, pointer to the first element of the row in Dy
+* @params columns, the column size of the matrix
+* @returns NONE
+*/
+__attribute__((target("sse4.1")))
+void convolveRowDySse41(const unsigned char * above, const unsigned char * below, short int * dst, int columns)
+{
+	int j = 0;
+	for(; j + 16 <= columns; j += 16)
+	{
+		__m128i lo, hi;
+		gradient16Sse41(below + j, above + j, lo, hi);
+		_mm_storeu_si128((__m128i *)(dst + j), lo);
+		_mm_storeu_si128((__m128i *)(dst + j + 8), hi);
+	}
+	for(; j < columns; j++)
+	{
+		dst[j] = below[j] - above[j];
+	}
+}
+
+/**
+* Description: convolveInteriorDxSse41() that also tracks the min and max of the values it writes
+* Implementation: Keeps 8-lane min/max accumulators next to the gradient registers and
+* folds them into lowest/greatest once per row
+* @params src, pointer to the first element of the row in M
+* @params dst, pointer to the first element of the row in Dx
+* @params count, the number of interior columns
+* @params lowest, the lowest Dx value found so far, updated in place
+* @params greatest, the greatest Dx value found so far, updated in place
+* @returns NONE
+*/
+__attribute__((target("sse4.1")))
+void convolveInteriorDxMinMaxSse41(const unsigned char * src, short int * dst, int count, short int & lowest, short int & greatest)
+{
+	__m128i vmin = _mm_set1_epi16(lowest);
+	__m128i vmax = _mm_set1_epi16(greatest);
+	int j = 1;
+	for(; j + 16 <= count + 1; j += 16)
+	{
+		__m128i lo, hi;
+		gradient16Sse41(src + j + 1, src + j - 1, lo, hi);
+		_mm_storeu_si128((__m128i *)(dst + j), lo);
+		_mm_storeu_si128((__m128i *)(dst + j + 8), hi);
+		vmin = _mm_min_epi16(vmin, _mm_min_epi16(lo, hi));
+		vmax = _mm_max_epi16(vmax, _mm_max_epi16(lo, hi));
+	}
+	reduceMinMaxSse41(vmin, vmax, lowest, greatest);
+	for(; j <= count; j++)
+	{
+		dst[j] = src[j+1] - src[j-1];
+		lowest = std::min(lowest, dst[j]);
+		greatest = std::max(greatest, dst[j]);
+	}
+}
+
+/**
+* Description: convolveRowDySse41() that also tracks the min and max of the values it writes
+* @params above, pointer to the row in M multiplied by the '-1' filter value
+* @params below, pointer to the row in M multiplied by the '1' filter value
+* @params dst, pointer to the first element of the row in Dy
+* @params columns, the column size of the matrix
+* @params lowest, the lowest Dy value found so far, updated in place
+* @params greatest, the greatest Dy value found so far, updated in place
+* @returns NONE
+*/
+__attribute__((target("sse4.1")))
+void convolveRowDyMinMaxSse41(const unsigned char * above, const unsigned char * below, short int * dst, int columns, short int & lowest, short int & greatest)
+{
+	__m128i vmin = _mm_set1_epi16(lowest);
+	__m128i vmax = _mm_set1_epi16(greatest);
+	int j = 0;
+	for(; j + 16 <= columns; j += 16)
+	{
+		__m128i lo, hi;
+		gradient16Sse41(below + j, above + j, lo, hi);
+		_mm_storeu_si128((__m128i *)(dst + j), lo);
+		_mm_storeu_si128((__m128i *)(dst + j + 8), hi);
+		vmin = _mm_min_epi16(vmin, _mm_min_epi16(lo, hi));
+		vmax = _mm_max_epi16(vmax, _mm_max_epi16(lo, hi));
+	}
+	reduceMinMaxSse41(vmin, vmax, lowest, greatest);
+	for(; j < columns; j++)
+	{
+		dst[j] = below[j] - above[j];
+		lowest = std::min(lowest, dst[j]);
+		greatest = std::max(greatest, dst[j]);
+	}
+}
+
+///////////////////////////////////////
+//AVX2 ROW KERNELS
+///////////////////////////////////////
+/**
+* Description: Calculates 32 gradients plus - minus from 32 bytes at each pointer
+* Implementation: Widens each 16 byte half of the loads to 16 bit with
+* _mm256_cvtepu8_epi16 and subtracts them
+* @params plus, pointer to the values multiplied by the '1' filter value
+* @params minus, pointer to the values multiplied by the '-1' filter value
+* @params lo, receives the gradients of the first 16 values
+* @params hi, receives the gradients of the last 16 values
+* @returns NONE
+*/
+__attribute__((target("avx2")))
+inline void gradient32Avx2(const unsigned char * plus, const unsigned char * minus, __m256i & lo, __m256i & hi)
+{
+	__m256i p = _mm256_loadu_si256((const __m256i *)plus);
+	__m256i m = _mm256_loadu_si256((const __m256i *)minus);
+	lo = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(p)),
+		_mm256_cvtepu8_epi16(_mm256_castsi256_si128(m)));
+	hi = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(p, 1)),
+		_mm256_cvtepu8_epi16(_mm256_extracti128_si256(m, 1)));
+}
+
+/**
+* Description: Folds the 16 lanes of the min/max accumulators into lowest and greatest
+* @params vmin, the vector of lowest values found so far
+* @params vmax, the vector of greatest values found so far
+* @params lowest, the lowest value found so far, updated in place
+* @params greatest, the greatest value found so far, updated in place
+* @returns NONE
+*/
+__attribute__((target("avx2")))
+inline void reduceMinMaxAvx2(__m256i vmin, __m256i vmax, short int & lowest, short int & greatest)
+{
+	short int lanesMin[16], lanesMax[16];
+	_mm256_storeu_si256((__m256i *)lanesMin, vmin);
+	_mm256_storeu_si256((__m256i *)lanesMax, vmax);
+	for(int k = 0; k < 16; k++)
+	{
+		lowest = std::min(lowest, lanesMin[k]);
+		greatest = std::max(greatest, lanesMax[k]);
+	}
+}
+
+/**
+* Description: Calculates 'count' Dx values starting at src[1] with AVX2
+* Implementation: Subtracts the 32 bytes at src+j-1 from the 32 bytes at src+j+1.
+* The leftover columns that do not fill a full vector are computed with scalar code.
+* Preconditions: src[0] through src[count+1] are readable
+* Postconditions: dst[1] through dst[count] hold right - left
+* @params src, pointer to the first element of the row in M
+* @params dst, pointer to the first element of the row in Dx
+* @params count, the number of interior columns
+* @returns NONE
+*/
+__attribute__((target("avx2")))
+void convolveInteriorDxAvx2(const unsigned char * src, short int * dst, int count)
+{
+	int j = 1;
+	for(; j + 32 <= count + 1; j += 32)
+	{
+		__m256i lo, hi;
+		gradient32Avx2(src + j + 1, src + j - 1, lo, hi);
+		_mm256_storeu_si256((__m256i *)(dst + j), lo);
+		_mm256_storeu_si256((__m256i *)(dst + j + 16), hi);
+	}
+	for(; j <= count; j++)
+	{
+		dst[j] = src[j+1] - src[j-1];
+	}
+}
+
+/**
+* Description: Calculates one row of Dy with AVX2
+* Implementation: Subtracts 32 bytes of the row above from the row below.
+* The leftover columns are computed with scalar code.
+* Preconditions: above, below and dst point to at least 'columns' elements
+* Postconditions: dst holds below - above
+* @params above, pointer to the row in M multiplied by the '-1' filter value
+* @params below, pointer to the row in M multiplied by the '1' filter value
+* @params dst, pointer to the first element of the row in Dy
+* @params columns, the column size of the matrix
+* @returns NONE
+*/
+__attribute__((target("avx2")))
+void convolveRowDyAvx2(const unsigned char * above, const unsigned char * below, short int * dst, int columns)
+{
+	int j = 0;
+	for(; j + 32 <= columns; j += 32)
+	{
+		__m256i lo, hi;
+		gradient32Avx2(below + j, above + j, lo, hi);
+		_mm256_storeu_si256((__m256i *)(dst + j), lo);
+		_mm256_storeu_si256((__m256i *)(dst + j + 16), hi);
+	}
+	for(; j < columns; j++)
+	{
+		dst[j] = below[j] - above[j];
+	}
+}
+
+/**
+* Description: convolveInteriorDxAvx2() that also tracks the min and max of the values it writes
+* Implementation: Keeps 16-lane min/max accumulators next to the gradient registers and
+* folds them into lowest/greatest once per row
+* @params src, pointer to the first element of the row in M
+* @params dst, pointer to the first element of the row in Dx
+* @params count, the number of interior columns
+* @params lowest, the lowest Dx value found so far, updated in place
+* @params greatest, the greatest Dx value found so far, updated in place
+* @returns NONE
+*/
+__attribute__((target("avx2")))
+void convolveInteriorDxMinMaxAvx2(const unsigned char * src, short int * dst, int count, short int & lowest, short int & greatest)
+{
+	__m256i vmin = _mm256_set1_epi16(lowest);
+	__m256i vmax = _mm256_set1_epi16(greatest);
+	int j = 1;
+	for(; j + 32 <= count + 1; j += 32)
+	{
+		__m256i lo, hi;
+		gradient32Avx2(src + j + 1, src + j - 1, lo, hi);
+		_mm256_storeu_si256((__m256i *)(dst + j), lo);
+		_mm256_storeu_si256((__m256i *)(dst + j + 16), hi);
+		vmin = _mm256_min_epi16(vmin, _mm256_min_epi16(lo, hi));
+		vmax = _mm256_max_epi16(vmax, _mm256_max_epi16(lo, hi));
+	}
+	reduceMinMaxAvx2(vmin, vmax, lowest, greatest);
+	for(; j <= count; j++)
+	{
+		dst[j] = src[j+1] - src[j-1];
+		lowest = std::min(lowest, dst[j]);
+		greatest = std::max(greatest, dst[j]);
+	}
+}
+
+/**
+* Description: convolveRowDyAvx2() that also tracks the min and max of the values it writes
+* @params above, pointer to the row in M multiplied by the '-1' filter value
+* @params below, pointer to the row in M multiplied by the '1' filter value
+* @params dst, pointer to the first element of the row in Dy
+* @params columns, the column size of the matrix
+* @params lowest, the lowest Dy value found so far, updated in place
+* @params greatest, the greatest Dy value found so far, updated in place
+* @returns NONE
+*/
+__attribute__((target("avx2")))
+void convolveRowDyMinMaxAvx2(const unsigned char * above, const unsigned char * below, short int * dst, int columns, short int & lowest, short int & greatest)
+{
+	__m256i vmin = _mm256_set1_epi16(lowest);
+	__m256i vmax = _mm256_set1_epi16(greatest);
+	int j = 0;
+	for(; j + 32 <= columns; j += 32)
+	{
+		__m256i lo, hi;
+		gradient32Avx2(below + j, above + j, lo, hi);
+		_mm256_storeu_si256((__m256i *)(dst + j), lo);
+		_mm256_storeu_si256((__m256i *)(dst + j + 16), hi);
+		vmin = _mm256_min_epi16(vmin, _mm256_min_epi16(lo, hi));
+		vmax = _mm256_max_epi16(vmax, _mm256_max_epi16(lo, hi));
+	}
+	reduceMinMaxAvx2(vmin, vmax, lowest, greatest);
+	for(; j < columns; j++)
+	{
+		dst[j] = below[j] - above[j];
+		lowest = std::min(lowest, dst[j]);
+		greatest = std::max(greatest, dst[j]);
+	}
+}
+#endif
+
+#endif
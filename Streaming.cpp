@@ -0,0 +1,197 @@
+#ifndef STREAMING_CPP
+#define STREAMING_CPP
+
+#include <istream>
+#include <ostream>
+#include <vector>
+#include <cstring>
+#include "Convolution.cpp"
+
+/*
+* Streaming (out-of-core) convolution for matrices that do not fit in memory.
+* M is read one row at a time from any std::istream (a file or a pipe) as raw
+* unsigned char rows, and every Dx/Dy row is handed to a RowSink as soon as it is
+* known, so the memory used is a handful of rows no matter how many rows M has.
+*/
+
+///////////////////////////////////////
+//ROW SINKS
+///////////////////////////////////////
+/**
+* Receiver of the Dx or Dy rows produced by convolveStream()
+* Rows arrive in increasing order, except that Dy row 0 arrives last: it needs
+* the last row of M as its wrap-around neighbor, which is only known at the end.
+*/
+class RowSink
+{
+public:
+	virtual ~RowSink() {}
+
+	/**
+	* Description: Receives one finished row
+	* @params row, the row index in the output matrix
+	* @params values, pointer to the 'columns' values of the row, only valid during the call
+	* @params columns, the column size of the matrix
+	* @returns NONE
+	*/
+	virtual void writeRow(long row, const short int * values, int columns) = 0;
+};
+
+/**
+* RowSink that writes the rows as raw binary short ints to an output stream.
+* Every row is written at its own offset (row*columns*sizeof(short int)), so the
+* stream must be seekable (a file) for Dy, whose row 0 arrives last. Dx rows always
+* arrive in order and can be written to a pipe.
+*/
+class StreamRowSink : public RowSink
+{
+public:
+	StreamRowSink(std::ostream & out) : out(out), nextRow(0) {}
+
+	void writeRow(long row, const short int * values, int columns)
+	{
+		const long rowBytes = (long)columns*sizeof(short int);
+		if(row != nextRow)
+		{
+			out.seekp(row*rowBytes);
+		}
+		out.write((const char *)values, rowBytes);
+		nextRow = row + 1;
+		if(row == 0)
+		{
+			//go back to the end so later rows keep appending
+			out.seekp(0, std::ios::end);
+		}
+	}
+
+private:
+	std::ostream & out;
+	long nextRow;
+};
+
+/**
+* RowSink that stores the rows in a Matrix or a view of one, used when the output does fit in memory
+*/
+class MatrixRowSink : public RowSink
+{
+public:
+	MatrixRowSink(MatrixView<short int> D) : D(D) {}
+
+	void writeRow(long row, const short int * values, int columns)
+	{
+		std::memcpy(D.getRow(row), values, (long)columns*sizeof(short int));
+	}
+
+private:
+	MatrixView<short int> D;
+};
+
+///////////////////////////////////////
+//STREAMING CONVOLUTION
+///////////////////////////////////////
+/**
+* Description: Reads one row of M from the input stream
+* @params in, the input stream
+* @params row, receives the 'columns' bytes of the row
+* @params columns, the column size of the matrix
+* @returns bool, true if a full row was read, false at the end of the stream
+*/
+bool readRow(std::istream & in, unsigned char * row, int columns)
+{
+	in.read((char *)row, columns);
+	if(in.gcount() == columns)
+	{
+		return true;
+	}
+	if(in.gcount() > 0)
+	{
+		std::cout << "ERROR: incomplete last row of " << in.gcount() << " bytes, expected "
+		<< columns << " bytes, the row is ignored" << std::endl;
+	}
+	return false;
+}
+
+/**
+* Description: Convolves a matrix M streamed row by row with the filter [-1, 0, 1]
+* Implementation: Keeps a 3-row ring buffer (rows i-1, i and i+1) of M. Dx of a row is
+* emitted as soon as the row is read, Dy of row i as soon as row i+1 is read. The
+* number of rows is only known once the stream ends, so rows 0 and 1 of M are kept:
+* the last row's '1' neighbor wraps around to row 0, and Dy row 0 (row 1 - last row)
+* is emitted after the last row has been read. The min/max of Dx and Dy are
+* accumulated in the same sweep with the fused row kernels, since the outputs may
+* never be in memory to run getMin()/getMax() on.
+* Memory use is 5 rows of M plus 2 rows of output, independent of the number of rows.
+* Preconditions: in holds rows*columns raw unsigned char values, row after row
+* Postconditions: every row of Dx and Dy has been written to dxSink and dySink
+* @params in, the input stream holding M
+* @params columns, the column size of M
+* @params dxSink, receives the rows of Dx
+* @params dySink, receives the rows of Dy
+* @params rows, receives the number of rows read from the stream
+* @return GradientExtrema, the min and max values of Dx and Dy
+*/
+GradientExtrema convolveStream(std::istream & in, int columns, RowSink & dxSink, RowSink & dySink, long & rows)
+{
+	FusedRowKernels kernels = fusedRowKernels(simdLevel());
+	std::vector<unsigned char> buffer(5*(long)columns);
+	std::vector<short int> dx(columns);
+	std::vector<short int> dy(columns);
+
+	//rows 0 and 1 of M are kept for the wrap-around, the other three buffers form the ring
+	unsigned char * first = &buffer[0];
+	unsigned char * second = first + columns;
+	unsigned char * above = second + columns;
+	unsigned char * current = above + columns;
+	unsigned char * below = current + columns;
+
+	rows = 0;
+	if(!readRow(in, current, columns))
+	{
+		return kernels.extrema;
+	}
+	std::memcpy(first, current, columns);
+	std::memcpy(second, current, columns);
+
+	for(long i = 0; ; i++)
+	{
+		//Dx only needs the current row
+		kernels.dxRow(current, &dx[0], columns);
+		dxSink.writeRow(i, &dx[0], columns);
+
+		if(!readRow(in, below, columns))
+		{
+			rows = i + 1;
+			break;
+		}
+		if(i == 0)
+		{
+			std::memcpy(second, below, columns);
+		}
+		else
+		{
+			kernels.dyRow(above, below, &dy[0], columns);
+			dySink.writeRow(i, &dy[0], columns);
+		}
+
+		//rotate the ring: current becomes above, below becomes current
+		unsigned char * spare = above;
+		above = current;
+		current = below;
+		below = spare;
+	}
+
+	//bottom border: the '1' neighbor of the last row wraps around to row 0
+	if(rows > 1)
+	{
+		kernels.dyRow(above, first, &dy[0], columns);
+		dySink.writeRow(rows-1, &dy[0], columns);
+	}
+
+	//top border: the '-1' neighbor of row 0 wraps around to the last row
+	kernels.dyRow(current, second, &dy[0], columns);
+	dySink.writeRow(0, &dy[0], columns);
+
+	return kernels.extrema;
+}
+
+#endif
@@ -0,0 +1,513 @@
+#ifndef SUMMED_AREA_TABLE_CPP
+#define SUMMED_AREA_TABLE_CPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "MatrixView.cpp"
+#include "ThreadPool.cpp"
+
+/*
+* Summed-area tables (integral images) for box filters of any radius at a constant cost
+* per pixel. Entry (i, j) of the table is the sum of the rows [0, i) and columns [0, j)
+* of M, so the sum of any rectangle is four lookups.
+*
+* Boxes wrap around the edges exactly like WrapBorder and convolve(): the sum of the
+* rows [a, b) of M, for any a and b, is S(b) - S(a), where S(k) = q*S(n) + S(m) for
+* k = q*n + m, 0 <= m < n, extends the prefix sums periodically. A box wider than the
+* matrix therefore counts the pixels it covers more than once, the same as a
+* convolution with a kernel of that size would.
+*
+* The table is built with 32 bit sums when the sum of the whole matrix fits in them,
+* half the memory traffic of 64 bit sums, and with 64 bit sums otherwise. For unsigned
+* char that is up to 16.8M pixels, 4096x4096.
+*/
+
+/**
+* The sums of an element type, Narrow when the whole matrix fits in it, Wide otherwise,
+* and the largest magnitude one element can have. Defined for the 8 and 16 bit integer
+* types of M and of the compact and short int results.
+*/
+template <typename T> struct SummedAreaTypes;
+template <> struct SummedAreaTypes<unsigned char> { typedef uint32_t Narrow; typedef uint64_t Wide; static const long MAGNITUDE = 255; };
+template <> struct SummedAreaTypes<signed char> { typedef int32_t Narrow; typedef int64_t Wide; static const long MAGNITUDE = 128; };
+template <> struct SummedAreaTypes<unsigned short int> { typedef uint32_t Narrow; typedef uint64_t Wide; static const long MAGNITUDE = 65535; };
+template <> struct SummedAreaTypes<short int> { typedef int32_t Narrow; typedef int64_t Wide; static const long MAGNITUDE = 32768; };
+
+/**
+* Description: Divides rounding toward negative infinity
+* @params value, the dividend
+* @params size, the divisor, greater than 0
+* @params remainder, receives value - quotient*size, in [0, size)
+* @returns long, the quotient
+*/
+inline long floorDivide(long value, long size, long & remainder)
+{
+	long quotient = value / size;
+	remainder = value % size;
+	if(remainder < 0)
+	{
+		remainder += size;
+		quotient--;
+	}
+	return quotient;
+}
+
+template <typename T>
+class SummedAreaTable
+{
+public:
+	typedef typename SummedAreaTypes<T>::Narrow Narrow;
+	typedef typename SummedAreaTypes<T>::Wide Wide;
+
+	SummedAreaTable();
+
+	///////////////////////////////////////
+	//BUILDING
+	///////////////////////////////////////
+	void build(MatrixView<T> M);
+	void build(MatrixView<T> M, ThreadPool & pool);
+
+	///////////////////////////////////////
+	//GETTERS
+	///////////////////////////////////////
+	int getRows() const;
+	int getColumns() const;
+	bool isWide() const;
+
+	///////////////////////////////////////
+	//QUERIES
+	///////////////////////////////////////
+	Wide rectangleSum(int row, int column, int rows, int columns) const;
+	Wide boxSum(int row, int column, int radius) const;
+	double boxMean(int row, int column, int radius) const;
+
+	/**
+	* Description: Calls visit(table) with the table as Narrow or Wide entries, so a
+	* whole-image pass can pick its loop once instead of for every pixel
+	*/
+	template <typename Visitor>
+	void visit(Visitor visitor) const
+	{
+		if(wide.empty())
+		{
+			visitor(narrow.data());
+		}
+		else
+		{
+			visitor(wide.data());
+		}
+	}
+
+	/**
+	* Description: The prefix sum S(i, j) of the rows [0, i) and columns [0, j), for i and
+	* j inside [0, rows] x [0, columns], the sum of a rectangle inside M is four of them
+	* @params table, the entries, from visit()
+	*/
+	template <typename S>
+	Wide prefix(const S * table, int i, int j) const
+	{
+		return (Wide)table[(long)i*(columns + 1) + j];
+	}
+
+	/**
+	* Description: S(i, j) for any i and j, extended periodically as described above
+	* @params table, the entries, from visit()
+	*/
+	template <typename S>
+	Wide periodicPrefix(const S * table, long i, long j) const
+	{
+		long rowRemainder, columnRemainder;
+		const Wide rowPeriods = (Wide)floorDivide(i, rows, rowRemainder);
+		const Wide columnPeriods = (Wide)floorDivide(j, columns, columnRemainder);
+		return rowPeriods*columnPeriods*prefix(table, rows, columns) + rowPeriods*prefix(table, rows, (int)columnRemainder)
+			+ columnPeriods*prefix(table, (int)rowRemainder, columns) + prefix(table, (int)rowRemainder, (int)columnRemainder);
+	}
+
+private:
+	template <typename S>
+	void buildRows(MatrixView<T> M, S * table, const S * above, int firstRow, int endRow);
+
+	template <typename S>
+	void buildParallel(MatrixView<T> M, S * table, ThreadPool & pool);
+
+	void allocate(MatrixView<T> M);
+
+	int rows;
+	int columns;
+
+	/**
+	* The (rows + 1) x (columns + 1) entries, row 0 and column 0 are 0, only one of the two is used
+	*/
+	std::vector<Narrow> narrow;
+	std::vector<Wide> wide;
+};
+
+template <typename T>
+SummedAreaTable<T>::SummedAreaTable() : rows(0), columns(0)
+{
+}
+
+/**
+* Description: Sizes the table for M, with Narrow entries if every sum fits in them
+*/
+template <typename T>
+void SummedAreaTable<T>::allocate(MatrixView<T> M)
+{
+	rows = M.getRows();
+	columns = M.getColumns();
+	const long entries = (long)(rows + 1)*(columns + 1);
+	const double largest = (double)rows*columns*SummedAreaTypes<T>::MAGNITUDE;
+	if(largest <= (double)std::numeric_limits<Narrow>::max())
+	{
+		wide.clear();
+		wide.shrink_to_fit();
+		narrow.assign(entries, 0);
+	}
+	else
+	{
+		narrow.clear();
+		narrow.shrink_to_fit();
+		wide.assign(entries, 0);
+	}
+}
+
+/**
+* Description: Fills the table rows firstRow + 1 to endRow from the rows [firstRow, endRow) of M
+* Implementation: A running sum along each row of M, added to the table row above
+* @params above, the row the sums of row firstRow start from, table row firstRow or zeros
+*/
+template <typename T>
+template <typename S>
+void SummedAreaTable<T>::buildRows(MatrixView<T> M, S * table, const S * above, int firstRow, int endRow)
+{
+	const long stride = columns + 1;
+	for(int i = firstRow; i < endRow; i++)
+	{
+		const T * line = M.getRow(i);
+		S * current = table + (i + 1)*stride;
+		S running = 0;
+		current[0] = 0;
+		for(int j = 0; j < columns; j++)
+		{
+			running += (S)line[j];
+			current[j + 1] = above[j + 1] + running;
+		}
+		above = current;
+	}
+}
+
+/**
+* Description: Builds the table for M
+* @params M, the matrix, the table keeps no reference to it
+* @returns NONE
+*/
+template <typename T>
+void SummedAreaTable<T>::build(MatrixView<T> M)
+{
+	allocate(M);
+	if(wide.empty())
+	{
+		buildRows(M, narrow.data(), (const Narrow *)narrow.data(), 0, rows);
+	}
+	else
+	{
+		buildRows(M, wide.data(), (const Wide *)wide.data(), 0, rows);
+	}
+}
+
+/**
+* Description: build() using every thread of the pool
+* Implementation: Every band of rows first sums its rows as if it were the top of M,
+* starting from a row of zeros, then the last table row of every band is added to the
+* rows of all bands below it. Both passes write rows of their own band only.
+*/
+template <typename T>
+template <typename S>
+void SummedAreaTable<T>::buildParallel(MatrixView<T> M, S * table, ThreadPool & pool)
+{
+	const int bands = std::max(1, std::min(rows, pool.getThreads()));
+	const long stride = columns + 1;
+	auto bandStartRow = [&](int band) { return (int)((long)rows*band / bands); };
+
+	pool.run(bands, [&](int band)
+	{
+		const std::vector<S> zeros(stride, 0);
+		buildRows(M, table, zeros.data(), bandStartRow(band), bandStartRow(band + 1));
+	});
+
+	//the offset of every band is the sum of the last rows of the bands above it
+	std::vector<std::vector<S> > offsets(bands, std::vector<S>(stride, 0));
+	for(int band = 1; band < bands; band++)
+	{
+		const S * last = table + (long)bandStartRow(band)*stride;
+		for(long j = 0; j < stride; j++)
+		{
+			offsets[band][j] = offsets[band - 1][j] + last[j];
+		}
+	}
+
+	pool.run(bands, [&](int band)
+	{
+		if(band == 0)
+		{
+			return;
+		}
+		const std::vector<S> & offset = offsets[band];
+		for(int i = bandStartRow(band) + 1; i <= bandStartRow(band + 1); i++)
+		{
+			S * current = table + (long)i*stride;
+			for(long j = 0; j < stride; j++)
+			{
+				current[j] += offset[j];
+			}
+		}
+	});
+}
+
+/**
+* Description: Builds the table for M on the pool
+* @params M, the matrix, the table keeps no reference to it
+* @params pool, the thread pool
+* @returns NONE
+*/
+template <typename T>
+void SummedAreaTable<T>::build(MatrixView<T> M, ThreadPool & pool)
+{
+	allocate(M);
+	if(wide.empty())
+	{
+		buildParallel(M, narrow.data(), pool);
+	}
+	else
+	{
+		buildParallel(M, wide.data(), pool);
+	}
+}
+
+template <typename T>
+int SummedAreaTable<T>::getRows() const
+{
+	return rows;
+}
+
+template <typename T>
+int SummedAreaTable<T>::getColumns() const
+{
+	return columns;
+}
+
+/**
+* Description: True if the table holds 64 bit sums, because the 32 bit ones could overflow
+*/
+template <typename T>
+bool SummedAreaTable<T>::isWide() const
+{
+	return !wide.empty();
+}
+
+/**
+* Description: The sum of a rectangle, wrapping around the edges
+* @params row, column, the top-left corner, can be outside M
+* @params rows, columns, the size, can be larger than M
+* @returns Wide, the sum
+*/
+template <typename T>
+typename SummedAreaTable<T>::Wide SummedAreaTable<T>::rectangleSum(int row, int column, int rows, int columns) const
+{
+	Wide sum = 0;
+	visit([&](const auto * table)
+	{
+		const long bottom = (long)row + rows;
+		const long right = (long)column + columns;
+		sum = this->periodicPrefix(table, bottom, right) - this->periodicPrefix(table, row, right)
+			- this->periodicPrefix(table, bottom, column) + this->periodicPrefix(table, row, column);
+	});
+	return sum;
+}
+
+/**
+* Description: The sum of the (2*radius + 1) x (2*radius + 1) box centered on a pixel
+*/
+template <typename T>
+typename SummedAreaTable<T>::Wide SummedAreaTable<T>::boxSum(int row, int column, int radius) const
+{
+	return rectangleSum(row - radius, column - radius, 2*radius + 1, 2*radius + 1);
+}
+
+/**
+* Description: The mean of the box centered on a pixel
+*/
+template <typename T>
+double SummedAreaTable<T>::boxMean(int row, int column, int radius) const
+{
+	const double side = 2.0*radius + 1.0;
+	return (double)boxSum(row, column, radius) / (side*side);
+}
+
+///////////////////////////////////////
+//WHOLE-IMAGE BOX FILTERS
+///////////////////////////////////////
+/**
+* Description: Converts a box sum to the output type, integers rounded to the nearest,
+* halves away from zero as std::llround() but without its call
+*/
+template <typename Out>
+inline Out boxOutput(double value, std::true_type)
+{
+	return (value >= 0.0) ? (Out)(long long)(value + 0.5) : (Out)-(long long)(0.5 - value);
+}
+
+template <typename Out>
+inline Out boxOutput(double value, std::false_type)
+{
+	return (Out)value;
+}
+
+/**
+* Description: Box sums or means of the rows [firstRow, endRow) of the image
+* Implementation: A box inside M is four plain lookups, only the boxes that reach past
+* an edge, the rows within radius of the top or bottom and the columns within radius of
+* the sides, fold their corners with periodicPrefix()
+* @params table, the summed-area table of M and its entries
+* @params out, the result, the size of M
+* @params radius, the box radius
+* @params area, 1 for the sums, (2*radius+1)^2 for the means, a division rather than a
+* multiplication by its inverse so a mean that is exactly a half rounds as it should
+* @params firstRow, endRow, the rows to compute
+* @returns NONE
+*/
+template <typename T, typename S, typename Out>
+void boxFilterRows(const SummedAreaTable<T> & table, const S * entries, MatrixView<Out> out, int radius, double area, int firstRow, int endRow)
+{
+	typedef typename SummedAreaTable<T>::Wide Wide;
+	const int rows = table.getRows();
+	const int columns = table.getColumns();
+	const int side = 2*radius + 1;
+	const int firstInside = std::min(radius, columns);
+	const int endInside = std::max(firstInside, columns - radius);
+	const typename std::is_integral<Out>::type integral{};
+
+	for(int i = firstRow; i < endRow; i++)
+	{
+		Out * line = out.getRow(i);
+		const bool rowInside = i - radius >= 0 && i + radius < rows;
+		auto folded = [&](int j)
+		{
+			const long top = (long)i - radius;
+			const long left = (long)j - radius;
+			const Wide sum = table.periodicPrefix(entries, top + side, left + side) - table.periodicPrefix(entries, top, left + side)
+				- table.periodicPrefix(entries, top + side, left) + table.periodicPrefix(entries, top, left);
+			line[j] = boxOutput<Out>((double)sum / area, integral);
+		};
+		if(!rowInside)
+		{
+			for(int j = 0; j < columns; j++)
+			{
+				folded(j);
+			}
+			continue;
+		}
+		for(int j = 0; j < firstInside; j++)
+		{
+			folded(j);
+		}
+		const S * top = entries + (long)(i - radius)*(columns + 1);
+		const S * bottom = entries + (long)(i + radius + 1)*(columns + 1);
+		for(int j = firstInside; j < endInside; j++)
+		{
+			const Wide sum = (Wide)bottom[j + radius + 1] - (Wide)top[j + radius + 1] - (Wide)bottom[j - radius] + (Wide)top[j - radius];
+			line[j] = boxOutput<Out>((double)sum / area, integral);
+		}
+		for(int j = endInside; j < columns; j++)
+		{
+			folded(j);
+		}
+	}
+}
+
+/**
+* Description: The box sum of every pixel, the same as convolving M with a
+* (2*radius + 1) x (2*radius + 1) kernel of ones with WrapBorder, at a cost per pixel
+* that does not depend on the radius
+* Preconditions: out has the size of the table
+* @params table, the summed-area table of M
+* @params out, the box sums, the caller chooses a type they fit in
+* @params radius, the box radius, 0 or more
+* @returns NONE
+*/
+template <typename T, typename Out>
+void boxSum(const SummedAreaTable<T> & table, MatrixView<Out> out, int radius)
+{
+	table.visit([&](const auto * entries)
+	{
+		boxFilterRows(table, entries, out, radius, 1.0, 0, table.getRows());
+	});
+}
+
+/**
+* Description: The box mean of every pixel, rounded to the nearest for integer results
+* Preconditions: out has the size of the table
+* @params table, the summed-area table of M
+* @params out, the box means
+* @params radius, the box radius, 0 or more
+* @returns NONE
+*/
+template <typename T, typename Out>
+void boxMean(const SummedAreaTable<T> & table, MatrixView<Out> out, int radius)
+{
+	const double side = 2.0*radius + 1.0;
+	table.visit([&](const auto * entries)
+	{
+		boxFilterRows(table, entries, out, radius, side*side, 0, table.getRows());
+	});
+}
+
+/**
+* Description: boxMean() on the row bands of the pool
+*/
+template <typename T, typename Out>
+void boxMean(const SummedAreaTable<T> & table, MatrixView<Out> out, int radius, ThreadPool & pool)
+{
+	const int rows = table.getRows();
+	const int bands = std::max(1, std::min(rows, pool.getThreads()));
+	const double side = 2.0*radius + 1.0;
+	table.visit([&](const auto * entries)
+	{
+		pool.run(bands, [&](int band)
+		{
+			boxFilterRows(table, entries, out, radius, side*side, (int)((long)rows*band / bands), (int)((long)rows*(band + 1) / bands));
+		});
+	});
+}
+
+/**
+* Description: Local-mean normalization, every pixel minus the mean of the box around it
+* Implementation: boxMean() into out, then the pixels of M minus it
+* Preconditions: M and out have the size of the table, which was built from M
+* @params M, the matrix
+* @params table, the summed-area table of M
+* @params out, M minus its box means, rounded to the nearest for integer results
+* @params radius, the box radius
+* @returns NONE
+*/
+template <typename T, typename Out>
+void subtractLocalMean(MatrixView<T> M, const SummedAreaTable<T> & table, MatrixView<Out> out, int radius)
+{
+	static_assert(std::is_signed<Out>::value, "the difference from the mean needs a signed result");
+	boxMean(table, out, radius);
+	for(int i = 0; i < M.getRows(); i++)
+	{
+		const T * line = M.getRow(i);
+		Out * result = out.getRow(i);
+		for(int j = 0; j < M.getColumns(); j++)
+		{
+			result[j] = (Out)(line[j] - result[j]);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef THREAD_POOL_CPP
+#define THREAD_POOL_CPP
+
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <algorithm>
+
+/*
+* Persistent pool of worker threads used by the parallel convolution engine and the
+* parallel min/max reductions. The workers are started once and then sleep between
+* jobs, so running a job does not pay for thread creation.
+* An exception thrown by a task, on a worker or on the calling thread, is caught, the tasks
+* not started yet are skipped, and run() rethrows it once the tasks already running are done.
+* The pool runs one job at a time: run() must not be called from two threads at once.
+*/
+class ThreadPool
+{
+public:
+	///////////////////////////////////////
+	//CONSTRUCTORS AND DESTRUCTORS
+	///////////////////////////////////////
+	ThreadPool(int threads);
+	~ThreadPool();
+
+	///////////////////////////////////////
+	//GETTERS
+	///////////////////////////////////////
+	int getThreads() const;
+
+	///////////////////////////////////////
+	//JOB EXECUTION
+	///////////////////////////////////////
+	void run(int tasks, const std::function<void(int)> & task);
+
+private:
+	///////////////////////////////////////
+	//PRIVATE DATA VARIABLES
+	///////////////////////////////////////
+	/**
+	* The worker threads, the thread calling run() works as one more thread
+	*/
+	std::vector<std::thread> workers;
+
+	/**
+	* Guards every variable below and the two condition variables
+	*/
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	/**
+	* The job of the current run() call, nullptr between jobs
+	*/
+	const std::function<void(int)> * job;
+
+	/**
+	* Next task index to hand out, number of tasks in the job and tasks not finished yet
+	*/
+	int nextTask;
+	int taskCount;
+	int pending;
+
+	/**
+	* The first exception thrown by a task of the current job, rethrown by run()
+	*/
+	std::exception_ptr failure;
+
+	/**
+	* Incremented for every job so sleeping workers can tell a new job from a spurious wakeup
+	*/
+	unsigned long generation;
+
+	/**
+	* Set by the destructor to make the workers exit
+	*/
+	bool stopping;
+
+	/////////////////////////////////////////
+	//PRIVATE HELPER METHODS
+	/////////////////////////////////////////
+	void workerLoop();
+	void runTasks();
+};
+
+///////////////////////////////////////
+//CONSTRUCTORS AND DESTRUCTORS
+///////////////////////////////////////
+/**
+* Constructor
+* Description: Starts the worker threads
+* Implementation: Starts threads-1 workers, since the caller of run() also executes tasks.
+* A thread count below 1 uses std::thread::hardware_concurrency().
+* Preconditions: NONE
+* Postconditions: The workers are asleep waiting for a job
+* @params threads, the total number of threads executing a job
+*/
+ThreadPool::ThreadPool(int threads)
+	: job(nullptr), nextTask(0), taskCount(0), pending(0), generation(0), stopping(false)
+{
+	if(threads < 1)
+	{
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for(int t = 1; t < threads; t++)
+	{
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+/**
+* Destructor
+* Description: Stops and joins the worker threads
+* Preconditions: No run() call is in progress
+* Postconditions: All workers have exited
+*/
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(size_t t = 0; t < workers.size(); t++)
+	{
+		workers[t].join();
+	}
+}
+
+///////////////////////////////////////
+//GETTERS
+///////////////////////////////////////
+/**
+* Description: Returns the number of threads that execute a job, including the caller of run()
+* @params NONE
+* @returns int, the thread count
+*/
+int ThreadPool::getThreads() const
+{
+	return (int)workers.size() + 1;
+}
+
+///////////////////////////////////////
+//JOB EXECUTION
+///////////////////////////////////////
+/**
+* Description: Runs task(0) through task(tasks-1) on the pool and waits for all of them
+* Implementation: Publishes the job, wakes the workers and executes tasks on the calling
+* thread as well until every task has been claimed, then waits for the stragglers.
+* Throws: the first exception thrown by a task, after every task that started has finished
+* Preconditions: Not called from inside a task of the same pool, nor from two threads at once
+* Postconditions: Every task has finished or was skipped after a task threw
+* @params tasks, the number of tasks
+* @params task, callable with the task index
+* @returns NONE
+*/
+void ThreadPool::run(int tasks, const std::function<void(int)> & task)
+{
+	if(tasks < 1)
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		job = &task;
+		nextTask = 0;
+		taskCount = tasks;
+		pending = tasks;
+		failure = nullptr;
+		generation++;
+	}
+	wake.notify_all();
+
+	runTasks();
+
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [this] { return pending == 0; });
+	job = nullptr;
+	std::exception_ptr thrown = failure;
+	failure = nullptr;
+	guard.unlock();
+	if(thrown)
+	{
+		std::rethrow_exception(thrown);
+	}
+}
+
+/////////////////////////////////////////
+//PRIVATE HELPER METHODS
+/////////////////////////////////////////
+/**
+* Description: Body of every worker thread
+* Implementation: Sleeps until a new job is published or the pool is stopping,
+* then helps executing the job
+* @params NONE
+* @returns NONE
+*/
+void ThreadPool::workerLoop()
+{
+	unsigned long seen = 0;
+	while(true)
+	{
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [this, seen] { return stopping || generation != seen; });
+			if(stopping)
+			{
+				return;
+			}
+			seen = generation;
+		}
+		runTasks();
+	}
+}
+
+/**
+* Description: Claims and executes tasks of the current job until none are left
+* Implementation: A task that throws is recorded in failure, and the tasks nobody has
+* claimed yet are dropped from the job so run() only waits for the ones running
+* @params NONE
+* @returns NONE
+*/
+void ThreadPool::runTasks()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	while(job != nullptr && nextTask < taskCount)
+	{
+		const int index = nextTask++;
+		const std::function<void(int)> * current = job;
+		guard.unlock();
+
+		std::exception_ptr thrown;
+		try
+		{
+			(*current)(index);
+		}
+		catch(...)
+		{
+			thrown = std::current_exception();
+		}
+
+		guard.lock();
+		if(thrown)
+		{
+			if(!failure)
+			{
+				failure = thrown;
+			}
+			pending -= taskCount - nextTask;
+			nextTask = taskCount;
+		}
+		if(--pending == 0)
+		{
+			done.notify_all();
+		}
+	}
+}
+
+#endif
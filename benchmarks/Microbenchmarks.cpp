@@ -0,0 +1,685 @@
+#include "Matrix.cpp"
+#include "NaiveConvolution.cpp"
+#include "Convolution.cpp"
+#include "KernelConvolution.cpp"
+#include "Gradient.cpp"
+#include "Batch.cpp"
+#include "Streaming.cpp"
+#include "IncrementalConvolution.cpp"
+#include "CompactConvolution.cpp"
+#include "GradientHistogram.cpp"
+#include "SummedAreaTable.cpp"
+#include "MatrixExpression.cpp"
+#include "CommandLine.cpp"
+#include "Benchmark.cpp"
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+
+/*
+* Microbenchmarks of every engine, kernel and border variant on square shapes from 64x64
+* to 16Kx16K and on skewed 1xN, Nx1, 2xN and Nx2 strips, in the spirit of Google Benchmark:
+* every case is warmed up once, then repeated until it has run for --min-time seconds, and
+* the median, min and p99 times are reported with the throughput of the median run.
+*
+* Regression tracking: --csv FILE writes the results, --baseline FILE compares the medians
+* with an earlier --csv file and fails (exit code 1) when a case got slower than the
+* tolerance allows.
+*/
+
+///////////////////////////////////////
+//BUFFERS
+///////////////////////////////////////
+/**
+* The matrices of one shape, shared by all cases. The ones only some cases need are
+* allocated the first time such a case runs.
+*/
+struct BenchmarkData
+{
+	BenchmarkData(int rows, int columns, uint64_t seed, ThreadPool & pool)
+		: rows(rows), columns(columns), pool(pool), M(rows, columns, ghostLayout(), FILL_NONE),
+		Dx(rows, columns, paddedLayout(), FILL_NONE), Dy(rows, columns, paddedLayout(), FILL_NONE)
+	{
+		M.fillRand(seed, pool);
+	}
+
+	static MatrixLayout paddedLayout()
+	{
+		MatrixLayout layout;
+		layout.padRows = true;
+		return layout;
+	}
+
+	//every engine can read an M with ghost cells, only the ghost engine uses them
+	static MatrixLayout ghostLayout()
+	{
+		MatrixLayout layout = paddedLayout();
+		layout.ghost = 1;
+		return layout;
+	}
+
+	void needGradient()
+	{
+		if(!magnitude)
+		{
+			magnitude.reset(new Matrix<short int>(rows, columns, paddedLayout(), FILL_NONE));
+			orientation.reset(new Matrix<unsigned char>(rows, columns, paddedLayout(), FILL_NONE));
+		}
+	}
+
+	void needFrames(int count)
+	{
+		if((int)frames.size() != count)
+		{
+			const long elements = (long)count*rows*columns;
+			frameInput.assign(elements, 0);
+			frameDx.assign(elements, 0);
+			frameDy.assign(elements, 0);
+			const uint64_t mixedSeed = mixRandomBits(1);
+			pool.run(count*rows, [&](int row)
+			{
+				fillRandomRow(&frameInput[(long)row*columns], columns, mixedSeed, row);
+			});
+			frames = frameViews(&frameInput[0], count, rows, columns);
+			framesDx = frameViews(&frameDx[0], count, rows, columns);
+			framesDy = frameViews(&frameDy[0], count, rows, columns);
+		}
+	}
+
+	void needStream()
+	{
+		if(stream.empty())
+		{
+			for(int i = 0; i < rows; i++)
+			{
+				stream.append((const char *)M.view().getRow(i), columns);
+			}
+		}
+	}
+
+	/**
+	* M in a wider element type and its results, for the typed kernel cases
+	*/
+	template <typename T>
+	struct TypedBuffers
+	{
+		TypedBuffers(int rows, int columns) : M(rows, columns, paddedLayout(), FILL_NONE),
+			Dx(rows, columns, paddedLayout(), FILL_NONE), Dy(rows, columns, paddedLayout(), FILL_NONE)
+		{
+			M.fillRand(1);
+		}
+
+		Matrix<T> M;
+		Matrix<typename ConvolutionTypes<T>::Output> Dx;
+		Matrix<typename ConvolutionTypes<T>::Output> Dy;
+	};
+
+	template <typename T>
+	TypedBuffers<T> & needTyped(std::unique_ptr<TypedBuffers<T> > & buffers)
+	{
+		if(!buffers)
+		{
+			buffers.reset(new TypedBuffers<T>(rows, columns));
+		}
+		return *buffers;
+	}
+
+	void needCompact()
+	{
+		if(!compactDx)
+		{
+			compactDx.reset(new Matrix<signed char>(rows, columns, paddedLayout(), FILL_NONE));
+			compactDy.reset(new Matrix<signed char>(rows, columns, paddedLayout(), FILL_NONE));
+			compactDxDy.reset(new Matrix<signed char>(rows, 2*columns, paddedLayout(), FILL_NONE));
+		}
+	}
+
+	void needBoxFilter()
+	{
+		if(!boxed)
+		{
+			table.build(M.view(), pool);
+			boxed.reset(new Matrix<unsigned char>(rows, columns, paddedLayout(), FILL_NONE));
+		}
+	}
+
+	//Dx and Dy of their own, the other cases leave the wider Sobel and Scharr results in Dx and Dy
+	void needStatistics()
+	{
+		if(!statsDx)
+		{
+			statsDx.reset(new Matrix<short int>(rows, columns, paddedLayout(), FILL_NONE));
+			statsDy.reset(new Matrix<short int>(rows, columns, paddedLayout(), FILL_NONE));
+			convolveSimd(M, *statsDx, *statsDy);
+		}
+	}
+
+	//a 64x64 block in the middle and the bottom-right pixel, whose halo wraps around
+	void needDirty()
+	{
+		if(dirty.isEmpty())
+		{
+			convolveSimd(M, Dx, Dy);
+			counts.build(Dx, Dy);
+			dirty.add(rows/2 - 32, columns/2 - 32, 64, 64);
+			dirty.add(rows-1, columns-1, 1, 1);
+		}
+	}
+
+	int rows;
+	int columns;
+	ThreadPool & pool;
+	Matrix<unsigned char> M;
+	Matrix<short int> Dx;
+	Matrix<short int> Dy;
+	std::unique_ptr<Matrix<short int> > magnitude;
+	std::unique_ptr<Matrix<unsigned char> > orientation;
+	std::vector<unsigned char> frameInput;
+	std::vector<short int> frameDx;
+	std::vector<short int> frameDy;
+	std::vector<MatrixView<unsigned char> > frames;
+	std::vector<MatrixView<short int> > framesDx;
+	std::vector<MatrixView<short int> > framesDy;
+	std::string stream;
+	DirtyRegions dirty;
+	ExtremaCounts counts;
+	SummedAreaTable<unsigned char> table;
+	std::unique_ptr<Matrix<unsigned char> > boxed;
+	std::unique_ptr<Matrix<short int> > statsDx;
+	std::unique_ptr<Matrix<short int> > statsDy;
+	std::unique_ptr<Matrix<signed char> > compactDx;
+	std::unique_ptr<Matrix<signed char> > compactDy;
+	std::unique_ptr<Matrix<signed char> > compactDxDy;
+	std::unique_ptr<TypedBuffers<unsigned short int> > uint16;
+	std::unique_ptr<TypedBuffers<short int> > int16;
+	std::unique_ptr<TypedBuffers<float> > float32;
+	std::unique_ptr<TypedBuffers<double> > float64;
+};
+
+/**
+* The results of the statistics cases are added here, so the compiler cannot drop their work
+*/
+volatile long benchmarkSink = 0;
+
+/**
+* Stream buffer that drops what is written, the print cases measure the formatting only
+*/
+class DiscardBuffer : public std::streambuf
+{
+protected:
+	int overflow(int c) { return c; }
+	std::streamsize xsputn(const char *, std::streamsize count) { return count; }
+};
+
+/**
+* RowSink that drops the rows, the stream case measures reading and convolving only
+*/
+class DiscardRowSink : public RowSink
+{
+public:
+	void writeRow(long, const short int *, int) {}
+};
+
+///////////////////////////////////////
+//CASES
+///////////////////////////////////////
+/**
+* One benchmarked variant
+* minimumSize: the smallest row and column size the variant runs on
+* maximumPixels: the largest matrix it runs on, 0 for no limit, for variants with big extra buffers
+* bytesPerPixel: the bytes read and written per pixel, for the GB/s column
+* frames: the matrices convolved per run
+*/
+struct BenchmarkCase
+{
+	std::string name;
+	int minimumSize;
+	long maximumPixels;
+	double bytesPerPixel;
+	int frames;
+	std::function<void(BenchmarkData &)> run;
+};
+
+/**
+* Description: Adds the kernel engine cases of one border policy
+*/
+template <typename Border>
+void addKernelCases(std::vector<BenchmarkCase> & cases, const std::string & border)
+{
+	//valid-only results are the top-left corner of Dx and Dy, radius 1 smaller on each side
+	auto output = [](Matrix<short int> & D, int rows, int columns, bool horizontal, bool vertical)
+	{
+		return D.view(0, 0, kernelOutputSize<Border>(rows, vertical ? 1 : 0), kernelOutputSize<Border>(columns, horizontal ? 1 : 0));
+	};
+	const int minimum = Border::valid ? 3 : 1;
+
+	cases.push_back({ "kernel/central/" + border, minimum, 0, 5.0, 1, [output](BenchmarkData & d)
+	{
+		convolveHorizontal<CentralDifferenceKernel, Border>(d.M.view(), output(d.Dx, d.rows, d.columns, true, false));
+		convolveVertical<CentralDifferenceKernel, Border>(d.M.view(), output(d.Dy, d.rows, d.columns, false, true));
+	} });
+	cases.push_back({ "kernel/sobel/" + border, minimum, 0, 5.0, 1, [output](BenchmarkData & d)
+	{
+		convolveSeparable<CentralDifferenceKernel, SobelSmoothKernel, Border>(d.M.view(), output(d.Dx, d.rows, d.columns, true, true));
+		convolveSeparable<SobelSmoothKernel, CentralDifferenceKernel, Border>(d.M.view(), output(d.Dy, d.rows, d.columns, true, true));
+	} });
+	cases.push_back({ "kernel/scharr/" + border, minimum, 0, 5.0, 1, [output](BenchmarkData & d)
+	{
+		convolveSeparable<CentralDifferenceKernel, ScharrSmoothKernel, Border>(d.M.view(), output(d.Dx, d.rows, d.columns, true, true));
+		convolveSeparable<ScharrSmoothKernel, CentralDifferenceKernel, Border>(d.M.view(), output(d.Dy, d.rows, d.columns, true, true));
+	} });
+	cases.push_back({ "kernel/runtime_central/" + border, minimum, 0, 5.0, 1, [output](BenchmarkData & d)
+	{
+		const RuntimeKernel central(std::vector<int>{ -1, 0, 1 });
+		convolveHorizontal<RuntimeKernel, Border>(d.M.view(), output(d.Dx, d.rows, d.columns, true, false), central);
+		convolveVertical<RuntimeKernel, Border>(d.M.view(), output(d.Dy, d.rows, d.columns, false, true), central);
+	} });
+}
+
+/**
+* Description: Adds the central difference and Sobel cases of the kernel engine on M of
+* type T, held in the member 'buffers' of BenchmarkData
+*/
+template <typename T>
+void addTypedCases(std::vector<BenchmarkCase> & cases, const std::string & name, std::unique_ptr<BenchmarkData::TypedBuffers<T> > BenchmarkData::* buffers)
+{
+	const double bytes = (double)(sizeof(T) + 2*sizeof(typename ConvolutionTypes<T>::Output));
+	cases.push_back({ "kernel/central/wrap/" + name, 1, 1L << 24, bytes, 1, [buffers](BenchmarkData & d)
+	{
+		BenchmarkData::TypedBuffers<T> & t = d.needTyped(d.*buffers);
+		convolveHorizontal<CentralDifferenceKernel>(t.M.view(), t.Dx.view());
+		convolveVertical<CentralDifferenceKernel>(t.M.view(), t.Dy.view());
+	} });
+	cases.push_back({ "kernel/sobel/wrap/" + name, 1, 1L << 24, bytes, 1, [buffers](BenchmarkData & d)
+	{
+		BenchmarkData::TypedBuffers<T> & t = d.needTyped(d.*buffers);
+		convolveSeparable<CentralDifferenceKernel, SobelSmoothKernel>(t.M.view(), t.Dx.view());
+		convolveSeparable<SobelSmoothKernel, CentralDifferenceKernel>(t.M.view(), t.Dy.view());
+	} });
+}
+
+/**
+* Description: Lists every benchmarked variant
+* @returns std::vector<BenchmarkCase>, the cases
+*/
+std::vector<BenchmarkCase> benchmarkCases()
+{
+	std::vector<BenchmarkCase> cases;
+	//the naive engine reads out of bounds on a single row or column, see convolve()
+	cases.push_back({ "naive", 2, 0, 5.0, 1, [](BenchmarkData & d) { convolve(d.M, d.Dx, d.Dy); } });
+	cases.push_back({ "split", 1, 0, 5.0, 1, [](BenchmarkData & d) { convolveSplit(d.M, d.Dx, d.Dy); } });
+	for(int level = SIMD_SCALAR; level <= simdLevel(); level++)
+	{
+		cases.push_back({ std::string("simd/") + simdLevelName((SimdLevel)level), 1, 0, 5.0, 1, [level](BenchmarkData & d)
+		{
+			RowKernels kernels = simdRowKernels((SimdLevel)level);
+			convolveRows(d.M, d.Dx, d.Dy, kernels);
+		} });
+	}
+	cases.push_back({ "fused", 1, 0, 5.0, 1, [](BenchmarkData & d) { convolveFused(d.M, d.Dx, d.Dy); } });
+	cases.push_back({ "parallel", 1, 0, 5.0, 1, [](BenchmarkData & d) { convolveParallel(d.M, d.Dx, d.Dy, d.pool); } });
+	cases.push_back({ "fused_parallel", 1, 0, 5.0, 1, [](BenchmarkData & d) { convolveFusedParallel(d.M, d.Dx, d.Dy, d.pool); } });
+	cases.push_back({ "tiled", 1, 0, 5.0, 1, [](BenchmarkData & d) { convolveTiled(d.M, d.Dx, d.Dy, 0); } });
+	cases.push_back({ "ghost", 1, 0, 5.0, 1, [](BenchmarkData & d) { convolveGhost(d.M, d.Dx, d.Dy); } });
+
+	//M read once and 2 bytes of results written per pixel
+	const CompactMode modes[] = { COMPACT_SATURATE, COMPACT_HALVE };
+	for(CompactMode mode : modes)
+	{
+		const std::string name = (mode == COMPACT_HALVE) ? "compact/halve" : "compact/saturate";
+		cases.push_back({ name, 1, 0, 3.0, 1, [mode](BenchmarkData & d)
+		{
+			d.needCompact();
+			convolveCompact(d.M, *d.compactDx, *d.compactDy, mode);
+		} });
+		cases.push_back({ name + "_interleaved", 1, 0, 3.0, 1, [mode](BenchmarkData & d)
+		{
+			d.needCompact();
+			convolveInterleaved(d.M, *d.compactDxDy, mode);
+		} });
+	}
+
+	addKernelCases<WrapBorder>(cases, "wrap");
+	addKernelCases<ClampBorder>(cases, "clamp");
+	addKernelCases<MirrorBorder>(cases, "mirror");
+	addKernelCases<ZeroBorder>(cases, "zero");
+	addKernelCases<ValidBorder>(cases, "valid");
+	addTypedCases<unsigned short int>(cases, "uint16", &BenchmarkData::uint16);
+	addTypedCases<short int>(cases, "int16", &BenchmarkData::int16);
+	addTypedCases<float>(cases, "float", &BenchmarkData::float32);
+	addTypedCases<double>(cases, "double", &BenchmarkData::float64);
+
+	const GradientNorm norms[] = { NORM_L1, NORM_L2 };
+	for(GradientNorm norm : norms)
+	{
+		const std::string name = (norm == NORM_L1) ? "gradient/l1" : "gradient/l2";
+		cases.push_back({ name, 1, 0, 8.0, 1, [norm](BenchmarkData & d)
+		{
+			d.needGradient();
+			GradientOptions options;
+			options.norm = norm;
+			convolveGradient(d.M, d.Dx, d.Dy, *d.magnitude, *d.orientation, options, d.pool);
+		} });
+		cases.push_back({ name + "_no_gradient_store", 1, 0, 4.0, 1, [norm](BenchmarkData & d)
+		{
+			d.needGradient();
+			GradientOptions options;
+			options.norm = norm;
+			convolveGradient(d.M, MatrixView<short int>(), MatrixView<short int>(), *d.magnitude, *d.orientation, options, d.pool);
+		} });
+	}
+
+	cases.push_back({ "batch/8_frames", 1, 1L << 22, 5.0, 8, [](BenchmarkData & d)
+	{
+		d.needFrames(8);
+		convolveBatch(d.frames, d.framesDx, d.framesDy, d.pool);
+	} });
+	cases.push_back({ "stream", 1, 1L << 24, 1.0, 1, [](BenchmarkData & d)
+	{
+		d.needStream();
+		std::istringstream in(d.stream);
+		DiscardRowSink dxSink, dySink;
+		long rows;
+		convolveStream(in, d.columns, dxSink, dySink, rows);
+	} });
+	//statistics of Dx and Dy: getMin() and getMax() read both twice, a histogram reads them once
+	cases.push_back({ "minmax", 1, 0, 8.0, 1, [](BenchmarkData & d)
+	{
+		d.needStatistics();
+		benchmarkSink += d.statsDx->getMin() + d.statsDx->getMax() + d.statsDy->getMin() + d.statsDy->getMax();
+	} });
+	cases.push_back({ "histogram", 1, 0, 4.0, 1, [](BenchmarkData & d)
+	{
+		d.needStatistics();
+		benchmarkSink += computeHistogram(d.statsDx->view()).getPercentile(99.0) + computeHistogram(d.statsDy->view()).getPercentile(99.0);
+	} });
+	cases.push_back({ "histogram_parallel", 1, 0, 4.0, 1, [](BenchmarkData & d)
+	{
+		d.needStatistics();
+		benchmarkSink += computeHistogram(d.statsDx->view(), d.pool).getPercentile(99.0) + computeHistogram(d.statsDy->view(), d.pool).getPercentile(99.0);
+	} });
+	//the summed-area table reads M and writes 4 or 8 bytes per pixel, the box means read
+	//four table entries per pixel, mostly from cache, and write one byte
+	cases.push_back({ "box/table", 1, 0, 5.0, 1, [](BenchmarkData & d)
+	{
+		d.needBoxFilter();
+		d.table.build(d.M.view(), d.pool);
+	} });
+	const int radii[] = { 1, 8, 64 };
+	for(int radius : radii)
+	{
+		cases.push_back({ "box/mean_r" + std::to_string(radius), 1, 0, 5.0, 1, [radius](BenchmarkData & d)
+		{
+			d.needBoxFilter();
+			boxMean(d.table, d.boxed->view(), radius, d.pool);
+		} });
+	}
+
+	//gradient, abs, threshold and min/max: one matrix per stage against one fused pass that
+	//reads M only, the staged chain writes Dx, Dy, the magnitude and the threshold and reads them back
+	cases.push_back({ "expression/staged", 1, 0, 19.0, 1, [](BenchmarkData & d)
+	{
+		d.needGradient();
+		convolveSimd(d.M, d.Dx, d.Dy);
+		evaluate(abs(lazy(d.Dx)) + abs(lazy(d.Dy)), d.magnitude->view());
+		evaluate(threshold(lazy(*d.magnitude), 100), d.Dx.view());
+		benchmarkSink += d.Dx.getMin() + d.Dx.getMax();
+	} });
+	cases.push_back({ "expression/fused", 1, 0, 1.0, 1, [](BenchmarkData & d)
+	{
+		const ExpressionExtrema<int> extrema = getExtrema(threshold(abs(gradientX(d.M)) + abs(gradientY(d.M)), 100));
+		benchmarkSink += extrema.min + extrema.max;
+	} });
+	cases.push_back({ "expression/fused_parallel", 1, 0, 1.0, 1, [](BenchmarkData & d)
+	{
+		const ExpressionExtrema<int> extrema = getExtrema(threshold(abs(gradientX(d.M)) + abs(gradientY(d.M)), 100), d.pool);
+		benchmarkSink += extrema.min + extrema.max;
+	} });
+
+	//Dx as text, as printMatrix() writes it, against formatting every value with operator<<
+	cases.push_back({ "print/bulk", 1, 1L << 22, 2.0, 1, [](BenchmarkData & d)
+	{
+		DiscardBuffer discard;
+		std::ostream out(&discard);
+		writeMatrixText(d.Dx.view(), out);
+	} });
+	cases.push_back({ "print/operator", 1, 1L << 22, 2.0, 1, [](BenchmarkData & d)
+	{
+		DiscardBuffer discard;
+		std::ostream out(&discard);
+		for(int i = 0; i < d.rows; i++)
+		{
+			const short int * line = d.Dx.view().getRow(i);
+			for(int j = 0; j < d.columns; j++)
+			{
+				out << line[j] << ((j == d.columns-1) ? "\n" : " ");
+			}
+		}
+	} });
+	//MPix/s counts the whole matrix, the speedup over a full engine, and GB/s is left out
+	cases.push_back({ "incremental/64x64_block", 64, 0, 0.0, 1, [](BenchmarkData & d)
+	{
+		d.needDirty();
+		convolveDirty(d.M, d.dirty, d.Dx, d.Dy);
+	} });
+	cases.push_back({ "incremental/64x64_block_extrema", 64, 0, 0.0, 1, [](BenchmarkData & d)
+	{
+		d.needDirty();
+		convolveDirty(d.M, d.dirty, d.Dx, d.Dy, d.counts);
+	} });
+	return cases;
+}
+
+/**
+* Square shapes from 64x64 to 16Kx16K, then strips with the pixels of 1Kx1K and 4Kx4K
+*/
+const int SHAPES[][2] = { { 64, 64 }, { 256, 256 }, { 1024, 1024 }, { 4096, 4096 }, { 16384, 16384 },
+	{ 1, 1 << 20 }, { 1 << 20, 1 }, { 2, 1 << 19 }, { 1 << 19, 2 },
+	{ 1, 1 << 24 }, { 1 << 24, 1 }, { 2, 1 << 23 }, { 1 << 23, 2 } };
+
+///////////////////////////////////////
+//RESULTS
+///////////////////////////////////////
+struct BenchmarkResult
+{
+	std::string name;
+	int rows;
+	int columns;
+	TimingSummary timing;
+	double pixelsPerSecond;
+	double bytesPerSecond;
+};
+
+/**
+* Description: Reads the median times of an earlier --csv file
+* Throws: std::runtime_error if the file cannot be read
+* @params path, the CSV file
+* @returns std::map<std::string, double>, the median seconds by benchmark name
+*/
+std::map<std::string, double> readBaseline(const std::string & path)
+{
+	std::ifstream in(path);
+	if(!in)
+	{
+		throw std::runtime_error(path + ": cannot read the baseline");
+	}
+	std::map<std::string, double> medians;
+	std::string line;
+	std::getline(in, line);
+	while(std::getline(in, line))
+	{
+		//name,rows,columns,median_ns,...
+		std::istringstream fields(line);
+		std::string name, rows, columns, median;
+		if(std::getline(fields, name, ',') && std::getline(fields, rows, ',') && std::getline(fields, columns, ',') && std::getline(fields, median, ','))
+		{
+			medians[name] = std::atof(median.c_str()) * 1e-9;
+		}
+	}
+	return medians;
+}
+
+void writeCsv(const std::string & path, const std::vector<BenchmarkResult> & results)
+{
+	std::ofstream out(path);
+	if(!out)
+	{
+		throw std::runtime_error(path + ": cannot write the results");
+	}
+	out << "name,rows,columns,median_ns,min_ns,p99_ns,samples,mpix_per_s,gb_per_s" << std::endl;
+	for(const BenchmarkResult & result : results)
+	{
+		out << result.name << ',' << result.rows << ',' << result.columns << ','
+			<< (long long)(result.timing.medianSeconds*1e9) << ',' << (long long)(result.timing.minSeconds*1e9) << ','
+			<< (long long)(result.timing.p99Seconds*1e9) << ',' << result.timing.samples << ','
+			<< result.pixelsPerSecond / 1e6 << ',' << result.bytesPerSecond / 1e9 << std::endl;
+	}
+}
+
+void printUsage()
+{
+	std::cout << "usage: convolution_benchmarks [options]" << std::endl
+		<< "  --filter TEXT       only run the cases whose name contains TEXT, e.g. simd/avx2 or /1024x1024" << std::endl
+		<< "  --max-pixels N      skip the shapes with more than N pixels (default: none)" << std::endl
+		<< "  --min-time S        run every case for at least S seconds (default 0.2), 0 = once" << std::endl
+		<< "  --threads N         threads of the parallel cases, 0 = all cores (default)" << std::endl
+		<< "  --csv FILE          write the results to FILE" << std::endl
+		<< "  --baseline FILE     compare the medians with an earlier --csv FILE" << std::endl
+		<< "  --tolerance PCT     slowdown against the baseline reported as a regression (default 10)" << std::endl;
+}
+
+double parseSeconds(const char * text, const std::string & flag)
+{
+	char * end = nullptr;
+	const double value = std::strtod(text, &end);
+	if(end == text || *end != '\0' || value < 0.0)
+	{
+		throw std::invalid_argument(flag + " needs a number of at least 0, got '" + text + "'");
+	}
+	return value;
+}
+
+int main(int argc, char ** argv)
+{
+	std::string filter;
+	long long maximumPixels = 0;
+	double minimumTime = 0.2;
+	int threads = 0;
+	std::string csvPath;
+	std::string baselinePath;
+	double tolerance = 10.0;
+
+	try
+	{
+		for(int k = 1; k < argc; k++)
+		{
+			const std::string flag = argv[k];
+			if(flag == "--help" || flag == "-h")
+			{
+				printUsage();
+				return 0;
+			}
+			if(k + 1 >= argc)
+			{
+				throw std::invalid_argument(flag + " needs a value");
+			}
+			const char * value = argv[++k];
+			if(flag == "--filter") filter = value;
+			else if(flag == "--max-pixels") maximumPixels = parseNumber(value, flag, 1);
+			else if(flag == "--min-time") minimumTime = parseSeconds(value, flag);
+			else if(flag == "--threads") threads = (int)parseNumber(value, flag, 0);
+			else if(flag == "--csv") csvPath = value;
+			else if(flag == "--baseline") baselinePath = value;
+			else if(flag == "--tolerance") tolerance = parseSeconds(value, flag);
+			else throw std::invalid_argument("unknown option " + flag + ", see --help");
+		}
+
+		const std::map<std::string, double> baseline = baselinePath.empty() ? std::map<std::string, double>() : readBaseline(baselinePath);
+		ThreadPool pool(threads);
+		const std::vector<BenchmarkCase> cases = benchmarkCases();
+		std::vector<BenchmarkResult> results;
+		int regressions = 0;
+
+		std::cout << "SIMD level: " << simdLevelName(simdLevel()) << ", threads: " << pool.getThreads() << std::endl;
+		std::printf("%-44s %12s %12s %12s %7s %10s %8s\n", "Benchmark", "Median", "Min", "p99", "Reps", "MPix/s", "GB/s");
+		std::cout << std::string(111, '-') << std::endl;
+
+		for(const auto & shape : SHAPES)
+		{
+			const int rows = shape[0];
+			const int columns = shape[1];
+			const long pixels = (long)rows*columns;
+			const std::string suffix = "/" + std::to_string(rows) + "x" + std::to_string(columns);
+			if(maximumPixels > 0 && pixels > maximumPixels)
+			{
+				continue;
+			}
+
+			//the matrices are only allocated for shapes with at least one selected case
+			std::unique_ptr<BenchmarkData> data;
+			for(const BenchmarkCase & variant : cases)
+			{
+				const std::string name = variant.name + suffix;
+				if(rows < variant.minimumSize || columns < variant.minimumSize
+					|| (variant.maximumPixels > 0 && pixels > variant.maximumPixels)
+					|| name.find(filter) == std::string::npos)
+				{
+					continue;
+				}
+				if(!data)
+				{
+					data.reset(new BenchmarkData(rows, columns, 1, pool));
+				}
+
+				//one warmup and one timed run estimate the repetitions that fill the minimum time
+				BenchmarkData & d = *data;
+				auto run = [&]() { variant.run(d); };
+				std::vector<double> seconds = timeRepetitions(1, 1, run);
+				const int repetitions = (int)std::min(10000.0, std::ceil(minimumTime / std::max(seconds[0], 1e-9))) - 1;
+				if(repetitions > 0)
+				{
+					const std::vector<double> more = timeRepetitions(0, repetitions, run);
+					seconds.insert(seconds.end(), more.begin(), more.end());
+				}
+
+				BenchmarkResult result;
+				result.name = name;
+				result.rows = rows;
+				result.columns = columns;
+				result.timing = summarizeTimings(seconds);
+				result.pixelsPerSecond = (double)pixels*variant.frames / result.timing.medianSeconds;
+				result.bytesPerSecond = result.pixelsPerSecond*variant.bytesPerPixel;
+				results.push_back(result);
+				std::printf("%-44s %9.3f ms %9.3f ms %9.3f ms %7d %10.1f %8.2f\n", name.c_str(), result.timing.medianSeconds*1e3,
+					result.timing.minSeconds*1e3, result.timing.p99Seconds*1e3, result.timing.samples,
+					result.pixelsPerSecond / 1e6, result.bytesPerSecond / 1e9);
+
+				const std::map<std::string, double>::const_iterator before = baseline.find(name);
+				if(before != baseline.end() && result.timing.medianSeconds > before->second*(1.0 + tolerance/100.0))
+				{
+					regressions++;
+					std::printf("REGRESSION %s: %.3f ms, baseline %.3f ms (+%.1f%%)\n", name.c_str(), result.timing.medianSeconds*1e3,
+						before->second*1e3, (result.timing.medianSeconds / before->second - 1.0)*100.0);
+				}
+			}
+		}
+
+		if(!csvPath.empty())
+		{
+			writeCsv(csvPath, results);
+		}
+		if(!baseline.empty())
+		{
+			std::cout << regressions << " regressions against " << baselinePath << std::endl;
+		}
+		return (regressions == 0) ? 0 : 1;
+	}
+	catch(const std::exception & e)
+	{
+		std::cout << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,1266 @@
+#include "Matrix.cpp"
+#include "NaiveConvolution.cpp"
+#include "Convolution.cpp"
+#include "KernelConvolution.cpp"
+#include "Gradient.cpp"
+#include "Batch.cpp"
+#include "Streaming.cpp"
+#include "IncrementalConvolution.cpp"
+#include "CompactConvolution.cpp"
+#include "GradientHistogram.cpp"
+#include "SummedAreaTable.cpp"
+#include "MatrixExpression.cpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+* Equivalence tests: every optimized path must give exactly the result of the naive
+* convolve() from NaiveConvolution.cpp, on every shape from 1x1 to long skewed strips.
+* convolve() itself needs at least 2 rows and 2 columns, so it is first checked against a
+* brute-force separable reference (referenceConvolution() below) on those shapes, and the
+* reference, which also covers every border policy and kernel, is the golden result for
+* the rest. Returns 1 if any check fails.
+*/
+
+///////////////////////////////////////
+//CHECKS
+///////////////////////////////////////
+int checks = 0;
+int failures = 0;
+
+/**
+* Description: Records one check, printing it if it failed
+* @params passed, the result of the check
+* @params what, the description of what was checked
+* @returns bool, passed
+*/
+bool check(bool passed, const std::string & what)
+{
+	checks++;
+	if(!passed)
+	{
+		failures++;
+		std::cout << "FAILED: " << what << std::endl;
+	}
+	return passed;
+}
+
+/**
+* Description: Compares two results element by element
+* @params actual, the result of the path under test
+* @params expected, the golden result
+* @params what, the description of the check
+* @returns bool, true if they have the same size and elements
+*/
+template <typename A, typename E>
+bool checkSame(MatrixView<A> actual, MatrixView<E> expected, const std::string & what)
+{
+	if(actual.getRows() != expected.getRows() || actual.getColumns() != expected.getColumns())
+	{
+		return check(false, what + ": size " + std::to_string(actual.getRows()) + "x" + std::to_string(actual.getColumns())
+			+ ", expected " + std::to_string(expected.getRows()) + "x" + std::to_string(expected.getColumns()));
+	}
+	for(int i = 0; i < expected.getRows(); i++)
+	{
+		for(int j = 0; j < expected.getColumns(); j++)
+		{
+			if((long)actual.getRow(i)[j] != (long)expected.getRow(i)[j])
+			{
+				return check(false, what + ": (" + std::to_string(i) + ", " + std::to_string(j) + ") is "
+					+ std::to_string((long)actual.getRow(i)[j]) + ", expected " + std::to_string((long)expected.getRow(i)[j]));
+			}
+		}
+	}
+	return check(true, what);
+}
+
+/**
+* Description: Compares a result with a reference element by element, up to a tolerance
+* for the rounding of floating point sums taken in a different order
+* @params actual, the result of the path under test
+* @params expected, the reference
+* @params tolerance, the largest accepted difference
+* @params what, the description of the check
+* @returns bool, true if they have the same size and close elements
+*/
+template <typename A>
+bool checkClose(MatrixView<A> actual, MatrixView<double> expected, double tolerance, const std::string & what)
+{
+	if(actual.getRows() != expected.getRows() || actual.getColumns() != expected.getColumns())
+	{
+		return check(false, what + ": size differs");
+	}
+	for(int i = 0; i < expected.getRows(); i++)
+	{
+		for(int j = 0; j < expected.getColumns(); j++)
+		{
+			if(std::fabs((double)actual.getRow(i)[j] - expected.getRow(i)[j]) > tolerance)
+			{
+				return check(false, what + ": (" + std::to_string(i) + ", " + std::to_string(j) + ") is "
+					+ std::to_string((double)actual.getRow(i)[j]) + ", expected " + std::to_string(expected.getRow(i)[j]));
+			}
+		}
+	}
+	return check(true, what);
+}
+
+std::string shapeName(int rows, int columns)
+{
+	return std::to_string(rows) + "x" + std::to_string(columns);
+}
+
+///////////////////////////////////////
+//REFERENCE
+///////////////////////////////////////
+/**
+* Description: Brute-force 2D convolution with the kernel vertical x horizontal
+* Implementation: For every output pixel sums every tap, resolving the positions outside
+* the matrix with Border::index() one by one. No row pointers, no blocks, no SIMD.
+* @params M, the source matrix
+* @params horizontal, vertical, the taps along the rows and the columns
+* @returns std::vector<int>, the result, rows x columns as given by kernelOutputSize()
+*/
+template <typename Border>
+Matrix<int> referenceConvolution(MatrixView<unsigned char> M, const std::vector<int> & horizontal, const std::vector<int> & vertical)
+{
+	const int rows = M.getRows();
+	const int columns = M.getColumns();
+	const int radiusH = (int)horizontal.size() / 2;
+	const int radiusV = (int)vertical.size() / 2;
+	const int outputRows = kernelOutputSize<Border>(rows, radiusV);
+	const int outputColumns = kernelOutputSize<Border>(columns, radiusH);
+	//valid-only results start at the first position whose taps are all inside the matrix
+	const int offsetV = Border::valid ? radiusV : 0;
+	const int offsetH = Border::valid ? radiusH : 0;
+
+	Matrix<int> D(std::max(outputRows, 1), std::max(outputColumns, 1), MatrixLayout(), FILL_NONE);
+	for(int i = 0; i < outputRows; i++)
+	{
+		for(int j = 0; j < outputColumns; j++)
+		{
+			int sum = 0;
+			for(int a = 0; a < (int)vertical.size(); a++)
+			{
+				const int row = Border::index(i + offsetV + a - radiusV, rows);
+				for(int b = 0; b < (int)horizontal.size(); b++)
+				{
+					const int column = Border::index(j + offsetH + b - radiusH, columns);
+					sum += (row < 0 || column < 0) ? 0 : vertical[a]*horizontal[b]*(int)M.getRow(row)[column];
+				}
+			}
+			D.put(i, j, sum);
+		}
+	}
+	return D;
+}
+
+/**
+* Description: referenceConvolution() for the other element types, summed in double
+* @params M, the source matrix
+* @params horizontal, vertical, the taps along the rows and the columns
+* @returns Matrix<double>, the result, rows x columns as given by kernelOutputSize()
+*/
+template <typename Border, typename T>
+Matrix<double> referenceConvolutionTyped(MatrixView<T> M, const std::vector<int> & horizontal, const std::vector<int> & vertical)
+{
+	const int rows = M.getRows();
+	const int columns = M.getColumns();
+	const int radiusH = (int)horizontal.size() / 2;
+	const int radiusV = (int)vertical.size() / 2;
+	const int outputRows = kernelOutputSize<Border>(rows, radiusV);
+	const int outputColumns = kernelOutputSize<Border>(columns, radiusH);
+	const int offsetV = Border::valid ? radiusV : 0;
+	const int offsetH = Border::valid ? radiusH : 0;
+
+	Matrix<double> D(std::max(outputRows, 1), std::max(outputColumns, 1), MatrixLayout(), FILL_NONE);
+	for(int i = 0; i < outputRows; i++)
+	{
+		for(int j = 0; j < outputColumns; j++)
+		{
+			double sum = 0;
+			for(int a = 0; a < (int)vertical.size(); a++)
+			{
+				const int row = Border::index(i + offsetV + a - radiusV, rows);
+				for(int b = 0; b < (int)horizontal.size(); b++)
+				{
+					const int column = Border::index(j + offsetH + b - radiusH, columns);
+					sum += (row < 0 || column < 0) ? 0.0 : vertical[a]*horizontal[b]*(double)M.getRow(row)[column];
+				}
+			}
+			D.put(i, j, sum);
+		}
+	}
+	return D;
+}
+
+/**
+* Description: The view of a reference result with the size the engines produce
+*/
+template <typename Border>
+MatrixView<int> referenceView(Matrix<int> & D, int rows, int columns, int radiusH, int radiusV)
+{
+	return D.view(0, 0, kernelOutputSize<Border>(rows, radiusV), kernelOutputSize<Border>(columns, radiusH));
+}
+
+///////////////////////////////////////
+//FIXTURES
+///////////////////////////////////////
+struct Shape
+{
+	int rows;
+	int columns;
+};
+
+/**
+* Single pixels, single rows and columns, 2-wide strips, shapes around the SIMD widths
+* (16 and 32) and the 32-pixel kernel blocks, and a few larger ones
+*/
+const Shape SHAPES[] = { {1, 1}, {1, 2}, {2, 1}, {2, 2}, {3, 3}, {1, 1000}, {1000, 1}, {2, 517}, {517, 2},
+	{4, 15}, {5, 16}, {6, 17}, {7, 31}, {8, 32}, {9, 33}, {33, 65}, {64, 64}, {100, 257}, {255, 1025} };
+const int SHAPE_COUNT = sizeof(SHAPES) / sizeof(SHAPES[0]);
+
+const std::vector<int> CENTRAL = { -1, 0, 1 };
+const std::vector<int> IDENTITY = { 1 };
+
+Matrix<unsigned char> randomMatrix(int rows, int columns, uint64_t seed, const MatrixLayout & layout = MatrixLayout())
+{
+	Matrix<unsigned char> M(rows, columns, layout, FILL_NONE);
+	M.fillRand(seed);
+	return M;
+}
+
+Matrix<short int> resultMatrix(int rows, int columns, const MatrixLayout & layout = MatrixLayout())
+{
+	return Matrix<short int>(std::max(rows, 1), std::max(columns, 1), layout, FILL_NONE);
+}
+
+///////////////////////////////////////
+//TESTS
+///////////////////////////////////////
+/**
+* The naive convolve() agrees with the reference wherever it can run
+*/
+void testNaiveMatchesReference()
+{
+	for(int s = 0; s < SHAPE_COUNT; s++)
+	{
+		const Shape shape = SHAPES[s];
+		if(shape.rows < 2 || shape.columns < 2)
+		{
+			continue;
+		}
+		Matrix<unsigned char> M = randomMatrix(shape.rows, shape.columns, 100 + s);
+		Matrix<short int> Dx = resultMatrix(shape.rows, shape.columns);
+		Matrix<short int> Dy = resultMatrix(shape.rows, shape.columns);
+		convolve(M, Dx, Dy);
+		Matrix<int> expectedX = referenceConvolution<WrapBorder>(M, CENTRAL, IDENTITY);
+		Matrix<int> expectedY = referenceConvolution<WrapBorder>(M, IDENTITY, CENTRAL);
+		checkSame(Dx.view(), expectedX.view(), "naive Dx " + shapeName(shape.rows, shape.columns));
+		checkSame(Dy.view(), expectedY.view(), "naive Dy " + shapeName(shape.rows, shape.columns));
+	}
+}
+
+/**
+* Every Dx/Dy engine of Convolution.cpp, at every SIMD level this CPU has, serial and on a pool
+*/
+void testRowEngines()
+{
+	ThreadPool pool(3);
+	MatrixLayout padded;
+	padded.padRows = true;
+	MatrixLayout ghost;
+	ghost.padRows = true;
+	ghost.ghost = 1;
+
+	for(int s = 0; s < SHAPE_COUNT; s++)
+	{
+		const int rows = SHAPES[s].rows;
+		const int columns = SHAPES[s].columns;
+		const std::string shape = shapeName(rows, columns);
+		Matrix<unsigned char> M = randomMatrix(rows, columns, 200 + s, ghost);
+		Matrix<int> expectedX = referenceConvolution<WrapBorder>(M, CENTRAL, IDENTITY);
+		Matrix<int> expectedY = referenceConvolution<WrapBorder>(M, IDENTITY, CENTRAL);
+		Matrix<short int> Dx = resultMatrix(rows, columns, padded);
+		Matrix<short int> Dy = resultMatrix(rows, columns, padded);
+
+		auto expect = [&](const std::string & engine)
+		{
+			checkSame(Dx.view(), expectedX.view(), engine + " Dx " + shape);
+			checkSame(Dy.view(), expectedY.view(), engine + " Dy " + shape);
+		};
+		auto expectExtrema = [&](const GradientExtrema & extrema, const std::string & engine)
+		{
+			check(extrema.xMin == Dx.getMin() && extrema.xMax == Dx.getMax() && extrema.yMin == Dy.getMin() && extrema.yMax == Dy.getMax(),
+				engine + " min/max " + shape);
+		};
+
+		convolveSplit(M, Dx, Dy);
+		expect("split");
+		convolveSimd(M, Dx, Dy);
+		expect("simd");
+		for(int level = SIMD_SCALAR; level <= simdLevel(); level++)
+		{
+			const std::string name = std::string("rows/") + simdLevelName((SimdLevel)level);
+			RowKernels kernels = simdRowKernels((SimdLevel)level);
+			convolveRows(M, Dx, Dy, kernels);
+			expect(name);
+			FusedRowKernels fused = fusedRowKernels((SimdLevel)level);
+			convolveRows(M, Dx, Dy, fused);
+			expect("fused " + name);
+			expectExtrema(fused.extrema, "fused " + name);
+		}
+		expectExtrema(convolveFused(M, Dx, Dy), "fused");
+		expect("fused");
+		convolveParallel(M, Dx, Dy, pool);
+		expect("parallel");
+		expectExtrema(convolveFusedParallel(M, Dx, Dy, pool), "fused parallel");
+		expect("fused parallel");
+		const int strips[] = { 0, 1, 7, 64 };
+		for(int strip : strips)
+		{
+			convolveTiled(M, Dx, Dy, strip);
+			expect("tiled/" + std::to_string(strip));
+		}
+		convolveGhost(M, Dx, Dy);
+		expect("ghost");
+	}
+
+	//a view of no rows gives the empty range
+	Matrix<unsigned char> M = randomMatrix(4, 4, 299);
+	Matrix<short int> D = resultMatrix(4, 4);
+	const GradientExtrema none = convolveFusedParallel(M.view().subView(0, 0, 0, 4), D.view().subView(0, 0, 0, 4), D.view().subView(0, 0, 0, 4), pool);
+	check(none.xMin == std::numeric_limits<short int>::max() && none.xMax == std::numeric_limits<short int>::min()
+		&& none.yMin == std::numeric_limits<short int>::max() && none.yMax == std::numeric_limits<short int>::min(), "fused parallel of 0 rows");
+}
+
+/**
+* Every border policy of the kernel engine, for the central difference, Sobel, Scharr,
+* the 5-tap Gaussian and a runtime kernel
+*/
+template <typename Border>
+void testKernelEngine(const std::string & border)
+{
+	const std::vector<int> sobel = { 1, 2, 1 };
+	const std::vector<int> scharr = { 3, 10, 3 };
+	const std::vector<int> gaussian = { 1, 4, 6, 4, 1 };
+	const std::vector<int> runtime = { 2, -3, 0, 5, -1, 4, 7 };
+
+	for(int s = 0; s < SHAPE_COUNT; s++)
+	{
+		const int rows = SHAPES[s].rows;
+		const int columns = SHAPES[s].columns;
+		const std::string shape = border + " " + shapeName(rows, columns);
+		Matrix<unsigned char> M = randomMatrix(rows, columns, 300 + s);
+		Matrix<short int> D = resultMatrix(rows, columns);
+		Matrix<int> wide(std::max(rows, 1), std::max(columns, 1), MatrixLayout(), FILL_NONE);
+
+		//the results are written into the top-left corner of D, the size of the reference
+		auto expectShort = [&](const std::vector<int> & h, const std::vector<int> & v, const std::string & what)
+		{
+			Matrix<int> expected = referenceConvolution<Border>(M, h, v);
+			const MatrixView<int> view = referenceView<Border>(expected, rows, columns, (int)h.size()/2, (int)v.size()/2);
+			checkSame(D.view(0, 0, view.getRows(), view.getColumns()), view, what + " " + shape);
+		};
+		auto output = [&](int radiusH, int radiusV)
+		{
+			return D.view(0, 0, kernelOutputSize<Border>(rows, radiusV), kernelOutputSize<Border>(columns, radiusH));
+		};
+
+		convolveHorizontal<CentralDifferenceKernel, Border>(M.view(), output(1, 0));
+		expectShort(CENTRAL, IDENTITY, "kernel Dx");
+		convolveVertical<CentralDifferenceKernel, Border>(M.view(), output(0, 1));
+		expectShort(IDENTITY, CENTRAL, "kernel Dy");
+		convolveSeparable<CentralDifferenceKernel, SobelSmoothKernel, Border>(M.view(), output(1, 1));
+		expectShort(CENTRAL, sobel, "sobel x");
+		convolveSeparable<SobelSmoothKernel, CentralDifferenceKernel, Border>(M.view(), output(1, 1));
+		expectShort(sobel, CENTRAL, "sobel y");
+		convolveSeparable<CentralDifferenceKernel, ScharrSmoothKernel, Border>(M.view(), output(1, 1));
+		expectShort(CENTRAL, scharr, "scharr x");
+		convolveHorizontal<RuntimeKernel, Border>(M.view(), output(3, 0), RuntimeKernel(runtime));
+		expectShort(runtime, IDENTITY, "runtime horizontal");
+		convolveVertical<RuntimeKernel, Border>(M.view(), output(0, 3), RuntimeKernel(runtime));
+		expectShort(IDENTITY, runtime, "runtime vertical");
+
+		Matrix<int> expected = referenceConvolution<Border>(M, gaussian, gaussian);
+		const MatrixView<int> view = referenceView<Border>(expected, rows, columns, 2, 2);
+		const MatrixView<int> out = wide.view(0, 0, view.getRows(), view.getColumns());
+		convolveSeparable<Gaussian5Kernel, Gaussian5Kernel, Border>(M.view(), out);
+		checkSame(out, view, "gaussian5 " + shape);
+	}
+}
+
+/**
+* The kernel engine on the wider element types, into the result type ConvolutionTypes<T>
+* picks: full-range 16-bit data must not overflow, floating point data must match the
+* double reference up to rounding. getMax() must also work on all-negative data.
+*/
+template <typename T>
+void testElementType(const std::string & name, double tolerance)
+{
+	typedef typename ConvolutionTypes<T>::Output Result;
+	const std::vector<int> sobel = { 1, 2, 1 };
+	const std::vector<int> scharr = { 3, 10, 3 };
+
+	for(int s = 0; s < SHAPE_COUNT; s++)
+	{
+		const int rows = SHAPES[s].rows;
+		const int columns = SHAPES[s].columns;
+		const std::string shape = name + " " + shapeName(rows, columns);
+		Matrix<T> M(rows, columns, MatrixLayout(), FILL_NONE);
+		M.fillRand(1000 + s);
+		Matrix<Result> D(rows, columns, MatrixLayout(), FILL_NONE);
+
+		convolveHorizontal<CentralDifferenceKernel>(M.view(), D.view());
+		checkClose(D.view(), referenceConvolutionTyped<WrapBorder>(M.view(), CENTRAL, IDENTITY).view(), tolerance, "typed Dx " + shape);
+		convolveVertical<CentralDifferenceKernel>(M.view(), D.view());
+		checkClose(D.view(), referenceConvolutionTyped<WrapBorder>(M.view(), IDENTITY, CENTRAL).view(), tolerance, "typed Dy " + shape);
+		convolveSeparable<CentralDifferenceKernel, SobelSmoothKernel>(M.view(), D.view());
+		checkClose(D.view(), referenceConvolutionTyped<WrapBorder>(M.view(), CENTRAL, sobel).view(), tolerance, "typed sobel x " + shape);
+		convolveSeparable<ScharrSmoothKernel, CentralDifferenceKernel>(M.view(), D.view());
+		checkClose(D.view(), referenceConvolutionTyped<WrapBorder>(M.view(), scharr, CENTRAL).view(), tolerance, "typed scharr y " + shape);
+
+		Matrix<double> expected = referenceConvolutionTyped<ValidBorder>(M.view(), CENTRAL, sobel);
+		const MatrixView<Result> out = D.view(0, 0, kernelOutputSize<ValidBorder>(rows, 1), kernelOutputSize<ValidBorder>(columns, 1));
+		convolveSeparable<CentralDifferenceKernel, SobelSmoothKernel, ValidBorder>(M.view(), out);
+		checkClose(out, expected.view(0, 0, out.getRows(), out.getColumns()), tolerance, "typed valid sobel x " + shape);
+	}
+
+	ThreadPool pool(3);
+	Matrix<Result> negative(9, 7, MatrixLayout(), FILL_NONE);
+	for(int i = 0; i < 9; i++)
+	{
+		for(int j = 0; j < 7; j++)
+		{
+			negative.put(i, j, (Result)(-100 - i*7 - j));
+		}
+	}
+	check(negative.getMax() == (Result)(-100) && negative.view().getMax(pool) == (Result)(-100), "getMax of negative " + name);
+}
+
+/**
+* The gradient stage: Dx/Dy as convolve(), the magnitude against the formula and the
+* orientation against the scalar gradientRow(), serial and on a pool
+*/
+void testGradient()
+{
+	ThreadPool pool(3);
+	for(int s = 0; s < SHAPE_COUNT; s++)
+	{
+		const int rows = SHAPES[s].rows;
+		const int columns = SHAPES[s].columns;
+		Matrix<unsigned char> M = randomMatrix(rows, columns, 400 + s);
+		Matrix<int> expectedX = referenceConvolution<WrapBorder>(M, CENTRAL, IDENTITY);
+		Matrix<int> expectedY = referenceConvolution<WrapBorder>(M, IDENTITY, CENTRAL);
+		Matrix<short int> Dx = resultMatrix(rows, columns);
+		Matrix<short int> Dy = resultMatrix(rows, columns);
+		Matrix<short int> magnitude = resultMatrix(rows, columns);
+		Matrix<unsigned char> orientation(rows, columns, MatrixLayout(), FILL_NONE);
+		Matrix<short int> expectedMagnitude = resultMatrix(rows, columns);
+		Matrix<unsigned char> expectedOrientation(rows, columns, MatrixLayout(), FILL_NONE);
+
+		for(int norm = NORM_L1; norm <= NORM_L2; norm++)
+		{
+			for(int mode = ORIENTATION_EXACT; mode <= ORIENTATION_FAST; mode++)
+			{
+				GradientOptions options;
+				options.norm = (GradientNorm)norm;
+				options.orientation = (OrientationMode)mode;
+				options.bins = (mode == ORIENTATION_FAST) ? 8 : 180;
+				const std::string name = std::string("gradient ") + ((norm == NORM_L1) ? "l1" : "l2")
+					+ ((mode == ORIENTATION_FAST) ? "/fast " : "/exact ") + shapeName(rows, columns);
+
+				std::vector<short int> dx(columns);
+				std::vector<short int> dy(columns);
+				for(int i = 0; i < rows; i++)
+				{
+					for(int j = 0; j < columns; j++)
+					{
+						dx[j] = (short int)expectedX.get(i, j);
+						dy[j] = (short int)expectedY.get(i, j);
+						const double length = (norm == NORM_L1) ? std::abs(dx[j]) + std::abs(dy[j]) : std::floor(std::hypot(dx[j], dy[j]) + 0.5);
+						expectedMagnitude.put(i, j, (short int)length);
+					}
+					gradientRow(&dx[0], &dy[0], nullptr, expectedOrientation.view().getRow(i), 0, columns, options);
+				}
+
+				for(int parallel = 0; parallel < 2; parallel++)
+				{
+					const std::string how = parallel ? " parallel" : "";
+					if(parallel) convolveGradient(M, Dx, Dy, magnitude, orientation, options, pool);
+					else convolveGradient(M, Dx, Dy, magnitude, orientation, options);
+					checkSame(Dx.view(), expectedX.view(), name + how + " Dx");
+					checkSame(Dy.view(), expectedY.view(), name + how + " Dy");
+					checkSame(magnitude.view(), expectedMagnitude.view(), name + how + " magnitude");
+					checkSame(orientation.view(), expectedOrientation.view(), name + how + " orientation");
+				}
+			}
+		}
+	}
+}
+
+/**
+* An exception thrown by a task, on a worker or on the calling thread, comes out of run(),
+* and the pool runs the next job normally
+*/
+void testThreadPool()
+{
+	ThreadPool pool(3);
+	for(int round = 0; round < 20; round++)
+	{
+		const int throwing = round % 6;
+		bool threw = false;
+		try
+		{
+			pool.run(6, [&](int task)
+			{
+				if(task == throwing) throw std::runtime_error("task " + std::to_string(task));
+			});
+		}
+		catch(const std::runtime_error & error)
+		{
+			threw = error.what() == "task " + std::to_string(throwing);
+		}
+		check(threw, "pool rethrows the exception of task " + std::to_string(throwing));
+
+		std::vector<int> ran(6, 0);
+		pool.run(6, [&](int task) { ran[task]++; });
+		check(std::count(ran.begin(), ran.end(), 1) == 6, "pool runs every task after an exception");
+	}
+
+	//the first task holds the calling thread until a worker has thrown from the second
+	const std::thread::id caller = std::this_thread::get_id();
+	std::atomic<bool> workerThrew(false);
+	bool threw = false;
+	try
+	{
+		pool.run(2, [&](int task)
+		{
+			if(std::this_thread::get_id() != caller)
+			{
+				workerThrew = true;
+				throw std::runtime_error("worker");
+			}
+			if(task == 0)
+			{
+				for(int wait = 0; wait < 2000 && !workerThrew; wait++)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			}
+		});
+	}
+	catch(const std::runtime_error &)
+	{
+		threw = true;
+	}
+	check(threw == workerThrew, "pool rethrows the exception of a worker");
+}
+
+/**
+* Engines on a region of interest give the result of the region copied into its own matrix
+*/
+void testViews()
+{
+	Matrix<unsigned char> M = randomMatrix(70, 90, 500);
+	Matrix<short int> Dx = resultMatrix(70, 90);
+	Matrix<short int> Dy = resultMatrix(70, 90);
+	const int r0 = 5, c0 = 11, rows = 41, columns = 67;
+	const MatrixView<unsigned char> roi = M.view(r0, c0, rows, columns);
+
+	Matrix<unsigned char> copy(rows, columns, MatrixLayout(), FILL_NONE);
+	for(int i = 0; i < rows; i++)
+	{
+		std::memcpy(copy.view().getRow(i), roi.getRow(i), columns);
+	}
+	Matrix<int> expectedX = referenceConvolution<WrapBorder>(copy, CENTRAL, IDENTITY);
+	Matrix<int> expectedY = referenceConvolution<WrapBorder>(copy, IDENTITY, CENTRAL);
+	const MatrixView<short int> dx = Dx.view(r0, c0, rows, columns);
+	const MatrixView<short int> dy = Dy.view(r0, c0, rows, columns);
+
+	convolveSimd(roi, dx, dy);
+	checkSame(dx, expectedX.view(), "simd roi Dx");
+	checkSame(dy, expectedY.view(), "simd roi Dy");
+	convolveTiled(roi, dx, dy, 16);
+	checkSame(dx, expectedX.view(), "tiled roi Dx");
+	checkSame(dy, expectedY.view(), "tiled roi Dy");
+	convolveHorizontal<CentralDifferenceKernel>(roi, dx);
+	convolveVertical<CentralDifferenceKernel>(roi, dy);
+	checkSame(dx, expectedX.view(), "kernel roi Dx");
+	checkSame(dy, expectedY.view(), "kernel roi Dy");
+}
+
+/**
+* Batches of frames, convolved together and pipelined from a stream
+*/
+void testBatch()
+{
+	ThreadPool pool(3);
+	const int shapes[][3] = { { 5, 17, 33 }, { 1, 64, 64 }, { 7, 2, 300 }, { 2, 1, 1 } };
+	for(const auto & shape : shapes)
+	{
+		const int count = shape[0];
+		const int rows = shape[1];
+		const int columns = shape[2];
+		const long frameElements = (long)rows*columns;
+		const std::string name = std::to_string(count) + "x" + shapeName(rows, columns);
+		std::vector<unsigned char> input(count*frameElements);
+		for(long k = 0; k < count*frameElements; k++)
+		{
+			input[k] = (unsigned char)counterRandom(600, k);
+		}
+		std::vector<short int> dxData(count*frameElements);
+		std::vector<short int> dyData(count*frameElements);
+		const std::vector<MatrixView<unsigned char> > frames = frameViews(&input[0], count, rows, columns);
+		const std::vector<MatrixView<short int> > Dx = frameViews(&dxData[0], count, rows, columns);
+		const std::vector<MatrixView<short int> > Dy = frameViews(&dyData[0], count, rows, columns);
+		convolveBatch(frames, Dx, Dy, pool);
+
+		std::istringstream in(std::string(input.begin(), input.end()));
+		std::ostringstream dxOut;
+		std::ostringstream dyOut;
+		StreamFrameSource source(in);
+		StreamFrameSink sink(dxOut, dyOut);
+		const FrameThroughput throughput = convolveFrames(source, sink, rows, columns, pool);
+		check(throughput.frames == count, "pipelined frame count " + name);
+		const std::string dxBytes = dxOut.str();
+		const std::string dyBytes = dyOut.str();
+
+		for(int f = 0; f < count; f++)
+		{
+			Matrix<int> expectedX = referenceConvolution<WrapBorder>(frames[f], CENTRAL, IDENTITY);
+			Matrix<int> expectedY = referenceConvolution<WrapBorder>(frames[f], IDENTITY, CENTRAL);
+			checkSame(Dx[f], expectedX.view(), "batch Dx " + name);
+			checkSame(Dy[f], expectedY.view(), "batch Dy " + name);
+			if(dxBytes.size() == dxData.size()*sizeof(short int) && dyBytes.size() == dyData.size()*sizeof(short int))
+			{
+				const short int * dx = (const short int *)dxBytes.data() + f*frameElements;
+				const short int * dy = (const short int *)dyBytes.data() + f*frameElements;
+				checkSame(MatrixView<short int>((short int *)dx, rows, columns, columns), expectedX.view(), "pipelined Dx " + name);
+				checkSame(MatrixView<short int>((short int *)dy, rows, columns, columns), expectedY.view(), "pipelined Dy " + name);
+			}
+		}
+		check(dxBytes.size() == dxData.size()*sizeof(short int) && dyBytes.size() == dyData.size()*sizeof(short int), "pipelined output size " + name);
+
+		//the same frames written on a writer thread while the next one is convolved
+		std::istringstream asyncIn(std::string(input.begin(), input.end()));
+		std::ostringstream asyncDxOut;
+		std::ostringstream asyncDyOut;
+		StreamFrameSource asyncSource(asyncIn);
+		StreamFrameSink asyncTarget(asyncDxOut, asyncDyOut);
+		AsyncWriter writer;
+		AsyncFrameSink asyncSink(asyncTarget, writer);
+		convolveFrames(asyncSource, asyncSink, rows, columns, pool);
+		asyncSink.finish();
+		check(asyncDxOut.str() == dxBytes && asyncDyOut.str() == dyBytes, "asynchronous frame sink " + name);
+	}
+}
+
+/**
+* The bulk text writer prints what operator<< prints, and the asynchronous writer runs
+* its jobs in order, writes what it was given before the caller changed it and passes
+* errors on through the futures
+*/
+void testWriter()
+{
+	auto expectText = [](const auto & values, int rows, int columns, const std::string & what)
+	{
+		typedef typename std::decay<decltype(values[0])>::type T;
+		std::ostringstream expected;
+		for(int i = 0; i < rows; i++)
+		{
+			for(int j = 0; j < columns; j++)
+			{
+				expected << +values[i*columns + j] << ((j == columns-1) ? "\n" : " ");
+			}
+		}
+		std::ostringstream actual;
+		writeMatrixText(MatrixView<T>((T *)values.data(), rows, columns, columns), actual);
+		check(actual.str() == expected.str(), "text of " + what);
+	};
+	expectText(std::vector<unsigned char>{ 0, 9, 10, 255 }, 2, 2, "unsigned char");
+	expectText(std::vector<signed char>{ -128, -1, 0, 127 }, 1, 4, "signed char");
+	expectText(std::vector<short int>{ -32768, -255, -10, 0, 7, 100, 32767, 1000 }, 4, 2, "short int");
+	expectText(std::vector<int>{ std::numeric_limits<int>::min(), -1, 0, std::numeric_limits<int>::max() }, 4, 1, "int");
+	expectText(std::vector<float>{ 0.0f, -1.5f, 0.1f, 1e-7f, 123456789.0f, 3.0f }, 2, 3, "float");
+	expectText(std::vector<double>{ 0.0, -2.25, 1.0/3.0, 1e300, -1e-300, 42.0 }, 3, 2, "double");
+
+	//larger than TEXT_BUFFER_BYTES, so the buffer is written out in the middle of a row
+	Matrix<short int> large(300, 1000, MatrixLayout(), FILL_NONE);
+	large.fillRand(1);
+	std::ostringstream expected;
+	for(int i = 0; i < large.getRows(); i++)
+	{
+		for(int j = 0; j < large.getColumns(); j++)
+		{
+			expected << large.view().getRow(i)[j] << ((j == large.getColumns()-1) ? "\n" : " ");
+		}
+	}
+	std::ostringstream actual;
+	writeMatrixText(large.view(), actual);
+	check(actual.str() == expected.str(), "text larger than the buffer");
+
+	AsyncWriter writer;
+	std::ostringstream printed;
+	std::vector<std::future<void> > done;
+	Matrix<short int> frame(3, 5, MatrixLayout(), FILL_NONE);
+	std::ostringstream frames;
+	for(int f = 0; f < 4; f++)
+	{
+		for(int i = 0; i < 3; i++)
+		{
+			for(int j = 0; j < 5; j++)
+			{
+				frame.view().getRow(i)[j] = (short int)(100*f + 10*i + j);
+			}
+		}
+		writeMatrixText(frame.view(), frames);
+		//the frame is overwritten right after, the writer prints its copy
+		done.push_back(writer.print(frame.view(), printed));
+	}
+	const std::string path = "equivalence_async_writer.cvmx";
+	done.push_back(writer.save(large.view(), path));
+	for(std::future<void> & job : done)
+	{
+		job.get();
+	}
+	check(printed.str() == frames.str(), "asynchronous prints in order");
+	Matrix<short int> loaded(path);
+	checkSame(loaded.view(), large.view(), "asynchronous save");
+	std::remove(path.c_str());
+
+	bool threw = false;
+	std::future<void> failed = writer.save(large.view(), "no_such_directory/matrix.cvmx");
+	try { failed.get(); } catch(const std::runtime_error &) { threw = true; }
+	check(threw, "asynchronous save error passed on");
+
+	//a header of 128 bytes is read, one that would misalign the elements is rejected
+	for(uint32_t headerBytes : { 128u, 66u })
+	{
+		MatrixFileHeader header = makeMatrixFileHeader(MatrixDType<short int>::code, 2, 3, 3);
+		header.headerBytes = headerBytes;
+		std::vector<char> bytes(headerBytes + 6*sizeof(short int), 0);
+		std::memcpy(&bytes[0], &header, sizeof(header));
+		const short int values[6] = { 1, -2, 3, -4, 5, -6 };
+		std::memcpy(&bytes[headerBytes], values, sizeof(values));
+		std::ofstream(path, std::ios::binary).write(&bytes[0], bytes.size());
+		threw = false;
+		try
+		{
+			Matrix<short int> read(path);
+			check(read.get(1, 2) == -6 && read.get(0, 0) == 1, "matrix file with a 128 byte header");
+		}
+		catch(const std::runtime_error &) { threw = true; }
+		check(threw == (headerBytes % 64 != 0), "matrix file header of " + std::to_string(headerBytes) + " bytes");
+		std::remove(path.c_str());
+	}
+}
+
+/**
+* M streamed row by row, with the min/max accumulated on the way
+*/
+void testStream()
+{
+	for(int s = 0; s < SHAPE_COUNT; s++)
+	{
+		const int rows = SHAPES[s].rows;
+		const int columns = SHAPES[s].columns;
+		const std::string shape = shapeName(rows, columns);
+		Matrix<unsigned char> M = randomMatrix(rows, columns, 700 + s);
+		std::string bytes;
+		for(int i = 0; i < rows; i++)
+		{
+			bytes.append((const char *)M.view().getRow(i), columns);
+		}
+		Matrix<int> expectedX = referenceConvolution<WrapBorder>(M, CENTRAL, IDENTITY);
+		Matrix<int> expectedY = referenceConvolution<WrapBorder>(M, IDENTITY, CENTRAL);
+		Matrix<short int> Dx = resultMatrix(rows, columns);
+		Matrix<short int> Dy = resultMatrix(rows, columns);
+
+		std::istringstream in(bytes);
+		MatrixRowSink dxSink(Dx);
+		MatrixRowSink dySink(Dy);
+		long streamed = 0;
+		const GradientExtrema extrema = convolveStream(in, columns, dxSink, dySink, streamed);
+		check(streamed == rows, "stream row count " + shape);
+		checkSame(Dx.view(), expectedX.view(), "stream Dx " + shape);
+		checkSame(Dy.view(), expectedY.view(), "stream Dy " + shape);
+		check(extrema.xMin == Dx.getMin() && extrema.xMax == Dx.getMax() && extrema.yMin == Dy.getMin() && extrema.yMax == Dy.getMax(),
+			"stream min/max " + shape);
+	}
+}
+
+/**
+* Dx and Dy brought up to date after changes to a few rectangles, with and without the
+* extrema counts, for changes at the wrap-around edges, random rectangles and the whole matrix
+*/
+void testIncremental()
+{
+	DirtyRegions regions;
+	for(int j = 0; j < 10; j++)
+	{
+		regions.add(3, j, 1, 1);
+	}
+	regions.add(20, 20, 2, 2);
+	check(regions.getRects().size() == 2 && regions.getArea() == 14, "dirty regions merge neighbors");
+
+	//scattered and diagonal changes keep their own area, not the box around them
+	DirtyRegions scattered;
+	for(int k = 0; k < 65; k++)
+	{
+		scattered.add((k*613) % 3998, (k*1931) % 3998, 2, 2);
+	}
+	check(scattered.getArea() == 65*4 && scattered.getRects().size() == 65, "dirty regions of scattered changes");
+	DirtyRegions diagonal;
+	for(int k = 0; k < 1000; k++)
+	{
+		diagonal.add(k, k, 1, 1);
+	}
+	check(diagonal.getArea() == 1000 && diagonal.getRects().size() == 1000, "dirty regions of a diagonal stroke");
+
+	//a block written pixel by pixel, and overlapping marks, are counted once
+	DirtyRegions block;
+	for(int i = 10; i < 74; i++)
+	{
+		for(int j = 64; j > 0; j--)
+		{
+			block.add(i, j, 1, 1);
+		}
+	}
+	block.add(40, 30, 5, 5);
+	check(block.getArea() == 64*64 && block.getRects().size() == 1 && block.getRects()[0].row == 10
+		&& block.getRects()[0].column == 1 && block.getRects()[0].rows == 64 && block.getRects()[0].columns == 64, "dirty regions of a block");
+	block.add(73, 60, 2, 10);
+	check(block.getArea() == 64*64 + 5 + 10 && block.getRects().size() == 3, "dirty regions of overlapping marks");
+	block.clear();
+	check(block.isEmpty() && block.getArea() == 0 && block.getRects().empty(), "dirty regions cleared");
+
+	std::mt19937 random(800);
+	for(int s = 0; s < SHAPE_COUNT; s++)
+	{
+		const int rows = SHAPES[s].rows;
+		const int columns = SHAPES[s].columns;
+		const std::string shape = shapeName(rows, columns);
+		Matrix<unsigned char> M = randomMatrix(rows, columns, 800 + s);
+		Matrix<short int> Dx = resultMatrix(rows, columns);
+		Matrix<short int> Dy = resultMatrix(rows, columns);
+		Matrix<short int> countedDx = resultMatrix(rows, columns);
+		Matrix<short int> countedDy = resultMatrix(rows, columns);
+		convolveSimd(M, Dx, Dy);
+		convolveSimd(M, countedDx, countedDy);
+		ExtremaCounts counts;
+		counts.build(countedDx, countedDy);
+		M.setDirtyTracking(true);
+
+		for(int round = 0; round < 4; round++)
+		{
+			if(round == 0)
+			{
+				//single pixels in the corners, whose halos wrap around both ways
+				M.put(0, 0, (unsigned char)random());
+				M.put(rows-1, columns-1, (unsigned char)random());
+				M.put(0, columns-1, (unsigned char)random());
+			}
+			else if(round == 3)
+			{
+				M.fillRand(900 + s);
+			}
+			else
+			{
+				for(int k = 0; k < 3; k++)
+				{
+					const int row = (int)(random() % rows);
+					const int column = (int)(random() % columns);
+					const int height = 1 + (int)(random() % std::min(rows - row, 5));
+					const int width = 1 + (int)(random() % std::min(columns - column, 40));
+					for(int i = row; i < row + height; i++)
+					{
+						for(int j = column; j < column + width; j++)
+						{
+							M.getMatrix()[(long)i*M.getStride() + j] = (unsigned char)random();
+						}
+					}
+					M.markDirty(row, column, height, width);
+				}
+			}
+
+			const std::string what = shape + " round " + std::to_string(round);
+			convolveDirty(M, M.getDirtyRegions(), Dx, Dy);
+			const GradientExtrema extrema = convolveDirty(M, M.getDirtyRegions(), countedDx, countedDy, counts);
+			M.clearDirty();
+			Matrix<int> expectedX = referenceConvolution<WrapBorder>(M, CENTRAL, IDENTITY);
+			Matrix<int> expectedY = referenceConvolution<WrapBorder>(M, IDENTITY, CENTRAL);
+			checkSame(Dx.view(), expectedX.view(), "incremental Dx " + what);
+			checkSame(Dy.view(), expectedY.view(), "incremental Dy " + what);
+			checkSame(countedDx.view(), expectedX.view(), "counted incremental Dx " + what);
+			checkSame(countedDy.view(), expectedY.view(), "counted incremental Dy " + what);
+			check(extrema.xMin == Dx.getMin() && extrema.xMax == Dx.getMax() && extrema.yMin == Dy.getMin() && extrema.yMax == Dy.getMax(),
+				"incremental min/max " + what);
+		}
+	}
+}
+
+/**
+* The compact engines give the reference narrowed by compactValue(), planar and
+* interleaved, for both narrowings, at every SIMD level this CPU has, serial and on a pool
+*/
+void testCompact()
+{
+	ThreadPool pool(3);
+	const CompactMode modes[] = { COMPACT_SATURATE, COMPACT_HALVE };
+	for(int s = 0; s < SHAPE_COUNT; s++)
+	{
+		const int rows = SHAPES[s].rows;
+		const int columns = SHAPES[s].columns;
+		const std::string shape = shapeName(rows, columns);
+		Matrix<unsigned char> M = randomMatrix(rows, columns, 800 + s);
+		Matrix<int> referenceX = referenceConvolution<WrapBorder>(M, CENTRAL, IDENTITY);
+		Matrix<int> referenceY = referenceConvolution<WrapBorder>(M, IDENTITY, CENTRAL);
+		Matrix<signed char> Dx(rows, columns, MatrixLayout(), FILL_NONE);
+		Matrix<signed char> Dy(rows, columns, MatrixLayout(), FILL_NONE);
+		Matrix<signed char> DxDy(rows, 2*columns, MatrixLayout(), FILL_NONE);
+
+		for(CompactMode mode : modes)
+		{
+			const std::string narrowing = (mode == COMPACT_HALVE) ? "halve" : "saturate";
+			Matrix<int> expectedX(rows, columns, MatrixLayout(), FILL_NONE);
+			Matrix<int> expectedY(rows, columns, MatrixLayout(), FILL_NONE);
+			Matrix<int> expectedXY(rows, 2*columns, MatrixLayout(), FILL_NONE);
+			for(int i = 0; i < rows; i++)
+			{
+				for(int j = 0; j < columns; j++)
+				{
+					const int x = compactValue(referenceX.view().getRow(i)[j], mode);
+					const int y = compactValue(referenceY.view().getRow(i)[j], mode);
+					expectedX.view().getRow(i)[j] = x;
+					expectedY.view().getRow(i)[j] = y;
+					expectedXY.view().getRow(i)[2*j] = x;
+					expectedXY.view().getRow(i)[2*j+1] = y;
+				}
+			}
+			auto expect = [&](const std::string & engine)
+			{
+				checkSame(Dx.view(), expectedX.view(), engine + " " + narrowing + " Dx " + shape);
+				checkSame(Dy.view(), expectedY.view(), engine + " " + narrowing + " Dy " + shape);
+			};
+			auto expectInterleaved = [&](const std::string & engine)
+			{
+				checkSame(DxDy.view(), expectedXY.view(), engine + " " + narrowing + " DxDy " + shape);
+				const GradientExtrema extrema = getInterleavedExtrema(DxDy);
+				check(extrema.xMin == Dx.getMin() && extrema.xMax == Dx.getMax() && extrema.yMin == Dy.getMin() && extrema.yMax == Dy.getMax(),
+					engine + " " + narrowing + " interleaved min/max " + shape);
+			};
+
+			for(int level = SIMD_SCALAR; level <= simdLevel(); level++)
+			{
+				const std::string name = std::string("compact/") + simdLevelName((SimdLevel)level);
+				CompactRowKernels kernels = compactRowKernels((SimdLevel)level, mode);
+				convolveRowRange(M.view(), Dx.view(), Dy.view(), kernels, 0, rows);
+				expect(name);
+				convolveInterleavedRange(M.view(), DxDy.view(), kernels, 0, rows);
+				expectInterleaved(name);
+			}
+			convolveCompact(M, Dx, Dy, mode, pool);
+			expect("compact parallel");
+			convolveInterleaved(M, DxDy, mode, pool);
+			expectInterleaved("interleaved parallel");
+		}
+	}
+}
+
+/**
+* The histogram statistics of Dx and Dy match sorting a copy of them: min, max, mean,
+* variance and nearest-rank percentiles, serial and on a pool, and values out of range throw
+*/
+void testHistogram()
+{
+	ThreadPool pool(3);
+	const double percents[] = { 0.0, 0.1, 1.0, 25.0, 50.0, 99.0, 99.9, 100.0 };
+	for(int s = 0; s < SHAPE_COUNT; s++)
+	{
+		const int rows = SHAPES[s].rows;
+		const int columns = SHAPES[s].columns;
+		const std::string shape = shapeName(rows, columns);
+		Matrix<unsigned char> M = randomMatrix(rows, columns, 900 + s);
+		Matrix<short int> Dx = resultMatrix(rows, columns);
+		Matrix<short int> Dy = resultMatrix(rows, columns);
+		convolveSimd(M, Dx, Dy);
+
+		std::vector<int> sorted;
+		for(int i = 0; i < rows; i++)
+		{
+			sorted.insert(sorted.end(), Dx.view().getRow(i), Dx.view().getRow(i) + columns);
+		}
+		std::sort(sorted.begin(), sorted.end());
+		double mean = 0.0;
+		for(int value : sorted) mean += value;
+		mean /= sorted.size();
+		double variance = 0.0;
+		for(int value : sorted) variance += (value - mean)*(value - mean);
+		variance /= sorted.size();
+
+		const GradientHistogram serial = computeHistogram(Dx.view());
+		const GradientHistogram parallel = computeHistogram(Dx.view(), pool);
+		for(const GradientHistogram * histogram : { &serial, &parallel })
+		{
+			const std::string name = ((histogram == &serial) ? "histogram " : "parallel histogram ") + shape;
+			check(histogram->getTotal() == (long)sorted.size() && histogram->getOutOfRange() == 0, name + " total");
+			check(histogram->getMin() == Dx.getMin() && histogram->getMax() == Dx.getMax(), name + " min/max");
+			check(std::fabs(histogram->getMean() - mean) < 1e-9 && std::fabs(histogram->getVariance() - variance) < 1e-6*(1.0 + variance), name + " mean/variance");
+			for(double percent : percents)
+			{
+				const long rank = std::max(1L, (long)std::ceil(percent / 100.0 * sorted.size()));
+				check(histogram->getPercentile(percent) == sorted[rank - 1], name + " p" + std::to_string(percent));
+			}
+			check(histogram->getCount(sorted[0]) == (long)(std::upper_bound(sorted.begin(), sorted.end(), sorted[0]) - sorted.begin()), name + " count");
+		}
+	}
+
+	//the Sobel results of the kernel engine need a range of 4*255
+	Matrix<unsigned char> M = randomMatrix(64, 64, 950);
+	Matrix<short int> sobel = resultMatrix(64, 64);
+	convolveSeparable<CentralDifferenceKernel, SobelSmoothKernel>(M.view(), sobel.view());
+	bool threw = false;
+	try { computeHistogram(sobel.view(), pool); } catch(const std::out_of_range &) { threw = true; }
+	check(threw, "histogram out of range throws");
+	const GradientHistogram wide = computeHistogram(sobel.view(), -4*255, 4*255);
+	check(wide.getMin() == sobel.getMin() && wide.getMax() == sobel.getMax() && wide.getTotal() == 64*64, "histogram of a wider range");
+
+	const GradientHistogram empty;
+	check(empty.getTotal() == 0 && empty.getMin() == 0 && empty.getMax() == 0 && empty.getPercentile(50.0) == 0 && empty.getMean() == 0.0, "empty histogram");
+	threw = false;
+	try { empty.getPercentile(100.5); } catch(const std::invalid_argument &) { threw = true; }
+	check(threw, "percentile out of [0, 100] throws");
+}
+
+/**
+* Box sums and means from summed-area tables match convolving with a kernel of ones with
+* WrapBorder, for boxes inside M, across its edges and wider than M, serial and on a pool,
+* with 32 and 64 bit sums
+*/
+void testSummedArea()
+{
+	ThreadPool pool(3);
+	const int radii[] = { 0, 1, 2, 7, 40 };
+	for(int s = 0; s < SHAPE_COUNT; s++)
+	{
+		const int rows = SHAPES[s].rows;
+		const int columns = SHAPES[s].columns;
+		const std::string shape = shapeName(rows, columns);
+		Matrix<unsigned char> M = randomMatrix(rows, columns, 1000 + s);
+		SummedAreaTable<unsigned char> serial;
+		serial.build(M.view());
+		SummedAreaTable<unsigned char> parallel;
+		parallel.build(M.view(), pool);
+		check(!serial.isWide(), "summed area table is 32 bit " + shape);
+
+		for(int radius : radii)
+		{
+			//the reference costs the area of the box per pixel, the large shapes take the small boxes only
+			if(radius > 2 && (long)rows*columns > 20000)
+			{
+				continue;
+			}
+			const std::string name = shape + " radius " + std::to_string(radius);
+			const std::vector<int> ones(2*radius + 1, 1);
+			Matrix<int> expected = referenceConvolution<WrapBorder>(M, ones, ones);
+			Matrix<int> sums(rows, columns, MatrixLayout(), FILL_NONE);
+			boxSum(serial, sums.view(), radius);
+			checkSame(sums.view(), expected.view(), "box sum " + name);
+			boxSum(parallel, sums.view(), radius);
+			checkSame(sums.view(), expected.view(), "box sum of the parallel table " + name);
+
+			Matrix<int> expectedMeans(rows, columns, MatrixLayout(), FILL_NONE);
+			const double area = (2.0*radius + 1.0)*(2.0*radius + 1.0);
+			for(int i = 0; i < rows; i++)
+			{
+				for(int j = 0; j < columns; j++)
+				{
+					expectedMeans.view().getRow(i)[j] = (int)std::llround(expected.view().getRow(i)[j] / area);
+				}
+			}
+			Matrix<unsigned char> means(rows, columns, MatrixLayout(), FILL_NONE);
+			boxMean(parallel, means.view(), radius, pool);
+			checkSame(means.view(), expectedMeans.view(), "box mean " + name);
+			check(serial.boxSum(rows - 1, 0, radius) == (uint64_t)expected.view().getRow(rows - 1)[0], "box sum query " + name);
+		}
+
+		Matrix<short int> normalized(rows, columns, MatrixLayout(), FILL_NONE);
+		subtractLocalMean(M.view(), serial, normalized.view(), 2);
+		const double area = 25.0;
+		const std::vector<int> ones(5, 1);
+		Matrix<int> sums = referenceConvolution<WrapBorder>(M, ones, ones);
+		bool same = true;
+		for(int i = 0; i < rows; i++)
+		{
+			for(int j = 0; j < columns; j++)
+			{
+				same = same && normalized.view().getRow(i)[j] == M.view().getRow(i)[j] - std::llround(sums.view().getRow(i)[j] / area);
+			}
+		}
+		check(same, "local mean normalization " + shape);
+	}
+
+	//the sum of 300x300 short ints can pass 2^31, so the table switches to 64 bit sums
+	Matrix<short int> D(300, 300, MatrixLayout(), FILL_NONE);
+	for(int i = 0; i < 300; i++)
+	{
+		for(int j = 0; j < 300; j++)
+		{
+			D.view().getRow(i)[j] = (short int)(((i*7 + j*13) % 2 == 0) ? 32767 - i : -32768 + j);
+		}
+	}
+	SummedAreaTable<short int> wide;
+	wide.build(D.view(), pool);
+	check(wide.isWide(), "summed area table switches to 64 bit");
+	const int rectangles[][4] = { { 0, 0, 300, 300 }, { -5, 290, 17, 23 }, { 150, -400, 3, 700 }, { 299, 299, 1, 1 }, { -301, -1, 602, 2 } };
+	for(const auto & r : rectangles)
+	{
+		int64_t expected = 0;
+		for(int i = r[0]; i < r[0] + r[2]; i++)
+		{
+			for(int j = r[1]; j < r[1] + r[3]; j++)
+			{
+				expected += D.view().getRow(WrapBorder::index(i, 300))[WrapBorder::index(j, 300)];
+			}
+		}
+		check(wide.rectangleSum(r[0], r[1], r[2], r[3]) == expected, "64 bit rectangle sum at " + std::to_string(r[0]) + ", " + std::to_string(r[1]));
+	}
+}
+
+/**
+* Fused expressions give what the chain gives stage by stage: gradients equal to the Dx and
+* Dy engines, elementwise operations, thresholds and reductions, serial and on a pool
+*/
+void testExpressions()
+{
+	ThreadPool pool(3);
+	for(int s = 0; s < SHAPE_COUNT; s++)
+	{
+		const int rows = SHAPES[s].rows;
+		const int columns = SHAPES[s].columns;
+		const std::string shape = shapeName(rows, columns);
+		Matrix<unsigned char> M = randomMatrix(rows, columns, 1100 + s);
+		Matrix<short int> Dx = resultMatrix(rows, columns);
+		Matrix<short int> Dy = resultMatrix(rows, columns);
+		convolveSimd(M, Dx, Dy);
+
+		Matrix<short int> out = resultMatrix(rows, columns);
+		evaluate(gradientX(M), out.view());
+		checkSame(out.view(), Dx.view(), "expression Dx " + shape);
+		evaluate(gradientY(M), out.view(), pool);
+		checkSame(out.view(), Dy.view(), "parallel expression Dy " + shape);
+
+		//the chain stage by stage: L1 magnitude, threshold, then a scaled and clamped mix
+		Matrix<int> expected(rows, columns, MatrixLayout(), FILL_NONE);
+		Matrix<int> mixed(rows, columns, MatrixLayout(), FILL_NONE);
+		ExpressionExtrema<int> extrema = { std::numeric_limits<int>::max(), std::numeric_limits<int>::lowest() };
+		long long sum = 0;
+		long nonZero = 0;
+		for(int i = 0; i < rows; i++)
+		{
+			for(int j = 0; j < columns; j++)
+			{
+				const int dx = Dx.view().getRow(i)[j];
+				const int dy = Dy.view().getRow(i)[j];
+				int magnitude = std::abs(dx) + std::abs(dy);
+				magnitude = (magnitude < 100) ? 0 : magnitude;
+				expected.view().getRow(i)[j] = magnitude;
+				mixed.view().getRow(i)[j] = std::max(-20, std::min(3*dx - dy + 1, 300));
+				extrema.min = std::min(extrema.min, magnitude);
+				extrema.max = std::max(extrema.max, magnitude);
+				sum += magnitude;
+				nonZero += (magnitude != 0);
+			}
+		}
+		const auto chain = threshold(abs(gradientX(M)) + abs(gradientY(M)), 100);
+		Matrix<int> result(rows, columns, MatrixLayout(), FILL_NONE);
+		evaluate(chain, result.view(), pool);
+		checkSame(result.view(), expected.view(), "expression chain " + shape);
+		evaluate(maximum(-20, minimum(3*lazy(Dx) - lazy(Dy) + 1, 300)), result.view());
+		checkSame(result.view(), mixed.view(), "expression with scalars " + shape);
+
+		const ExpressionExtrema<int> serial = getExtrema(chain);
+		const ExpressionExtrema<int> parallel = getExtrema(chain, pool);
+		check(serial.min == extrema.min && serial.max == extrema.max && parallel.min == extrema.min && parallel.max == extrema.max, "expression extrema " + shape);
+		check(getMin(chain) == extrema.min && getMax(chain, pool) == extrema.max, "expression min/max " + shape);
+		check(getSum(chain) == sum && getSum(chain, pool) == sum, "expression sum " + shape);
+		check(countNonZero(chain) == nonZero && countNonZero(chain, pool) == nonZero, "expression count " + shape);
+
+		//an elementwise chain can be stored over its own input
+		Matrix<short int> negated = resultMatrix(rows, columns);
+		evaluate(-lazy(Dx), negated.view());
+		evaluate(-lazy(negated), negated.view(), pool);
+		checkSame(negated.view(), Dx.view(), "expression in place " + shape);
+	}
+
+	//a region is a matrix of its own, its gradients wrap around inside it
+	Matrix<unsigned char> M = randomMatrix(40, 50, 1190);
+	MatrixView<unsigned char> region = M.view().subView(5, 7, 20, 30);
+	Matrix<short int> Dx = resultMatrix(20, 30);
+	Matrix<short int> Dy = resultMatrix(20, 30);
+	convolveSimd(region, Dx.view(), Dy.view());
+	Matrix<short int> out = resultMatrix(20, 30);
+	evaluate(gradientX(region) - gradientY(region), out.view());
+	Matrix<int> expected(20, 30, MatrixLayout(), FILL_NONE);
+	evaluate(lazy(Dx) - lazy(Dy), expected.view());
+	checkSame(out.view(), expected.view(), "expression of a region");
+
+	//new stages through map() and zip(), and float values
+	Matrix<float> F(20, 30, MatrixLayout(), FILL_NONE);
+	evaluate(map(lazy(region), [](unsigned char v) { return v * 0.5f; }), F.view());
+	double halfSum = 0.0;
+	for(int i = 0; i < 20; i++)
+	{
+		for(int j = 0; j < 30; j++)
+		{
+			halfSum += region.getRow(i)[j] * 0.5;
+		}
+	}
+	check(std::fabs(getSum(lazy(F)) - halfSum) < 1e-6, "expression map to float");
+	check(getMax(zip(lazy(F), lazy(region), [](float h, unsigned char v) { return v - 2*h; })) == 0.0f, "expression zip");
+
+	bool threw = false;
+	try { gradientX(M) + lazy(Dx); } catch(const std::invalid_argument &) { threw = true; }
+	check(threw, "expression of different shapes throws");
+	threw = false;
+	try { evaluate(gradientX(region), M.view()); } catch(const std::invalid_argument &) { threw = true; }
+	check(threw, "expression into an output of another shape throws");
+}
+
+int main()
+{
+	std::cout << "SIMD level: " << simdLevelName(simdLevel()) << std::endl;
+	testNaiveMatchesReference();
+	testRowEngines();
+	testKernelEngine<WrapBorder>("wrap");
+	testKernelEngine<ClampBorder>("clamp");
+	testKernelEngine<MirrorBorder>("mirror");
+	testKernelEngine<ZeroBorder>("zero");
+	testKernelEngine<ValidBorder>("valid");
+	testElementType<unsigned short int>("uint16", 0.0);
+	testElementType<short int>("int16", 0.0);
+	testElementType<float>("float", 1e-4);
+	testElementType<double>("double", 1e-9);
+	testGradient();
+	testThreadPool();
+	testViews();
+	testBatch();
+	testWriter();
+	testStream();
+	testIncremental();
+	testCompact();
+	testHistogram();
+	testSummedArea();
+	testExpressions();
+	std::cout << checks << " checks, " << failures << " failed" << std::endl;
+	return (failures == 0) ? 0 : 1;
+}